@@ -0,0 +1,156 @@
+/*
+snippet_bench — in-process benchmark of the generator library.
+
+Runs the lines of recorded sessions (the lines typed at the interactive prompt;
+':' commands and 'exit' are skipped) through Generator::generate() with every
+follow-up question answered by its default, and reports throughput, latency
+percentiles and the time spent in each stage. No server or socket is involved,
+so the numbers are the generator's own cost; this is also the training workload
+of the profile-guided build (see CMakeLists.txt).
+
+With --check the run fails (exit 1) if any line produces no program, which is
+how the regression tests use it.
+
+Compile: g++ -std=c++17 -O2 -Wall -Wextra -pthread -o snippet_bench snippet_bench.cpp snippetgen.cpp snippet_tools.cpp
+*/
+
+#include "snippetgen.h"
+#include "snippet_tools.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::string;
+using std::vector;
+
+using namespace snippetgen;
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    string db_path = USER_KW_FILE;
+    vector<string> session_files;
+    unsigned iterations = 20;  // passes over all session lines
+    unsigned warmup = 2;       // passes before measuring
+    bool check = false;        // fail if a line produces no program
+};
+
+static double micros(std::chrono::nanoseconds d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+static void print_usage(const char *argv0) {
+    cout << "Usage: " << argv0 << " [options] <session file>...\n"
+         << "  --db <file>          keyword database (default " << USER_KW_FILE << ")\n"
+         << "  --iterations N       measured passes over all lines (default 20)\n"
+         << "  --warmup N           unmeasured passes first (default 2)\n"
+         << "  --check              exit 1 if a line produces no program\n";
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&]() -> string {
+            if (i + 1 >= argc) throw std::invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+        try {
+            if (arg == "--db") opts.db_path = value();
+            else if (arg == "--iterations") opts.iterations = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--warmup") opts.warmup = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--check") opts.check = true;
+            else if (arg == "--help" || arg == "-h") { print_usage(argv[0]); return 0; }
+            else if (!arg.empty() && arg[0] == '-') { cerr << "Unknown option '" << arg << "'.\n"; print_usage(argv[0]); return 2; }
+            else opts.session_files.push_back(arg);
+        } catch (const std::exception &) {
+            cerr << "Invalid value for " << arg << ".\n";
+            return 2;
+        }
+    }
+    if (opts.session_files.empty()) { print_usage(argv[0]); return 2; }
+    if (opts.iterations == 0) { cerr << "--iterations must be positive.\n"; return 2; }
+
+    vector<string> lines;
+    for (const auto &f : opts.session_files) {
+        if (!read_session(f, lines)) { cerr << "Cannot read " << f << ".\n"; return 1; }
+    }
+    if (lines.empty()) { cerr << "No session lines to run.\n"; return 1; }
+
+    Generator gen(opts.db_path);
+    const auto load_start = Clock::now();
+    gen.load();
+    const double load_us = std::chrono::duration<double, std::micro>(Clock::now() - load_start).count();
+
+    GenerateOptions gopts;
+    gopts.offer_definitions = false; // never write the database
+    const AnswerProvider answers = default_answers();
+
+    for (unsigned w = 0; w < opts.warmup; ++w) {
+        for (const auto &line : lines) gen.generate(line, answers, gopts);
+    }
+
+    vector<double> latencies_us;
+    latencies_us.reserve(lines.size() * opts.iterations);
+    GenerateTimings stages;
+    size_t failed = 0;
+    size_t with_issues = 0; // lines whose program fails the structural check (first pass)
+    size_t with_lint = 0;   // lines whose program has performance lint findings (first pass)
+    size_t bytes = 0;
+    const auto start = Clock::now();
+    for (unsigned it = 0; it < opts.iterations; ++it) {
+        for (const auto &line : lines) {
+            const auto t0 = Clock::now();
+            GenerateResult res = gen.generate(line, answers, gopts);
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+            stages.tokenize += res.timings.tokenize;
+            stages.expand += res.timings.expand;
+            stages.assemble += res.timings.assemble;
+            stages.validate += res.timings.validate;
+            stages.lint += res.timings.lint;
+            if (it == 0 && !res.issues.empty()) ++with_issues;
+            if (it == 0 && !res.lint.empty()) ++with_lint;
+            bytes += res.program.size();
+            if (!res.ok) {
+                // report each failing line once
+                if (it == 0 && opts.check) cerr << "no program for '" << line << "': " << res.error << "\n";
+                ++failed;
+            }
+        }
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies_us.begin(), latencies_us.end());
+    double mean = 0;
+    for (double v : latencies_us) mean += v;
+    mean /= static_cast<double>(latencies_us.size());
+    const double n = static_cast<double>(latencies_us.size());
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "database:    " << gen.db().entries.size() << " keyword(s), loaded in " << load_us << " us\n";
+    cout << "requests:    " << latencies_us.size() << " (" << lines.size() << " line(s) x " << opts.iterations
+         << " pass(es)), " << failed << " without a program\n";
+    cout << "structure:   " << with_issues << " of " << lines.size() << " line(s) with structural issues\n";
+    cout << "lint:        " << with_lint << " of " << lines.size() << " line(s) with performance findings\n";
+    cout << "elapsed:     " << std::setprecision(3) << elapsed << std::setprecision(1) << " s\n";
+    cout << "throughput:  " << (elapsed > 0 ? n / elapsed : 0) << " req/s, "
+         << (elapsed > 0 ? static_cast<double>(bytes) / elapsed / 1e6 : 0) << " MB/s of program text\n";
+    cout << "latency us:  mean " << mean
+         << "  p50 " << percentile(latencies_us, 50)
+         << "  p90 " << percentile(latencies_us, 90)
+         << "  p99 " << percentile(latencies_us, 99)
+         << "  max " << latencies_us.back() << "\n";
+    cout << "stages us:   tokenize " << micros(stages.tokenize) / n
+         << "  expand " << micros(stages.expand) / n
+         << "  assemble " << micros(stages.assemble) / n
+         << "  validate " << micros(stages.validate) / n
+         << "  lint " << micros(stages.lint) / n << " (mean per request)\n";
+    return (opts.check && failed) ? 1 : 0;
+}
@@ -0,0 +1,1015 @@
+/*
+Building generated programs with a local compiler (POSIX only). See snippet_build.h.
+*/
+
+#include "snippet_build.h"
+#include "snippetgen.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#ifndef _WIN32
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <thread>
+#include <cxxabi.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace snippetgen {
+
+std::string default_compiler() {
+    const char *cxx = std::getenv("CXX");
+    return (cxx && *cxx) ? std::string(cxx) : std::string("c++");
+}
+
+#ifdef _WIN32
+
+CommandResult run_command(const std::vector<std::string> &, const std::string &, unsigned, const ChildLimits &, bool) {
+    CommandResult res;
+    res.output = "running programs is not supported on this platform";
+    return res;
+}
+
+ScratchDir::ScratchDir() {}
+ScratchDir::~ScratchDir() {}
+
+bool print_asm_by_occurrence(const std::string &, const BuildOptions &, std::ostream &out) {
+    out << "The assembly view is not supported on this platform.\n";
+    return false;
+}
+
+bool print_build_matrix(const std::string &, const BuildOptions &, const MatrixOptions &, std::ostream &out) {
+    out << "Build matrices are not supported on this platform.\n";
+    return false;
+}
+
+bool print_compiler_comparison(const std::string &, const BuildOptions &, const CompareOptions &, std::ostream &out) {
+    out << "Compiler comparisons are not supported on this platform.\n";
+    return false;
+}
+
+#else
+
+using std::string;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+// Captured output beyond this is read and dropped, so a chatty child cannot grow memory.
+static const size_t MAX_CAPTURED_OUTPUT = 1u << 20;
+
+// -------------------- Counters --------------------
+
+// perf_event_open counters attached to a child before it execs. Each counter
+// is opened on its own, so one the CPU lacks does not take the others along.
+class ChildCounters {
+public:
+    ChildCounters() = default;
+    ChildCounters(const ChildCounters &) = delete;
+    ChildCounters &operator=(const ChildCounters &) = delete;
+    ~ChildCounters() {
+        for (const auto &c : open_) ::close(c.fd);
+    }
+
+    // Open what can be opened on `pid`; counting starts when it execs.
+    void open(pid_t pid);
+    // Read the counts of the reaped child into `rc`; `usage` fills what perf could not count.
+    void read(RunCounters &rc, const rusage &usage) const;
+
+private:
+    struct Counter {
+        int fd;
+        bool hardware;
+        long long RunCounters::*field;
+    };
+    vector<Counter> open_;
+    string hardware_error_; // why no hardware counter opened
+    string software_error_;
+};
+
+void ChildCounters::open(pid_t pid) {
+#ifdef __linux__
+    struct Spec {
+        uint32_t type;
+        uint64_t config;
+        long long RunCounters::*field;
+    };
+    static const Spec specs[] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, &RunCounters::cycles},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, &RunCounters::instructions},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, &RunCounters::cache_misses},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, &RunCounters::branch_misses},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, &RunCounters::task_clock_ns},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, &RunCounters::page_faults}};
+    for (const auto &spec : specs) {
+        perf_event_attr attr {};
+        attr.size = sizeof attr;
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = 1;
+        attr.enable_on_exec = 1; // the program, not the fork's setup
+        attr.inherit = 1;        // and its threads
+        attr.exclude_kernel = 1; // allowed without privileges at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        const bool hardware = spec.type == PERF_TYPE_HARDWARE;
+        if (fd >= 0) {
+            open_.push_back({fd, hardware, spec.field});
+        } else {
+            string &error = hardware ? hardware_error_ : software_error_;
+            if (error.empty()) error = std::strerror(errno);
+        }
+    }
+#else
+    (void)pid;
+    hardware_error_ = software_error_ = "not available on this platform";
+#endif
+}
+
+void ChildCounters::read(RunCounters &rc, const rusage &usage) const {
+    bool hardware = false;
+    bool software = false;
+    for (const auto &c : open_) {
+        uint64_t v[3]; // value, time enabled, time running
+        if (::read(c.fd, v, sizeof v) != static_cast<ssize_t>(sizeof v) || v[2] == 0) continue;
+        // scaled up if the counter shared the PMU with others and ran part of the time
+        const double scale = v[2] < v[1] ? static_cast<double>(v[1]) / static_cast<double>(v[2]) : 1.0;
+        rc.*c.field = static_cast<long long>(static_cast<double>(v[0]) * scale);
+        (c.hardware ? hardware : software) = true;
+    }
+    if (hardware) {
+        rc.source = "hardware";
+    } else if (software) {
+        rc.source = "software";
+        rc.note = "hardware counters: " + (hardware_error_.empty() ? string("not counted") : hardware_error_);
+    } else {
+        rc.source = "rusage";
+        const string &error = !software_error_.empty() ? software_error_ : hardware_error_;
+        rc.note = "perf_event_open: " + (error.empty() ? string("not counted") : error);
+    }
+    if (rc.task_clock_ns < 0) {
+        rc.task_clock_ns = (static_cast<long long>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000000ll +
+                           (static_cast<long long>(usage.ru_utime.tv_usec) + usage.ru_stime.tv_usec) * 1000ll;
+    }
+    if (rc.page_faults < 0) rc.page_faults = static_cast<long long>(usage.ru_minflt) + usage.ru_majflt;
+}
+
+// -------------------- Child processes --------------------
+
+CommandResult run_command(const vector<string> &argv, const string &dir, unsigned timeout_ms,
+                          const ChildLimits &limits, bool count_events) {
+    CommandResult res;
+    if (argv.empty()) return res;
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1}; // reports a failed chdir/exec: CLOEXEC, so it closes unread on success
+    auto close_pipes = [&] {
+        for (int fd : {out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]}) {
+            if (fd >= 0) ::close(fd);
+        }
+    };
+    if (::pipe2(out_pipe, O_CLOEXEC) != 0 || ::pipe2(err_pipe, O_CLOEXEC) != 0) {
+        res.output = std::strerror(errno);
+        close_pipes();
+        return res;
+    }
+    vector<char *> args;
+    for (const auto &a : argv) args.push_back(const_cast<char *>(a.c_str()));
+    args.push_back(nullptr);
+
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::milliseconds(timeout_ms);
+    auto wait_ms = [&]() -> int { // poll() timeout until the deadline, at most 1 s; -1 without one
+        if (!timeout_ms) return -1;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        return static_cast<int>(std::max<long long>(0, std::min<long long>(left, 1000)));
+    };
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        res.output = std::strerror(errno);
+        close_pipes();
+        return res;
+    }
+    if (pid == 0) {
+        ::setpgid(0, 0); // its own group, so a timeout also stops what it started
+        ::dup2(out_pipe[1], 1);
+        ::dup2(out_pipe[1], 2);
+        int fd = ::open("/dev/null", O_RDONLY);
+        if (fd >= 0) ::dup2(fd, 0);
+        if (limits.memory_bytes) {
+            rlimit rl{limits.memory_bytes, limits.memory_bytes};
+            ::setrlimit(RLIMIT_AS, &rl);
+        }
+        if (limits.cpu_seconds) {
+            rlimit rl{limits.cpu_seconds, limits.cpu_seconds + 1}; // SIGXCPU, then SIGKILL
+            ::setrlimit(RLIMIT_CPU, &rl);
+        }
+        // Held until the parent has opened the counters. A stop rather than a
+        // pipe: a pipe's write end leaks into children other threads fork
+        // meanwhile, and two such children can wait for each other forever.
+        if (count_events) ::raise(SIGSTOP);
+        if (dir.empty() || ::chdir(dir.c_str()) == 0) ::execvp(args[0], args.data());
+        int e = errno;
+        ssize_t w = ::write(err_pipe[1], &e, sizeof e);
+        (void)w;
+        ::_exit(127);
+    }
+    ::setpgid(pid, pid);
+    ::close(out_pipe[1]);
+    ::close(err_pipe[1]);
+    int status = 0;
+    rusage usage {};
+    bool reaped = false;
+    ChildCounters counters;
+    if (count_events) {
+        pid_t w;
+        while ((w = ::wait4(pid, &status, WUNTRACED, &usage)) < 0 && errno == EINTR) {}
+        if (w == pid && WIFSTOPPED(status)) {
+            counters.open(pid);
+            ::kill(pid, SIGCONT);
+        } else {
+            reaped = w == pid; // it never got as far as the stop
+        }
+    }
+
+    // EOF once the exec succeeded. A child another thread forks meanwhile
+    // holds the write end until its own exec, so the wait is bounded too.
+    int exec_errno = 0;
+    ssize_t got = 0;
+    while (true) {
+        pollfd p{err_pipe[0], POLLIN, 0};
+        int r = ::poll(&p, 1, wait_ms());
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            if (r == 0 && timeout_ms && Clock::now() < deadline) continue;
+            break;
+        }
+        got = ::read(err_pipe[0], &exec_errno, sizeof exec_errno);
+        if (got < 0 && errno == EINTR) continue;
+        break;
+    }
+    ::close(err_pipe[0]);
+    res.started = got != static_cast<ssize_t>(sizeof exec_errno);
+    if (!res.started) res.output = argv[0] + ": " + std::strerror(exec_errno);
+
+    char buf[65536];
+    while (!reaped) {
+        if (timeout_ms && Clock::now() >= deadline) {
+            ::kill(-pid, SIGKILL);
+            res.timed_out = true;
+            break;
+        }
+        pollfd p{out_pipe[0], POLLIN, 0};
+        int r = ::poll(&p, 1, wait_ms());
+        if (r < 0 && errno != EINTR) break;
+        if (r <= 0) continue;
+        ssize_t n = ::read(out_pipe[0], buf, sizeof buf);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (res.output.size() < MAX_CAPTURED_OUTPUT) {
+            res.output.append(buf, std::min(static_cast<size_t>(n), MAX_CAPTURED_OUTPUT - res.output.size()));
+        }
+    }
+    ::close(out_pipe[0]);
+    // The output can reach EOF while the program runs on (it closed its
+    // stdout, or a grandchild holds the pipe): the deadline still applies.
+    auto pause = std::chrono::milliseconds(1);
+    while (!reaped) {
+        const bool bounded = timeout_ms && !res.timed_out;
+        pid_t w = ::wait4(pid, &status, bounded ? WNOHANG : 0, &usage);
+        if (w == pid) break;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (Clock::now() >= deadline) {
+            ::kill(-pid, SIGKILL);
+            res.timed_out = true;
+            continue;
+        }
+        std::this_thread::sleep_for(pause);
+        pause = std::min(pause * 2, std::chrono::milliseconds(50));
+    }
+    res.elapsed = Clock::now() - start;
+    if (WIFEXITED(status)) res.exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) res.signal = WTERMSIG(status);
+    if (count_events && res.started) counters.read(res.counters, usage);
+    return res;
+}
+
+ScratchDir::ScratchDir() {
+    const char *tmp = std::getenv("TMPDIR");
+    string templ = string((tmp && *tmp) ? tmp : "/tmp") + "/snippetgen-XXXXXX";
+    if (::mkdtemp(&templ[0])) path_ = std::move(templ);
+}
+
+ScratchDir::~ScratchDir() {
+    if (path_.empty()) return;
+    std::error_code ec;
+    std::filesystem::remove_all(path_, ec);
+}
+
+static bool write_file(const string &path, const string &text) {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs << text;
+    return static_cast<bool>(ofs.flush());
+}
+
+static string read_file(const string &path) {
+    std::ifstream ifs(path, std::ios::binary);
+    std::ostringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static string command_line(const vector<string> &argv) {
+    string out;
+    for (const auto &a : argv) {
+        if (!out.empty()) out += ' ';
+        out += a;
+    }
+    return out;
+}
+
+// -------------------- Assembly view --------------------
+
+static const char *const MARK = "sg-mark ";
+
+// One occurrence's share of main(): the source lines after its tag comment.
+struct AsmSegment {
+    string tag;
+    vector<string> source;
+    vector<string> assembly;
+};
+
+// The occurrence tag of a handler's comment line ("// (occurrence 2 (token 3)) ..."),
+// or "" for other lines. Nested expansions are tagged "occurrence 0"; their
+// code belongs to the occurrence that expanded them.
+static string top_occurrence_tag(const string &line) {
+    std::string_view t = trim_view(line);
+    if (t.rfind("// (", 0) != 0) return string();
+    std::string_view tag = occurrence_tag_in(t);
+    return tag.rfind("occurrence 0 ", 0) == 0 ? string() : string(tag);
+}
+
+// `program` with a marker after each occurrence comment in main() and one
+// before the final "return 0;", and the occurrences' source lines.
+static string add_occurrence_markers(const string &program, vector<AsmSegment> &segments) {
+    vector<string> lines;
+    std::istringstream in(program);
+    for (string ln; std::getline(in, ln);) lines.push_back(std::move(ln));
+
+    // make_program_from_body_lines ends main() with "    return 0;" and "}"
+    size_t end = lines.size();
+    if (end >= 2 && lines[end - 1] == "}" && lines[end - 2] == "    return 0;") end -= 2;
+
+    string out;
+    bool in_main = false;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const string &ln = lines[i];
+        if (i == end) out += "    __asm__ volatile(\"# " + string(MARK) + "end\" ::: \"memory\");\n";
+        out += ln;
+        out += '\n';
+        if (!in_main) { in_main = ln.rfind("int main(", 0) == 0; continue; }
+        if (i >= end) continue;
+        string tag = top_occurrence_tag(ln);
+        if (!tag.empty()) {
+            out += ln.substr(0, ln.find('/')) + "__asm__ volatile(\"# " + MARK + std::to_string(segments.size()) +
+                   "\" ::: \"memory\");\n";
+            segments.push_back({tag, {}, {}});
+        }
+        if (!segments.empty()) segments.back().source.push_back(ln);
+    }
+    return out;
+}
+
+static string demangle(const string &name) {
+    int status = 0;
+    char *d = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (!d) return name;
+    string out(d);
+    std::free(d);
+    return out;
+}
+
+struct AsmFunction {
+    string name;
+    vector<string> lines;
+};
+
+// The functions of a -S listing with their instructions and local labels;
+// directives and compiler comments are left out, markers are kept.
+static vector<AsmFunction> parse_asm_functions(const string &text) {
+    std::set<string> function_names; // from ".type name, @function" (ELF)
+    {
+        std::istringstream in(text);
+        for (string ln; std::getline(in, ln);) {
+            std::string_view t = trim_view(ln);
+            if (t.rfind(".type", 0) != 0) continue;
+            size_t comma = t.find(',');
+            if (comma == std::string_view::npos || t.find("function", comma) == std::string_view::npos) continue;
+            function_names.insert(string(trim_view(t.substr(5, comma - 5))));
+        }
+    }
+    vector<AsmFunction> funcs;
+    bool in_func = false;
+    std::istringstream in(text);
+    for (string ln; std::getline(in, ln);) {
+        if (ln.empty()) continue;
+        std::string_view t = trim_view(ln);
+        const bool label = !ascii::is_space(ln[0]) && !t.empty() && t.back() == ':';
+        if (label && t[0] != '.' && t[0] != 'L') {
+            string name(t.substr(0, t.size() - 1));
+            in_func = function_names.empty() || function_names.count(name);
+            if (name.rfind("_GLOBAL__", 0) == 0) in_func = false; // static initialization of <iostream>
+            if (in_func) funcs.push_back({name, {}});
+            continue;
+        }
+        if (!in_func) continue;
+        if (t.rfind(".cfi_endproc", 0) == 0 || t.rfind(".size", 0) == 0) { in_func = false; continue; }
+        if (t.find(MARK) != std::string_view::npos) { funcs.back().lines.emplace_back(t); continue; }
+        if (t.empty() || t[0] == '#' || t.rfind("//", 0) == 0 || t[0] == ';' || t[0] == '@') continue;
+        if (t[0] == '.' && !label) continue; // a directive
+        if (label && (t.rfind(".LFB", 0) == 0 || t.rfind(".LFE", 0) == 0 || t.rfind(".Ltmp", 0) == 0 ||
+                      t.rfind(".Lfunc", 0) == 0)) continue; // function bounds, never jumped to
+        string clean;
+        for (char c : t) clean += (c == '\t') ? ' ' : c;
+        funcs.back().lines.push_back(label ? clean : "  " + clean);
+    }
+    return funcs;
+}
+
+static void print_lines(std::ostream &out, const vector<string> &lines, const char *indent) {
+    for (const auto &l : lines) out << indent << l << "\n";
+}
+
+bool print_asm_by_occurrence(const string &program, const BuildOptions &opts, std::ostream &out) {
+    ScratchDir dir;
+    if (!dir.ok()) { out << "Cannot create a scratch directory: " << std::strerror(errno) << "\n"; return false; }
+    vector<AsmSegment> segments;
+    if (!write_file(dir.file("program.cpp"), add_occurrence_markers(program, segments))) {
+        out << "Cannot write " << dir.file("program.cpp") << "\n";
+        return false;
+    }
+    vector<string> argv{opts.compiler.empty() ? default_compiler() : opts.compiler};
+    argv.insert(argv.end(), opts.flags.begin(), opts.flags.end());
+    const string shown = command_line(argv) + " -S";
+    for (const char *a : {"-S", "-o", "program.s", "program.cpp"}) argv.push_back(a);
+
+    CommandResult cr = run_command(argv, dir.path(), opts.timeout_ms);
+    if (!cr.started || cr.timed_out || cr.exit_code != 0) {
+        out << "--- " << shown << " failed";
+        if (cr.timed_out) out << " (timed out)";
+        out << " ---\n" << cr.output;
+        if (!cr.output.empty() && cr.output.back() != '\n') out << "\n";
+        return false;
+    }
+
+    vector<AsmFunction> funcs = parse_asm_functions(read_file(dir.file("program.s")));
+    const AsmFunction *main_fn = nullptr;
+    for (const auto &f : funcs) {
+        if (f.name == "main" || f.name == "_main") main_fn = &f;
+    }
+
+    // split main() at the markers: before the first, per occurrence, after "end"
+    vector<string> prologue, epilogue;
+    vector<string> *cur = &prologue;
+    if (main_fn) {
+        for (const auto &l : main_fn->lines) {
+            size_t m = l.find(MARK);
+            if (m == string::npos) { cur->push_back(l); continue; }
+            string id = string(trim_view(std::string_view(l).substr(m + std::strlen(MARK))));
+            if (id == "end") { cur = &epilogue; continue; }
+            size_t k = std::strtoul(id.c_str(), nullptr, 10);
+            if (k < segments.size()) cur = &segments[k].assembly;
+        }
+    }
+
+    out << "--- Assembly by occurrence (" << shown << ", compiled in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(cr.elapsed).count() << " ms) ---\n";
+    if (!main_fn) out << "main() was not found in the assembly.\n";
+    if (!prologue.empty()) {
+        out << "\nmain() entry:\n";
+        print_lines(out, prologue, "    ");
+    }
+    for (const auto &seg : segments) {
+        out << "\n[" << seg.tag << "]\n  source:\n";
+        print_lines(out, seg.source, "  ");
+        out << "  assembly:\n";
+        if (seg.assembly.empty()) out << "      (no instructions of its own: optimized away or merged into a neighbour)\n";
+        print_lines(out, seg.assembly, "    ");
+    }
+    if (!epilogue.empty()) {
+        out << "\nmain() exit and out-of-line paths:\n";
+        print_lines(out, epilogue, "    ");
+    }
+    bool header = false;
+    for (const auto &f : funcs) {
+        if (&f == main_fn) continue;
+        if (!header) { out << "\nOther functions:\n"; header = true; }
+        out << "\n" << demangle(f.name) << ":\n";
+        print_lines(out, f.lines, "    ");
+    }
+    if (!cr.output.empty()) out << "\nCompiler output:\n" << cr.output;
+    return true;
+}
+
+// -------------------- Build variants --------------------
+
+// One build of the program (--matrix, compiler comparison) and its runs.
+struct BuildVariant {
+    string name;                 // "-O2 -march=native", "clang++"
+    string compiler;
+    vector<string> flags;
+    bool built = false;
+    std::chrono::nanoseconds compile{0};
+    uintmax_t size = 0;          // of the executable, in bytes
+    string compile_output;
+    bool ran = false;            // every run exited with 0
+    std::chrono::nanoseconds best{0};
+    string status;
+    string output;               // of the first run
+    vector<RunCounters> counters; // per run, with BuildOptions::counters
+};
+
+static double millis(std::chrono::nanoseconds d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+static string run_status(const CommandResult &cr) {
+    if (!cr.started) return "cannot run";
+    if (cr.timed_out) return "timed out";
+    if (cr.signal == SIGXCPU || cr.signal == SIGKILL) return "CPU limit";
+    if (cr.signal) return string("signal ") + std::to_string(cr.signal);
+    return "exit " + std::to_string(cr.exit_code);
+}
+
+// Build `v` as v<index> in `dir` (holding program.cpp) and run it opts.runs times.
+static void build_and_run(BuildVariant &v, size_t index, const ScratchDir &dir, const BuildOptions &opts) {
+    const string exe = "v" + std::to_string(index);
+    vector<string> argv{v.compiler};
+    argv.insert(argv.end(), v.flags.begin(), v.flags.end());
+    for (const char *a : {"-o", exe.c_str(), "program.cpp"}) argv.push_back(a);
+    CommandResult cc = run_command(argv, dir.path(), opts.timeout_ms);
+    v.compile = cc.elapsed;
+    v.compile_output = cc.output;
+    if (!cc.started || cc.timed_out || cc.exit_code != 0) {
+        v.status = !cc.started ? "no compiler" : (cc.timed_out ? "compile timed out" : "compile error");
+        return;
+    }
+    v.built = true;
+    struct stat st {};
+    if (::stat(dir.file(exe).c_str(), &st) == 0) v.size = static_cast<uintmax_t>(st.st_size);
+
+    for (unsigned r = 0; r < std::max(1u, opts.runs); ++r) {
+        CommandResult cr = run_command({"./" + exe}, dir.path(), opts.run_timeout_ms, opts.run_limits, opts.counters);
+        if (r == 0) v.output = cr.output;
+        if (opts.counters && cr.started) v.counters.push_back(cr.counters);
+        if (!cr.started || cr.timed_out || cr.signal || cr.exit_code != 0) {
+            v.status = run_status(cr);
+            return;
+        }
+        if (r == 0 || cr.elapsed < v.best) v.best = cr.elapsed;
+    }
+    v.ran = true;
+    v.status = "ok";
+}
+
+// "1234", "12.3K", "4.56M", "7.89G"; "-" if not counted.
+static string short_count(long long n) {
+    if (n < 0) return "-";
+    std::ostringstream os;
+    os << std::fixed;
+    if (n < 10000) os << n;
+    else if (n < 10000000) os << std::setprecision(1) << static_cast<double>(n) / 1e3 << "K";
+    else if (n < 10000000000ll) os << std::setprecision(2) << static_cast<double>(n) / 1e6 << "M";
+    else os << std::setprecision(2) << static_cast<double>(n) / 1e9 << "G";
+    return os.str();
+}
+
+// The counters of every counted run, one row per run. The hardware columns
+// are left out when no run had them.
+static void print_run_counters(std::ostream &out, const vector<BuildVariant> &variants, const char *label,
+                               size_t name_w) {
+    const RunCounters *first = nullptr;
+    bool hardware = false;
+    for (const auto &v : variants) {
+        for (const auto &rc : v.counters) {
+            if (!first) first = &rc;
+            hardware = hardware || rc.source == "hardware";
+        }
+    }
+    if (!first) return;
+    out << "\nCounters per run";
+    if (hardware) out << " (perf_event_open, user space):\n";
+    else if (first->source == "software") out << " (software counters only; " << first->note << "):\n";
+    else out << " (CPU time and page faults from wait4; " << first->note << "):\n";
+
+    out << std::left << std::setw(static_cast<int>(name_w)) << label << std::right << "  run";
+    if (hardware) {
+        out << "  " << std::setw(9) << "cycles" << "  " << std::setw(12) << "instructions" << "  " << std::setw(5)
+            << "IPC" << "  " << std::setw(12) << "cache misses" << "  " << std::setw(13) << "branch misses";
+    }
+    out << "  " << std::setw(8) << "CPU ms" << "  " << std::setw(11) << "page faults" << "\n";
+    for (const auto &v : variants) {
+        for (size_t r = 0; r < v.counters.size(); ++r) {
+            const RunCounters &rc = v.counters[r];
+            out << std::left << std::setw(static_cast<int>(name_w)) << (r == 0 ? v.name : string()) << std::right
+                << "  " << std::setw(3) << r + 1;
+            if (hardware) {
+                out << "  " << std::setw(9) << short_count(rc.cycles) << "  " << std::setw(12)
+                    << short_count(rc.instructions) << "  " << std::setw(5);
+                if (rc.cycles > 0 && rc.instructions >= 0) {
+                    out << std::fixed << std::setprecision(2)
+                        << static_cast<double>(rc.instructions) / static_cast<double>(rc.cycles) << std::defaultfloat;
+                } else {
+                    out << "-";
+                }
+                out << "  " << std::setw(12) << short_count(rc.cache_misses) << "  " << std::setw(13)
+                    << short_count(rc.branch_misses);
+            }
+            out << "  " << std::setw(8);
+            if (rc.task_clock_ns >= 0) out << std::fixed << std::setprecision(2) << rc.task_clock_ns / 1e6 << std::defaultfloat;
+            else out << "-";
+            out << "  " << std::setw(11) << short_count(rc.page_faults) << "\n";
+        }
+    }
+}
+
+// -------------------- Build matrix --------------------
+
+bool print_build_matrix(const string &program, const BuildOptions &opts, const MatrixOptions &matrix,
+                        std::ostream &out) {
+    vector<string> base;
+    for (const auto &f : opts.flags) {
+        if (f.rfind("-O", 0) != 0 && f.rfind("-march=", 0) != 0) base.push_back(f);
+    }
+    vector<BuildVariant> variants;
+    for (const auto &level : matrix.levels) {
+        for (const auto &march : matrix.march) {
+            BuildVariant v;
+            v.compiler = opts.compiler.empty() ? default_compiler() : opts.compiler;
+            v.flags = base;
+            v.flags.push_back("-O" + level);
+            v.name = "-O" + level;
+            if (!march.empty()) {
+                v.flags.push_back("-march=" + march);
+                v.name += " -march=" + march;
+            }
+            variants.push_back(std::move(v));
+        }
+    }
+    if (variants.empty()) { out << "The matrix has no variants.\n"; return false; }
+
+    ScratchDir dir;
+    if (!dir.ok()) { out << "Cannot create a scratch directory: " << std::strerror(errno) << "\n"; return false; }
+    if (!write_file(dir.file("program.cpp"), program)) {
+        out << "Cannot write " << dir.file("program.cpp") << "\n";
+        return false;
+    }
+
+    size_t jobs = matrix.jobs ? matrix.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min(jobs, variants.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t k = next++; k < variants.size(); k = next++) build_and_run(variants[k], k, dir, opts);
+    };
+    vector<std::thread> threads;
+    for (size_t t = 1; t < jobs; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads) t.join();
+
+    // outputs are compared with the first variant that ran
+    const BuildVariant *reference = nullptr;
+    for (const auto &v : variants) {
+        if (v.ran) { reference = &v; break; }
+    }
+    size_t name_w = 7;
+    for (const auto &v : variants) name_w = std::max(name_w, v.name.size());
+
+    out << "--- Build matrix (" << (opts.compiler.empty() ? default_compiler() : opts.compiler);
+    for (const auto &f : base) out << " " << f;
+    out << "; " << jobs << " at a time, best of " << std::max(1u, opts.runs) << " run(s)) ---\n";
+    out << std::left << std::setw(static_cast<int>(name_w)) << "variant" << std::right
+        << "  " << std::setw(10) << "compile ms" << "  " << std::setw(9) << "binary KB"
+        << "  " << std::setw(9) << "run ms" << "  result\n";
+    out << std::fixed;
+    for (const auto &v : variants) {
+        out << std::left << std::setw(static_cast<int>(name_w)) << v.name << std::right << "  "
+            << std::setw(10) << std::setprecision(0) << millis(v.compile) << "  ";
+        if (v.built) out << std::setw(9) << std::setprecision(1) << static_cast<double>(v.size) / 1024.0;
+        else out << std::setw(9) << "-";
+        out << "  ";
+        if (v.ran) out << std::setw(9) << std::setprecision(2) << millis(v.best);
+        else out << std::setw(9) << "-";
+        out << "  " << v.status;
+        if (v.ran && reference && &v != reference && v.output != reference->output) {
+            out << ", output differs from " << reference->name;
+        }
+        out << "\n";
+    }
+    out << std::defaultfloat;
+    print_run_counters(out, variants, "variant", name_w);
+
+    bool any_built = false;
+    for (const auto &v : variants) {
+        if (v.built) { any_built = true; continue; }
+        if (v.compile_output.empty()) continue;
+        out << "\n" << v.name << " did not build:\n" << v.compile_output;
+        if (v.compile_output.back() != '\n') out << "\n";
+        break; // the other variants usually fail the same way
+    }
+    return any_built;
+}
+
+// -------------------- Compiler comparison --------------------
+
+// argv[0] as execvp would find it, or "" if it is not there.
+static string find_in_path(const string &name) {
+    if (name.find('/') != string::npos) return ::access(name.c_str(), X_OK) == 0 ? name : string();
+    const char *path = std::getenv("PATH");
+    std::istringstream dirs(path ? path : "/usr/bin:/bin");
+    string d;
+    while (std::getline(dirs, d, ':')) {
+        const string candidate = (d.empty() ? string(".") : d) + "/" + name;
+        if (::access(candidate.c_str(), X_OK) == 0) return candidate;
+    }
+    return string();
+}
+
+static string compare_cache_dir(const CompareOptions &cmp) {
+    if (!cmp.cache_dir.empty()) return cmp.cache_dir;
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) return string(xdg) + "/snippetgen";
+    const char *home = std::getenv("HOME");
+    if (home && *home) return string(home) + "/.cache/snippetgen";
+    return string();
+}
+
+// Cache file: a version line, the numbers, each string as "<length>\n<bytes>\n",
+// then the number of counted runs and each run's counters.
+static const char *const CACHE_MAGIC = "snippetgen-compare 2";
+
+static void put_cached_string(std::ostream &os, const string &s) {
+    os << s.size() << "\n" << s << "\n";
+}
+
+static bool get_cached_string(std::istream &is, string &s) {
+    size_t n = 0;
+    if (!(is >> n) || is.get() != '\n' || n > 4 * MAX_CAPTURED_OUTPUT) return false;
+    s.assign(n, '\0');
+    return static_cast<bool>(is.read(&s[0], static_cast<std::streamsize>(n))) && is.get() == '\n';
+}
+
+static bool save_cached_variant(const string &path, const BuildVariant &v) {
+    std::ostringstream os;
+    os << CACHE_MAGIC << "\n" << v.built << " " << v.compile.count() << " " << v.size << " " << v.ran << " "
+       << v.best.count() << "\n";
+    put_cached_string(os, v.status);
+    put_cached_string(os, v.compile_output);
+    put_cached_string(os, v.output);
+    os << v.counters.size() << "\n";
+    for (const auto &rc : v.counters) {
+        os << rc.source << " " << rc.cycles << " " << rc.instructions << " " << rc.cache_misses << " "
+           << rc.branch_misses << " " << rc.task_clock_ns << " " << rc.page_faults << "\n";
+        put_cached_string(os, rc.note);
+    }
+    // written aside and renamed, so a concurrent reader never sees half a file
+    const string tmp = path + ".tmp" + std::to_string(::getpid());
+    if (!write_file(tmp, os.str())) return false;
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) { std::remove(tmp.c_str()); return false; }
+    return true;
+}
+
+// The cache keeps the most recently used COMPARE_CACHE_FILES results: a hit
+// touches its file, and each save drops the least recently used beyond that.
+static const size_t COMPARE_CACHE_FILES = 256;
+
+static void prune_compare_cache(const string &dir) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    vector<std::pair<fs::file_time_type, fs::path>> files;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const string name = it->path().filename().string();
+        if (name.rfind("compare-", 0) != 0 || name.size() < 4 || name.compare(name.size() - 4, 4, ".txt") != 0) continue;
+        std::error_code tec;
+        fs::file_time_type t = it->last_write_time(tec);
+        if (!tec) files.emplace_back(t, it->path());
+    }
+    if (files.size() <= COMPARE_CACHE_FILES) return;
+    const size_t excess = files.size() - COMPARE_CACHE_FILES;
+    std::nth_element(files.begin(), files.begin() + static_cast<std::ptrdiff_t>(excess), files.end());
+    for (size_t k = 0; k < excess; ++k) fs::remove(files[k].second, ec);
+}
+
+static bool load_cached_variant(const string &path, BuildVariant &v) {
+    std::istringstream is(read_file(path));
+    string magic;
+    if (!std::getline(is, magic) || magic != CACHE_MAGIC) return false;
+    long long compile_ns = 0, best_ns = 0;
+    if (!(is >> v.built >> compile_ns >> v.size >> v.ran >> best_ns) || is.get() != '\n') return false;
+    v.compile = std::chrono::nanoseconds(compile_ns);
+    v.best = std::chrono::nanoseconds(best_ns);
+    if (!get_cached_string(is, v.status) || !get_cached_string(is, v.compile_output) || !get_cached_string(is, v.output)) {
+        return false;
+    }
+    size_t runs = 0;
+    if (!(is >> runs) || runs > 1000) return false;
+    v.counters.assign(runs, RunCounters());
+    for (auto &rc : v.counters) {
+        if (!(is >> rc.source >> rc.cycles >> rc.instructions >> rc.cache_misses >> rc.branch_misses >>
+              rc.task_clock_ns >> rc.page_faults) || is.get() != '\n' || !get_cached_string(is, rc.note)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A "program.cpp:L:C: warning: ..." or "... error: ..." line of a compiler's output.
+struct Diagnostic {
+    int line = 0;
+    bool error = false;
+    string text;  // "warning: unused variable 'x' [-Wunused-variable]"
+};
+
+static vector<Diagnostic> parse_diagnostics(const string &output) {
+    vector<Diagnostic> diags;
+    std::istringstream is(output);
+    string l;
+    const string prefix = "program.cpp:";
+    while (std::getline(is, l)) {
+        if (l.rfind(prefix, 0) != 0) continue;
+        size_t p = prefix.size();
+        size_t q = l.find(':', p);
+        if (q == string::npos || q == p) continue;
+        Diagnostic d;
+        try { d.line = std::stoi(l.substr(p, q - p)); } catch (const std::exception &) { continue; }
+        size_t r = l.find(": ", q); // past the column
+        if (r == string::npos) continue;
+        d.text = l.substr(r + 2);
+        if (d.text.rfind("warning: ", 0) == 0) d.error = false;
+        else if (d.text.rfind("error: ", 0) == 0 || d.text.rfind("fatal error: ", 0) == 0) d.error = true;
+        else continue; // notes belong to the diagnostic before them
+        diags.push_back(std::move(d));
+    }
+    return diags;
+}
+
+bool print_compiler_comparison(const string &program, const BuildOptions &opts, const CompareOptions &cmp,
+                               std::ostream &out) {
+    vector<string> flags = opts.flags;
+    flags.insert(flags.end(), cmp.extra_flags.begin(), cmp.extra_flags.end());
+    vector<BuildVariant> variants;
+    vector<string> missing;
+    for (const auto &name : cmp.compilers) {
+        const string path = find_in_path(name);
+        if (path.empty()) { missing.push_back(name); continue; }
+        BuildVariant v;
+        v.name = name;
+        v.compiler = path;
+        v.flags = flags;
+        variants.push_back(std::move(v));
+    }
+
+    out << "--- Compiler comparison (";
+    for (size_t k = 0; k < flags.size(); ++k) out << (k ? " " : "") << flags[k];
+    out << "; best of " << std::max(1u, opts.runs) << " run(s)) ---\n";
+    for (const auto &m : missing) out << m << ": not found in PATH\n";
+    if (variants.empty()) return false;
+
+    ScratchDir dir;
+    if (!dir.ok()) { out << "Cannot create a scratch directory: " << std::strerror(errno) << "\n"; return false; }
+    if (!write_file(dir.file("program.cpp"), program)) {
+        out << "Cannot write " << dir.file("program.cpp") << "\n";
+        return false;
+    }
+
+    string cache = cmp.use_cache ? compare_cache_dir(cmp) : string();
+    if (!cache.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(cache, ec);
+        if (ec) cache.clear();
+    }
+    vector<bool> cached(variants.size(), false);
+    // one at a time: compilers timed side by side should not share the CPU
+    for (size_t k = 0; k < variants.size(); ++k) {
+        BuildVariant &v = variants[k];
+        string key_file;
+        if (!cache.empty()) {
+            // the compiler's version is part of the key, so an upgrade rebuilds
+            CommandResult ver = run_command({v.compiler, "--version"}, dir.path(), opts.timeout_ms);
+            std::ostringstream key;
+            key << v.compiler << "\n" << ver.output.substr(0, ver.output.find('\n')) << "\n";
+            for (const auto &f : v.flags) key << f << "\n";
+            key << opts.runs << " " << opts.run_timeout_ms << " " << opts.run_limits.memory_bytes << " "
+                << opts.run_limits.cpu_seconds << " " << opts.counters << "\n";
+            std::ostringstream hex;
+            hex << std::hex << std::setw(16) << std::setfill('0') << fnv1a64(program, fnv1a64(key.str()));
+            key_file = cache + "/compare-" + hex.str() + ".txt";
+            if (load_cached_variant(key_file, v)) {
+                std::error_code ec;
+                std::filesystem::last_write_time(key_file, std::filesystem::file_time_type::clock::now(), ec);
+                cached[k] = true;
+                continue;
+            }
+        }
+        build_and_run(v, k, dir, opts);
+        if (!key_file.empty() && v.status != "no compiler" && v.status != "compile timed out" &&
+            save_cached_variant(key_file, v)) {
+            prune_compare_cache(cache);
+        }
+    }
+
+    vector<vector<Diagnostic>> diags;
+    for (const auto &v : variants) diags.push_back(parse_diagnostics(v.compile_output));
+
+    const BuildVariant *reference = nullptr;
+    for (const auto &v : variants) {
+        if (v.ran) { reference = &v; break; }
+    }
+    size_t name_w = 8;
+    for (const auto &v : variants) name_w = std::max(name_w, v.name.size());
+    out << std::left << std::setw(static_cast<int>(name_w)) << "compiler" << std::right
+        << "  " << std::setw(10) << "compile ms" << "  " << std::setw(9) << "binary KB"
+        << "  " << std::setw(9) << "run ms" << "  " << std::setw(8) << "warnings" << "  " << std::setw(6)
+        << "errors" << "  result\n";
+    out << std::fixed;
+    for (size_t k = 0; k < variants.size(); ++k) {
+        const BuildVariant &v = variants[k];
+        size_t errors = 0;
+        for (const auto &d : diags[k]) errors += d.error;
+        out << std::left << std::setw(static_cast<int>(name_w)) << v.name << std::right << "  "
+            << std::setw(10) << std::setprecision(0) << millis(v.compile) << "  ";
+        if (v.built) out << std::setw(9) << std::setprecision(1) << static_cast<double>(v.size) / 1024.0;
+        else out << std::setw(9) << "-";
+        out << "  ";
+        if (v.ran) out << std::setw(9) << std::setprecision(2) << millis(v.best);
+        else out << std::setw(9) << "-";
+        out << "  " << std::setw(8) << diags[k].size() - errors << "  " << std::setw(6) << errors << "  " << v.status;
+        if (v.ran && reference && &v != reference && v.output != reference->output) {
+            out << ", output differs from " << reference->name;
+        }
+        if (cached[k]) out << " (cached)";
+        out << "\n";
+    }
+    out << std::defaultfloat;
+    print_run_counters(out, variants, "compiler", name_w);
+
+    // diagnostics by source line, each compiler's under the line
+    std::map<int, vector<std::pair<size_t, const Diagnostic *>>> by_line;
+    for (size_t k = 0; k < diags.size(); ++k) {
+        for (const auto &d : diags[k]) by_line[d.line].emplace_back(k, &d);
+    }
+    if (!by_line.empty()) {
+        vector<string> source;
+        std::istringstream is(program);
+        for (string l; std::getline(is, l);) source.push_back(l);
+        out << "\nDiagnostics by line:\n";
+        for (const auto &[line, list] : by_line) {
+            std::set<size_t> from;
+            for (const auto &e : list) from.insert(e.first);
+            const string text = line >= 1 && static_cast<size_t>(line) <= source.size() ? trim(source[line - 1]) : "";
+            out << "  line " << line << ": " << text;
+            if (from.size() == 1 && variants.size() > 1) out << "   [only " << variants[*from.begin()].name << "]";
+            out << "\n";
+            for (const auto &[k, d] : list) {
+                out << "    " << std::left << std::setw(static_cast<int>(name_w)) << variants[k].name << std::right
+                    << "  " << d->text << "\n";
+            }
+        }
+    }
+    for (size_t k = 0; k < variants.size(); ++k) {
+        const BuildVariant &v = variants[k];
+        if (v.built || v.compile_output.empty() || !diags[k].empty()) continue;
+        // failed without a diagnostic we could place (a linker error, a missing compiler driver)
+        out << "\n" << v.name << " did not build:\n" << v.compile_output;
+        if (v.compile_output.back() != '\n') out << "\n";
+    }
+    return variants.size() >= 2;
+}
+
+#endif // _WIN32
+
+} // namespace snippetgen
@@ -0,0 +1,149 @@
+/*
+Building generated programs with a local compiler (POSIX only).
+
+The generator never needs a compiler; these helpers are for looking at what a
+generated program turns into. The compiler and the programs it builds run as
+child processes in a private scratch directory, each under a timeout.
+
+--asm view: the program is compiled with -S after a marker statement has been
+put after each occurrence's "// (occurrence N (token M))" comment in main():
+
+    __asm__ volatile("# sg-mark K" ::: "memory");
+
+The marker emits only an assembler comment. Its "memory" clobber keeps loads
+and stores from moving across it, so the instructions between two markers in
+main() are the code of one occurrence. Other functions (the occurrences'
+top-level declarations) are listed after main().
+
+--matrix: the program is built once per optimization level and -march value
+(by default -O0, -O2, -O3, each without and with -march=native). Variants are
+compiled and run on up to `jobs` threads; each run of a built program is
+limited in memory, CPU time and wall time. The table shows compile time,
+binary size and the best wall time of `runs` runs, and flags variants whose
+output differs from the first one's.
+
+Compiler comparison: the program is built with each compiler (by default g++
+and clang++, those found in PATH) using the same flags plus -Wall -Wextra, and
+run. The table shows compile time, binary size, run time and diagnostics
+counts; the diagnostics follow, grouped by source line, so that a warning only
+one compiler gives stands out. Each compiler's result is cached on disk under
+a hash of the program, the flags, the run settings and the compiler's path
+and version, so asking again for the same program costs no builds. Only the
+most recently used results are kept.
+
+Counters (--counters with --matrix or --compare): each run of a built program
+is counted with perf_event_open, without the perf tool. The counters are opened
+on the child between fork and exec, enabled by the exec and inherited by its
+threads, and count user space only, which an unprivileged user may do with the
+default perf_event_paranoid setting. Where the CPU's counters are not available
+(most VMs and containers) only task-clock and page faults are counted; where
+perf_event_open is not allowed at all, the child's CPU time and page faults
+come from wait4().
+*/
+
+#ifndef SNIPPET_BUILD_H
+#define SNIPPET_BUILD_H
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace snippetgen {
+
+// Limits applied to a child before it starts; 0 = none.
+struct ChildLimits {
+    size_t memory_bytes = 0;  // RLIMIT_AS
+    unsigned cpu_seconds = 0; // RLIMIT_CPU
+};
+
+struct BuildOptions {
+    std::string compiler;                                // "" = $CXX, else c++
+    std::vector<std::string> flags = {"-std=c++17", "-O2"};
+    unsigned timeout_ms = 60000;                         // per compiler run
+    unsigned runs = 3;                                   // runs of a built program; the best time is shown
+    unsigned run_timeout_ms = 10000;                     // per program run
+    ChildLimits run_limits{512u << 20, 10};              // per program run
+    bool counters = false;                               // count each program run (see RunCounters)
+};
+
+// $CXX if set, else "c++".
+std::string default_compiler();
+
+// Counters of one child run; -1 = not counted.
+struct RunCounters {
+    std::string source;         // "hardware", "software" (task-clock and page faults) or "rusage"
+    std::string note;           // why a better source was not available
+    long long cycles = -1;
+    long long instructions = -1;
+    long long cache_misses = -1;
+    long long branch_misses = -1;
+    long long task_clock_ns = -1; // CPU time
+    long long page_faults = -1;
+};
+
+struct CommandResult {
+    bool started = false;   // the program could be executed
+    bool timed_out = false; // killed after the timeout
+    int exit_code = -1;     // exit status; -1 if it did not exit normally
+    int signal = 0;         // the signal that ended it, if any
+    std::string output;     // stdout and stderr, interleaved
+    std::chrono::nanoseconds elapsed{0};
+    RunCounters counters;   // with count_events
+};
+
+// Run argv[0] (looked up in PATH) with argv, without a shell, in `dir` ("" =
+// current directory). The child is killed after `timeout_ms` (0 = no limit).
+// With `count_events` the run is counted into CommandResult::counters.
+CommandResult run_command(const std::vector<std::string> &argv, const std::string &dir, unsigned timeout_ms,
+                          const ChildLimits &limits = {}, bool count_events = false);
+
+// A fresh directory under $TMPDIR (or /tmp), removed with its contents by the destructor.
+class ScratchDir {
+public:
+    ScratchDir();
+    ~ScratchDir();
+    ScratchDir(const ScratchDir &) = delete;
+    ScratchDir &operator=(const ScratchDir &) = delete;
+
+    bool ok() const { return !path_.empty(); }
+    const std::string &path() const { return path_; }
+    std::string file(const std::string &name) const { return path_ + "/" + name; }
+
+private:
+    std::string path_;
+};
+
+// The --asm view: compile `program` to assembly with opts.flags plus -S and
+// write each occurrence's source lines and assembly to `out`. Returns false
+// (after printing the compiler's diagnostics) if it does not compile.
+bool print_asm_by_occurrence(const std::string &program, const BuildOptions &opts, std::ostream &out);
+
+struct MatrixOptions {
+    std::vector<std::string> levels = {"0", "2", "3"};    // -O<level>
+    std::vector<std::string> march = {"", "native"};      // -march=<value>; "" = no -march
+    unsigned jobs = 0;                                    // variants built and run at once; 0 = one per CPU
+};
+
+// The --matrix table for `program`. opts.flags other than -O and -march apply
+// to every variant. Returns false if no variant could be built.
+bool print_build_matrix(const std::string &program, const BuildOptions &opts, const MatrixOptions &matrix,
+                        std::ostream &out);
+
+struct CompareOptions {
+    std::vector<std::string> compilers = {"g++", "clang++"};
+    std::vector<std::string> extra_flags = {"-Wall", "-Wextra"}; // added for every compiler
+    std::string cache_dir;  // "" = $XDG_CACHE_HOME/snippetgen, else $HOME/.cache/snippetgen
+    bool use_cache = true;
+};
+
+// The compiler comparison for `program`, built with opts.flags plus
+// cmp.extra_flags (opts.compiler is not used). Returns false if fewer than
+// two of the compilers were found.
+bool print_compiler_comparison(const std::string &program, const BuildOptions &opts, const CompareOptions &cmp,
+                               std::ostream &out);
+
+} // namespace snippetgen
+
+#endif // SNIPPET_BUILD_H
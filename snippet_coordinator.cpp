@@ -0,0 +1,357 @@
+/*
+Distributed batch coordinator implementation. See snippet_coordinator.h.
+*/
+
+#include "snippet_coordinator.h"
+#include "snippet_jsonl.h"
+#include "snippet_server.h"
+#include "snippetgen.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace snippetgen {
+
+#ifdef _WIN32
+
+int run_coordinator(const CoordinatorOptions &, std::istream &, std::ostream &) {
+    std::cerr << "Coordinator mode is not supported on this platform.\n";
+    return 1;
+}
+
+#else
+
+using std::string;
+using std::vector;
+
+// -------------------- Worker connection --------------------
+
+// One connection to a worker server, speaking the line protocol of
+// snippet_server.h.
+class WorkerConnection {
+    int fd_ = -1;
+    string buf_;
+
+    bool fill() {
+        char chunk[65536];
+        while (true) {
+            ssize_t r = ::read(fd_, chunk, sizeof(chunk));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            buf_.append(chunk, static_cast<size_t>(r));
+            return true;
+        }
+    }
+
+public:
+    ~WorkerConnection() { close(); }
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Between requests the server only speaks to close the session (idle
+    // timeout, shutdown); anything readable now means the connection is done.
+    bool stale() const {
+        pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return ::poll(&pfd, 1, 0) != 0;
+    }
+
+    bool open(const string &address, unsigned timeout_ms, string &error) {
+        fd_ = connect_to_server(address, error);
+        if (fd_ < 0) return false;
+        timeval tv;
+        tv.tv_sec = static_cast<time_t>(timeout_ms / 1000);
+        tv.tv_usec = static_cast<suseconds_t>((timeout_ms % 1000) * 1000);
+        ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        buf_.clear();
+    }
+
+    // Send one --jsonl request and read its response line (newline stripped).
+    bool request(const string &req, string &response, string &error) {
+        const string msg = "@jsonl " + req + "\n";
+        const char *p = msg.data();
+        size_t n = msg.size();
+        while (n > 0) {
+            // MSG_NOSIGNAL: a worker that died must not take the coordinator with it
+            ssize_t w = ::send(fd_, p, n, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) { error = "send failed"; return false; }
+            p += w;
+            n -= static_cast<size_t>(w);
+        }
+        size_t nl;
+        while ((nl = buf_.find('\n')) == string::npos) {
+            if (!fill()) { error = "connection lost or reply timed out"; return false; }
+        }
+        const string head = buf_.substr(0, nl);
+        buf_.erase(0, nl + 1);
+        if (head.rfind("OK ", 0) != 0) {
+            error = head.empty() ? "empty reply" : head;
+            return false;
+        }
+        size_t len = 0;
+        try { len = std::stoul(head.substr(3)); } catch (const std::exception &) { error = "bad reply header"; return false; }
+        while (buf_.size() < len) {
+            if (!fill()) { error = "connection lost or reply timed out"; return false; }
+        }
+        response.assign(buf_, 0, len);
+        buf_.erase(0, len);
+        if (!response.empty() && response.back() == '\n') response.pop_back();
+        return true;
+    }
+};
+
+// -------------------- Shard scheduling --------------------
+
+struct Shard {
+    uint64_t index = 0;
+    vector<string> requests;
+    unsigned attempts = 0;
+};
+
+// reader (caller's thread) -> shard queue -> one thread per worker connection
+// -> reorder buffer -> writer thread. A failed shard goes back to the front
+// of the queue for any connection to pick up.
+struct Coordination {
+    std::mutex mu;
+    std::condition_variable work_cv;  // shard queued, or nothing left to do
+    std::condition_variable done_cv;  // a shard finished or input finished
+    std::condition_variable slot_cv;  // inflight dropped below the limit
+    std::deque<Shard> queue;
+    std::map<uint64_t, vector<string>> done; // shard index -> responses, until written
+    size_t inflight = 0;              // shards read but not yet written
+    size_t pending = 0;               // shards read but not yet finished
+    uint64_t total = 0;               // shards read so far
+    bool eof = false;
+    bool write_failed = false;
+    unsigned live = 0;                // connections that have not given up
+    string last_worker_error;
+    uint64_t retries = 0;
+    uint64_t failed_shards = 0;
+};
+
+// Answer every request of a shard that cannot be generated.
+static void fail_shard_locked(Coordination &c, Shard &sh, const string &error) {
+    vector<string> responses;
+    responses.reserve(sh.requests.size());
+    for (const auto &req : sh.requests) responses.push_back(jsonl_error_response(req, error));
+    c.done.emplace(sh.index, std::move(responses));
+    --c.pending;
+    ++c.failed_shards;
+}
+
+struct WorkerStats {
+    uint64_t requests = 0;
+    uint64_t failures = 0;
+};
+
+static void connection_thread(const CoordinatorOptions &opts, const string &address, Coordination &c,
+                              WorkerStats &stats) {
+    WorkerConnection conn;
+    unsigned connect_failures = 0;
+    while (true) {
+        Shard sh;
+        {
+            std::unique_lock<std::mutex> lk(c.mu);
+            c.work_cv.wait(lk, [&] { return !c.queue.empty() || (c.eof && c.pending == 0) || c.write_failed; });
+            if (c.queue.empty() || c.write_failed) return;
+            sh = std::move(c.queue.front());
+            c.queue.pop_front();
+        }
+
+        string error;
+        if (conn.is_open() && conn.stale()) conn.close();
+        if (!conn.is_open() && !conn.open(address, opts.reply_timeout_ms, error)) {
+            // not the shard's fault: put it back without counting an attempt
+            std::unique_lock<std::mutex> lk(c.mu);
+            ++stats.failures;
+            c.last_worker_error = error;
+            if (++connect_failures >= opts.max_attempts) {
+                // give this worker up; if it was the last connection, nothing
+                // can be generated any more
+                if (--c.live == 0) {
+                    fail_shard_locked(c, sh, "no worker reachable: " + error);
+                    while (!c.queue.empty()) {
+                        fail_shard_locked(c, c.queue.front(), "no worker reachable: " + error);
+                        c.queue.pop_front();
+                    }
+                    c.done_cv.notify_all();
+                } else {
+                    c.queue.push_front(std::move(sh));
+                    c.work_cv.notify_one();
+                }
+                return;
+            }
+            c.queue.push_front(std::move(sh));
+            c.work_cv.notify_one();
+            lk.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100u << std::min(connect_failures, 6u)));
+            continue;
+        }
+        connect_failures = 0;
+
+        vector<string> responses;
+        responses.reserve(sh.requests.size());
+        bool ok = true;
+        for (const auto &req : sh.requests) {
+            string response;
+            if (!conn.request(req, response, error)) { ok = false; break; }
+            responses.push_back(std::move(response));
+        }
+
+        std::unique_lock<std::mutex> lk(c.mu);
+        if (ok) {
+            stats.requests += responses.size();
+            c.done.emplace(sh.index, std::move(responses));
+            --c.pending;
+            c.done_cv.notify_one();
+            if (c.eof && c.pending == 0) c.work_cv.notify_all();
+            continue;
+        }
+        // the partial responses are dropped; the whole shard runs again
+        conn.close();
+        ++stats.failures;
+        c.last_worker_error = address + ": " + error;
+        if (++sh.attempts >= opts.max_attempts) {
+            fail_shard_locked(c, sh, "shard failed after " + std::to_string(sh.attempts) + " attempt(s): " + error);
+            c.done_cv.notify_one();
+            if (c.eof && c.pending == 0) c.work_cv.notify_all();
+        } else {
+            ++c.retries;
+            c.queue.push_front(std::move(sh));
+            c.work_cv.notify_one();
+        }
+    }
+}
+
+static void coordinator_writer(Coordination &c, std::ostream &out) {
+    uint64_t next = 0;
+    vector<vector<string>> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(c.mu);
+            c.done_cv.wait(lk, [&] { return c.write_failed || c.done.count(next) || (c.eof && next == c.total); });
+            if (c.write_failed || !c.done.count(next)) return; // output failed, or everything written
+            for (auto it = c.done.find(next); it != c.done.end() && it->first == next; it = c.done.erase(it), ++next)
+                batch.push_back(std::move(it->second));
+        }
+        for (const auto &shard : batch) {
+            for (const auto &r : shard) out << r << '\n';
+        }
+        out.flush();
+        {
+            std::lock_guard<std::mutex> lk(c.mu);
+            c.inflight -= batch.size();
+            if (!out) {
+                // nothing more can be written: drop the queued shards so the
+                // connections and the reader stop instead of waiting on us
+                c.write_failed = true;
+                c.pending -= c.queue.size();
+                c.queue.clear();
+                c.done.clear();
+                c.work_cv.notify_all();
+                c.slot_cv.notify_all();
+                c.done_cv.notify_all();
+                return;
+            }
+        }
+        batch.clear();
+        c.slot_cv.notify_one();
+    }
+}
+
+int run_coordinator(const CoordinatorOptions &opts, std::istream &in, std::ostream &out) {
+    if (opts.workers.empty() || opts.connections == 0 || opts.shard_size == 0 || opts.max_attempts == 0) {
+        std::cerr << "The coordinator needs at least one worker, one connection, a shard size and an attempt.\n";
+        return 1;
+    }
+    const unsigned connections = static_cast<unsigned>(opts.workers.size()) * opts.connections;
+    const size_t limit = opts.inflight_shards ? opts.inflight_shards : 2 * static_cast<size_t>(connections);
+
+    Coordination c;
+    c.live = connections;
+    vector<WorkerStats> stats(opts.workers.size());
+    vector<std::thread> threads;
+    for (size_t w = 0; w < opts.workers.size(); ++w) {
+        for (unsigned i = 0; i < opts.connections; ++i)
+            threads.emplace_back(connection_thread, std::cref(opts), std::cref(opts.workers[w]), std::ref(c), std::ref(stats[w]));
+    }
+    std::thread writer(coordinator_writer, std::ref(c), std::ref(out));
+
+    uint64_t requests = 0;
+    Shard sh;
+    const auto submit = [&] {
+        std::unique_lock<std::mutex> lk(c.mu);
+        c.slot_cv.wait(lk, [&] { return c.inflight < limit || c.write_failed; });
+        if (c.write_failed) return false;
+        sh.index = c.total++;
+        ++c.inflight;
+        if (c.live == 0) {
+            fail_shard_locked(c, sh, "no worker reachable: " + c.last_worker_error);
+            c.done_cv.notify_one();
+        } else {
+            ++c.pending;
+            c.queue.push_back(std::move(sh));
+            c.work_cv.notify_one();
+        }
+        sh = Shard();
+        return true;
+    };
+    string line;
+    bool stopped = false;
+    while (!stopped && std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (trim(line).empty()) continue;
+        ++requests;
+        sh.requests.push_back(std::move(line));
+        if (sh.requests.size() == opts.shard_size) stopped = !submit();
+    }
+    if (!stopped && !sh.requests.empty()) submit();
+
+    {
+        std::lock_guard<std::mutex> lk(c.mu);
+        c.eof = true;
+    }
+    c.work_cv.notify_all();
+    c.done_cv.notify_all();
+    for (auto &t : threads) t.join();
+    writer.join();
+
+    std::cerr << "Coordinated " << requests << " request(s) in " << c.total << " shard(s): "
+              << c.retries << " retried, " << c.failed_shards << " failed.\n";
+    for (size_t w = 0; w < opts.workers.size(); ++w) {
+        std::cerr << "  " << opts.workers[w] << ": " << stats[w].requests << " request(s), "
+                  << stats[w].failures << " failure(s)\n";
+    }
+    if (c.failed_shards && !c.last_worker_error.empty()) std::cerr << "Last worker error: " << c.last_worker_error << "\n";
+    return (c.write_failed || c.failed_shards) ? 1 : 0;
+}
+
+#endif // _WIN32
+
+} // namespace snippetgen
@@ -0,0 +1,41 @@
+/*
+Coordinator for distributed batch generation: reads --jsonl requests, cuts them
+into shards of consecutive lines and hands the shards to snippet_gen servers
+(--serve on a Unix socket or tcp:<host>:<port>, each with its own loaded
+database) as "@jsonl" requests. Responses are written in input order, exactly
+as `snippet_gen --jsonl` would write them.
+
+A shard whose worker fails (connection refused or lost, ERR reply, reply
+timeout) is discarded as a whole and retried on any connection; requests are
+read-only, so re-running one is harmless. After max_attempts failures its
+requests are answered {"ok": false, "error": "..."} and the run exits 1.
+*/
+
+#ifndef SNIPPET_COORDINATOR_H
+#define SNIPPET_COORDINATOR_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace snippetgen {
+
+struct CoordinatorOptions {
+    std::vector<std::string> workers;  // server addresses
+    unsigned connections = 4;          // per worker address
+    size_t shard_size = 64;            // requests per shard
+    unsigned max_attempts = 3;         // per shard; also consecutive connect failures
+                                       // before a connection gives its worker up
+    unsigned reply_timeout_ms = 30000; // a worker silent this long has failed
+    size_t inflight_shards = 0;        // read but not yet written; 0 = 2 x connections.
+                                       // Input is not read while the limit is reached.
+};
+
+// Process requests from `in` until end of input. Returns the process exit code:
+// 0, or 1 if a shard failed for good or the output could not be written.
+int run_coordinator(const CoordinatorOptions &opts, std::istream &in, std::ostream &out);
+
+} // namespace snippetgen
+
+#endif // SNIPPET_COORDINATOR_H
@@ -0,0 +1,594 @@
+/*
+JSON-lines streaming mode implementation. See snippet_jsonl.h.
+*/
+
+#include "snippet_jsonl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace snippetgen {
+
+using std::string;
+using std::vector;
+
+// -------------------- Minimal JSON --------------------
+
+struct JsonValue {
+    enum Kind { Null, Bool, Number, String, Array, Object };
+    Kind kind = Null;
+    bool boolean = false;
+    string text; // String: decoded contents; Number: the literal as written
+    vector<JsonValue> items;
+    vector<std::pair<string, JsonValue>> members; // in source order
+
+    const JsonValue *find(const string &key) const {
+        for (const auto &m : members) if (m.first == key) return &m.second;
+        return nullptr;
+    }
+};
+
+static void append_utf8(string &out, unsigned cp) {
+    if (cp < 0x80) out += static_cast<char>(cp);
+    else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Strict RFC 8259 parser for one request line; throws std::runtime_error.
+class JsonParser {
+    const string &s_;
+    size_t i_ = 0;
+    static const int MAX_DEPTH = 64;
+
+public:
+    explicit JsonParser(const string &s) : s_(s) {}
+
+    JsonValue parse() {
+        JsonValue v = value(0);
+        skip_ws();
+        if (i_ != s_.size()) fail("unexpected trailing characters");
+        return v;
+    }
+
+private:
+    [[noreturn]] void fail(const string &what) const {
+        throw std::runtime_error(what + " at offset " + std::to_string(i_));
+    }
+
+    void skip_ws() {
+        while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\t' || s_[i_] == '\n' || s_[i_] == '\r')) ++i_;
+    }
+
+    bool consume(const char *word) {
+        size_t n = std::char_traits<char>::length(word);
+        if (s_.compare(i_, n, word) != 0) return false;
+        i_ += n;
+        return true;
+    }
+
+    JsonValue value(int depth) {
+        if (depth > MAX_DEPTH) fail("nesting too deep");
+        skip_ws();
+        if (i_ >= s_.size()) fail("unexpected end of input");
+        JsonValue v;
+        char c = s_[i_];
+        if (c == '{') {
+            v.kind = JsonValue::Object;
+            ++i_;
+            skip_ws();
+            if (i_ < s_.size() && s_[i_] == '}') { ++i_; return v; }
+            while (true) {
+                skip_ws();
+                if (i_ >= s_.size() || s_[i_] != '"') fail("expected object key");
+                string key = string_body();
+                skip_ws();
+                if (i_ >= s_.size() || s_[i_] != ':') fail("expected ':'");
+                ++i_;
+                v.members.emplace_back(std::move(key), value(depth + 1));
+                skip_ws();
+                if (i_ < s_.size() && s_[i_] == ',') { ++i_; continue; }
+                if (i_ < s_.size() && s_[i_] == '}') { ++i_; return v; }
+                fail("expected ',' or '}'");
+            }
+        }
+        if (c == '[') {
+            v.kind = JsonValue::Array;
+            ++i_;
+            skip_ws();
+            if (i_ < s_.size() && s_[i_] == ']') { ++i_; return v; }
+            while (true) {
+                v.items.push_back(value(depth + 1));
+                skip_ws();
+                if (i_ < s_.size() && s_[i_] == ',') { ++i_; continue; }
+                if (i_ < s_.size() && s_[i_] == ']') { ++i_; return v; }
+                fail("expected ',' or ']'");
+            }
+        }
+        if (c == '"') { v.kind = JsonValue::String; v.text = string_body(); return v; }
+        if (consume("true")) { v.kind = JsonValue::Bool; v.boolean = true; return v; }
+        if (consume("false")) { v.kind = JsonValue::Bool; return v; }
+        if (consume("null")) return v;
+        if (c == '-' || (c >= '0' && c <= '9')) { v.kind = JsonValue::Number; v.text = number(); return v; }
+        fail("unexpected character");
+    }
+
+    string number() {
+        size_t b = i_;
+        auto digits = [&]() {
+            size_t d = i_;
+            while (i_ < s_.size() && s_[i_] >= '0' && s_[i_] <= '9') ++i_;
+            if (i_ == d) fail("malformed number");
+        };
+        if (s_[i_] == '-') ++i_;
+        if (i_ < s_.size() && s_[i_] == '0') ++i_;
+        else digits();
+        if (i_ < s_.size() && s_[i_] == '.') { ++i_; digits(); }
+        if (i_ < s_.size() && (s_[i_] == 'e' || s_[i_] == 'E')) {
+            ++i_;
+            if (i_ < s_.size() && (s_[i_] == '+' || s_[i_] == '-')) ++i_;
+            digits();
+        }
+        return s_.substr(b, i_ - b);
+    }
+
+    unsigned hex4() {
+        if (s_.size() - i_ < 4) fail("truncated \\u escape");
+        unsigned v = 0;
+        for (int k = 0; k < 4; ++k) {
+            char h = s_[i_++];
+            v <<= 4;
+            if (h >= '0' && h <= '9') v |= static_cast<unsigned>(h - '0');
+            else if (h >= 'a' && h <= 'f') v |= static_cast<unsigned>(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') v |= static_cast<unsigned>(h - 'A' + 10);
+            else fail("bad hex digit in \\u escape");
+        }
+        return v;
+    }
+
+    // Parse a string starting at the opening quote; returns the decoded contents.
+    string string_body() {
+        ++i_; // opening quote
+        string out;
+        while (true) {
+            if (i_ >= s_.size()) fail("unterminated string");
+            char c = s_[i_++];
+            if (c == '"') return out;
+            if (static_cast<unsigned char>(c) < 0x20) fail("control character in string");
+            if (c != '\\') { out += c; continue; }
+            if (i_ >= s_.size()) fail("unterminated string");
+            char e = s_[i_++];
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp = hex4();
+                    if (cp >= 0xD800 && cp < 0xDC00 && consume("\\u")) {
+                        unsigned lo = hex4();
+                        if (lo < 0xDC00 || lo > 0xDFFF) fail("invalid surrogate pair");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xD800 && cp < 0xE000) {
+                        fail("unpaired surrogate");
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default: fail("invalid escape");
+            }
+        }
+    }
+};
+
+static void append_json_string(string &out, const string &s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+static void append_json(string &out, const JsonValue &v) {
+    switch (v.kind) {
+        case JsonValue::Null: out += "null"; break;
+        case JsonValue::Bool: out += v.boolean ? "true" : "false"; break;
+        case JsonValue::Number: out += v.text; break;
+        case JsonValue::String: append_json_string(out, v.text); break;
+        case JsonValue::Array:
+            out += '[';
+            for (size_t i = 0; i < v.items.size(); ++i) {
+                if (i) out += ',';
+                append_json(out, v.items[i]);
+            }
+            out += ']';
+            break;
+        case JsonValue::Object:
+            out += '{';
+            for (size_t i = 0; i < v.members.size(); ++i) {
+                if (i) out += ',';
+                append_json_string(out, v.members[i].first);
+                out += ':';
+                append_json(out, v.members[i].second);
+            }
+            out += '}';
+            break;
+    }
+}
+
+// -------------------- Answers from a request --------------------
+
+// Upper bound on questions per request, so an answer that a prompt keeps
+// rejecting (e.g. a clashing variable name) cannot loop forever.
+static const size_t MAX_PROMPTS_PER_REQUEST = 10000;
+
+class RequestAnswers {
+    struct Key {
+        string key;
+        vector<string> replies;
+        bool repeat = false; // a plain string answers every matching question
+        size_t next = 0;
+        bool used = false;
+    };
+    vector<Key> keys_;
+    bool defaults_ = true;
+    size_t prompts_ = 0;
+
+public:
+    vector<string> warnings;
+    bool limit_hit = false;
+
+    // `answers` is the request's "answers" member (nullptr when absent).
+    explicit RequestAnswers(const JsonValue *answers) {
+        if (!answers || answers->kind == JsonValue::Null) return;
+        if (answers->kind == JsonValue::String) {
+            if (answers->text != "defaults") throw std::runtime_error("\"answers\" must be an object or \"defaults\"");
+            return;
+        }
+        if (answers->kind != JsonValue::Object) throw std::runtime_error("\"answers\" must be an object or \"defaults\"");
+        defaults_ = false;
+        for (const auto &m : answers->members) {
+            Key k;
+            k.key = m.first;
+            if (m.second.kind == JsonValue::String) {
+                k.replies.push_back(m.second.text);
+                k.repeat = true;
+            } else if (m.second.kind == JsonValue::Array) {
+                for (const auto &item : m.second.items) {
+                    if (item.kind != JsonValue::String) throw std::runtime_error("answer \"" + m.first + "\" must hold strings");
+                    k.replies.push_back(item.text);
+                }
+            } else {
+                throw std::runtime_error("answer \"" + m.first + "\" must be a string or an array of strings");
+            }
+            keys_.push_back(std::move(k));
+        }
+    }
+
+    std::optional<string> answer(const Prompt &q) {
+        if (++prompts_ > MAX_PROMPTS_PER_REQUEST) { limit_hit = true; return std::nullopt; }
+        const string fallback = q.body_line ? "QED" : "";
+        if (defaults_) return fallback;
+
+        Key *match = nullptr;
+        for (auto &k : keys_) if (k.key == q.question) { match = &k; break; }
+        if (!match) {
+            for (auto &k : keys_) {
+                if (!k.key.empty() && q.question.find(k.key) != string::npos) { match = &k; break; }
+            }
+        }
+        if (!match) {
+            if (!q.body_line) warnings.push_back("no answer for \"" + q.question + "\"; used default \"" + q.default_value + "\"");
+            return fallback;
+        }
+        match->used = true;
+        if (match->next < match->replies.size()) return match->replies[match->next++];
+        if (match->repeat && !q.body_line) return match->replies.front();
+        return fallback;
+    }
+
+    void report_unused() {
+        for (const auto &k : keys_) {
+            if (!k.used) warnings.push_back("answer \"" + k.key + "\" matched no question");
+        }
+    }
+};
+
+// -------------------- Request handling --------------------
+
+using Clock = std::chrono::steady_clock;
+
+static long long micros(std::chrono::nanoseconds d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+struct Job {
+    uint64_t seq;
+    string line;
+    Clock::time_point read_at;
+};
+
+// Turn one request line into one response line (without the newline).
+static string handle_request(Generator &gen, const Job &job, const std::function<bool()> &cancel,
+                             GenerateResult *result) {
+    const Clock::time_point started = Clock::now();
+    string id = "null";
+    string error;
+    GenerateResult res;
+    vector<string> warnings;
+    std::ostringstream log;
+    bool want_log = false;
+    long long generate_us = 0;
+
+    JsonValue req;
+    std::optional<RequestAnswers> answers;
+    const JsonValue *line = nullptr;
+    try {
+        req = JsonParser(job.line).parse();
+        if (req.kind != JsonValue::Object) throw std::runtime_error("request must be a JSON object");
+        if (const JsonValue *v = req.find("id")) {
+            id.clear();
+            append_json(id, *v);
+        }
+        line = req.find("line");
+        if (!line || line->kind != JsonValue::String) throw std::runtime_error("missing string field \"line\"");
+        if (const JsonValue *v = req.find("log")) want_log = v->kind == JsonValue::Bool && v->boolean;
+        answers.emplace(req.find("answers"));
+    } catch (const std::exception &ex) {
+        error = string("invalid request: ") + ex.what();
+    }
+
+    if (error.empty()) {
+        GenerateOptions opts;
+        opts.offer_definitions = false; // read-only: requests run concurrently
+        opts.log = want_log ? &log : nullptr;
+        RequestAnswers &ra = *answers;
+        bool cancelled = false;
+        const AnswerProvider provider = [&](const Prompt &q) -> std::optional<string> {
+            if (cancel && cancel()) { cancelled = true; return std::nullopt; }
+            return ra.answer(q);
+        };
+        const Clock::time_point t0 = Clock::now();
+        try {
+            res = gen.generate(line->text, provider, opts);
+            if (cancelled) {
+                error = "cancelled";
+            } else if (!res.ok) {
+                error = ra.limit_hit ? "too many follow-up questions (limit " + std::to_string(MAX_PROMPTS_PER_REQUEST) +
+                                       "); an answer is probably being rejected repeatedly"
+                                     : res.error;
+            }
+        } catch (const std::exception &ex) {
+            error = ex.what();
+        }
+        generate_us = micros(Clock::now() - t0);
+        ra.report_unused();
+        warnings = std::move(ra.warnings);
+    }
+
+    string out;
+    out.reserve(res.program.size() + 256);
+    out += "{\"id\":";
+    out += id;
+    if (error.empty()) {
+        out += ",\"ok\":true,\"program\":";
+        append_json_string(out, res.program);
+        out += ",\"occurrences\":[";
+        for (size_t i = 0; i < res.occurrences.size(); ++i) {
+            if (i) out += ',';
+            out += "{\"keyword\":";
+            append_json_string(out, res.occurrences[i].first);
+            out += ",\"token\":" + std::to_string(res.occurrences[i].second) + "}";
+        }
+        out += "],\"issues\":[";
+        for (size_t i = 0; i < res.issues.size(); ++i) {
+            const ProgramIssue &is = res.issues[i];
+            if (i) out += ',';
+            out += "{\"line\":" + std::to_string(is.line) + ",\"column\":" + std::to_string(is.column) + ",\"occurrence\":";
+            append_json_string(out, is.tag);
+            out += ",\"message\":";
+            append_json_string(out, is.message);
+            out += '}';
+        }
+        out += "],\"lint\":[";
+        for (size_t i = 0; i < res.lint.size(); ++i) {
+            const LintFinding &f = res.lint[i];
+            if (i) out += ',';
+            out += "{\"line\":" + std::to_string(f.line) + ",\"occurrence\":";
+            append_json_string(out, f.tag);
+            out += ",\"rule\":";
+            append_json_string(out, f.rule);
+            out += ",\"message\":";
+            append_json_string(out, f.message);
+            out += ",\"suggestion\":";
+            append_json_string(out, f.suggestion);
+            out += '}';
+        }
+        out += ']';
+    } else {
+        out += ",\"ok\":false,\"error\":";
+        append_json_string(out, error);
+    }
+    out += ",\"warnings\":[";
+    for (size_t i = 0; i < warnings.size(); ++i) {
+        if (i) out += ',';
+        append_json_string(out, warnings[i]);
+    }
+    out += ']';
+    if (want_log) {
+        out += ",\"log\":";
+        append_json_string(out, log.str());
+    }
+    const Clock::time_point finished = Clock::now();
+    out += ",\"timings\":{\"queue_us\":" + std::to_string(micros(started - job.read_at)) +
+           ",\"generate_us\":" + std::to_string(generate_us) +
+           ",\"tokenize_us\":" + std::to_string(micros(res.timings.tokenize)) +
+           ",\"expand_us\":" + std::to_string(micros(res.timings.expand)) +
+           ",\"assemble_us\":" + std::to_string(micros(res.timings.assemble)) +
+           ",\"validate_us\":" + std::to_string(micros(res.timings.validate)) +
+           ",\"lint_us\":" + std::to_string(micros(res.timings.lint)) +
+           ",\"total_us\":" + std::to_string(micros(finished - job.read_at)) + "}}";
+    if (result) *result = std::move(res);
+    return out;
+}
+
+string handle_jsonl_request(Generator &gen, const string &request, const std::function<bool()> &cancel,
+                            GenerateResult *result) {
+    return handle_request(gen, Job{0, request, Clock::now()}, cancel, result);
+}
+
+string jsonl_error_response(const string &request, const string &error) {
+    string id = "null";
+    try {
+        JsonValue req = JsonParser(request).parse();
+        if (const JsonValue *v = req.kind == JsonValue::Object ? req.find("id") : nullptr) {
+            id.clear();
+            append_json(id, *v);
+        }
+    } catch (const std::exception &) {
+        // unparsable request: answered with a null id, like run_jsonl does
+    }
+    string out = "{\"id\":" + id + ",\"ok\":false,\"error\":";
+    append_json_string(out, error);
+    out += ",\"warnings\":[]}";
+    return out;
+}
+
+// -------------------- Stream pipeline --------------------
+
+// reader (caller's thread) -> work queue -> N generator threads -> reorder
+// buffer -> writer thread. `inflight` counts requests between being read and
+// being written; the reader waits while it is at the limit.
+struct Pipeline {
+    std::mutex mu;
+    std::condition_variable work_cv;  // work queued or input finished
+    std::condition_variable done_cv;  // a response is ready or input finished
+    std::condition_variable slot_cv;  // inflight dropped below the limit
+    std::deque<Job> work;
+    std::map<uint64_t, string> done;  // seq -> response, until it is written
+    size_t inflight = 0;
+    uint64_t total = 0;               // requests read so far
+    bool eof = false;
+    bool write_failed = false;
+};
+
+static void generator_thread(Generator &gen, Pipeline &p) {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(p.mu);
+            p.work_cv.wait(lk, [&] { return !p.work.empty() || p.eof; });
+            if (p.work.empty()) return;
+            job = std::move(p.work.front());
+            p.work.pop_front();
+        }
+        string response = handle_request(gen, job, nullptr, nullptr);
+        {
+            std::lock_guard<std::mutex> lk(p.mu);
+            p.done.emplace(job.seq, std::move(response));
+        }
+        p.done_cv.notify_one();
+    }
+}
+
+static void writer_thread(Pipeline &p, std::ostream &out) {
+    uint64_t next = 0;
+    vector<string> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(p.mu);
+            p.done_cv.wait(lk, [&] { return p.done.count(next) || (p.eof && next == p.total); });
+            if (!p.done.count(next)) return; // everything written
+            // take every consecutive response that is ready
+            for (auto it = p.done.find(next); it != p.done.end() && it->first == next; it = p.done.erase(it), ++next)
+                batch.push_back(std::move(it->second));
+        }
+        for (const auto &r : batch) out << r << '\n';
+        out.flush();
+        {
+            std::lock_guard<std::mutex> lk(p.mu);
+            p.inflight -= batch.size();
+            if (!out) p.write_failed = true;
+        }
+        batch.clear();
+        p.slot_cv.notify_one();
+    }
+}
+
+int run_jsonl(Generator &gen, const JsonlOptions &opts, std::istream &in, std::ostream &out) {
+    unsigned workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    size_t limit = opts.inflight ? opts.inflight : 4 * static_cast<size_t>(workers);
+
+    Pipeline p;
+    vector<std::thread> threads;
+    for (unsigned i = 0; i < workers; ++i) threads.emplace_back(generator_thread, std::ref(gen), std::ref(p));
+    std::thread writer(writer_thread, std::ref(p), std::ref(out));
+
+    string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (trim(line).empty()) continue;
+        {
+            std::unique_lock<std::mutex> lk(p.mu);
+            p.slot_cv.wait(lk, [&] { return p.inflight < limit || p.write_failed; });
+            if (p.write_failed) break;
+            ++p.inflight;
+            p.work.push_back(Job{p.total++, std::move(line), Clock::now()});
+        }
+        p.work_cv.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(p.mu);
+        p.eof = true;
+    }
+    p.work_cv.notify_all();
+    p.done_cv.notify_all();
+    for (auto &t : threads) t.join();
+    writer.join();
+    return p.write_failed ? 1 : 0;
+}
+
+} // namespace snippetgen
@@ -0,0 +1,65 @@
+/*
+JSON-lines streaming mode for the snippet generator: one request object per input
+line, one response object per output line, for pipelines that feed an unbounded
+stream of requests through a single process.
+
+Request (one per line; blank lines are ignored):
+  {"id": <any>, "line": "for if", "answers": {"<question or part of it>": "reply", ...}}
+  {"id": <any>, "line": "for if", "answers": "defaults"}     also the default when omitted
+  optional "log": true adds the progress notes printed while asking
+
+An answer value is either a string, used for every matching question, or an array
+of strings consumed one per matching question (multi-line bodies use arrays; the
+body ends when the array runs out). A key matches a question that equals it or
+contains it; exact matches win, otherwise keys are tried in request order.
+
+Response (in request order):
+  {"id": ..., "ok": true, "program": "...", "occurrences": [{"keyword": "for", "token": 1}, ...],
+   "issues": [{"line": n, "column": n, "occurrence": "...", "message": "..."}, ...],
+   "lint": [{"line": n, "occurrence": "...", "rule": "...", "message": "...", "suggestion": "..."}, ...],
+   "warnings": [...], "log": "...",
+   "timings": {"queue_us": n, "generate_us": n, "tokenize_us": n, "expand_us": n, "assemble_us": n,
+               "validate_us": n, "lint_us": n, "total_us": n}}
+  {"id": ..., "ok": false, "error": "...", "warnings": [...], "log": "...", "timings": {...}}
+"log" is present only when the request asked for it.
+
+Requests never define new keywords, so the database is read-only here and
+requests are generated on several threads at once.
+*/
+
+#ifndef SNIPPET_JSONL_H
+#define SNIPPET_JSONL_H
+
+#include "snippetgen.h"
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+namespace snippetgen {
+
+struct JsonlOptions {
+    unsigned workers = 0;  // generator threads; 0 = hardware concurrency
+    unsigned inflight = 0; // requests read but not yet written; 0 = 4 x workers.
+                           // Input is not read while the limit is reached, so a
+                           // slow consumer throttles the producer.
+};
+
+// Process requests from `in` until end of input. Returns the process exit code.
+int run_jsonl(Generator &gen, const JsonlOptions &opts, std::istream &in, std::ostream &out);
+
+// One request line to its response line (no newline), as run_jsonl writes it.
+// `cancel` is checked at every follow-up question; once it returns true the
+// request stops and is answered with "error": "cancelled". `result`, when
+// given, receives the generator's result (for metrics).
+std::string handle_jsonl_request(Generator &gen, const std::string &request,
+                                 const std::function<bool()> &cancel = nullptr,
+                                 GenerateResult *result = nullptr);
+
+// A failure response for `request` without generating it, keeping the
+// request's id when it parses.
+std::string jsonl_error_response(const std::string &request, const std::string &error);
+
+} // namespace snippetgen
+
+#endif // SNIPPET_JSONL_H
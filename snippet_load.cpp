@@ -0,0 +1,299 @@
+/*
+snippet_load — load generator for `snippet_gen --serve`.
+
+Replays recorded sessions (the lines typed at the interactive prompt; ':'
+commands and 'exit' are skipped) or synthetic keyword lines against the server
+socket over C concurrent connections, optionally paced to a fixed total request
+rate, and reports throughput and latency percentiles.
+
+With --shm, every connection switches its replies to the server's shared-memory
+ring (Linux) and reads each program in place instead of through the socket.
+
+With --rate, requests are scheduled at fixed intervals and latency is measured
+from the scheduled send time, so a stalled server shows up as latency rather
+than as a lower request rate.
+
+Compile: g++ -std=c++17 -O2 -Wall -Wextra -pthread -o snippet_load snippet_load.cpp snippetgen.cpp snippet_server.cpp snippet_metrics.cpp snippet_tenants.cpp snippet_jsonl.cpp snippet_coordinator.cpp snippet_shm.cpp snippet_build.cpp snippet_tools.cpp
+*/
+
+#include "snippetgen.h"
+#include "snippet_server.h"
+#include "snippet_shm.h"
+#include "snippet_tools.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::cout;
+using std::string;
+using std::vector;
+
+using namespace snippetgen;
+
+#ifdef _WIN32
+
+int main() {
+    cerr << "snippet_load needs a POSIX system.\n";
+    return 1;
+}
+
+#else
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions {
+    string socket_path = "snippet_gen.sock";
+    string db_path = USER_KW_FILE;   // keywords for synthetic lines
+    vector<string> replay_files;     // empty = synthetic
+    unsigned connections = 4;
+    double rate = 0;                 // total requests per second; 0 = closed loop
+    size_t requests = 1000;          // ignored when duration > 0
+    double duration = 0;             // seconds
+    unsigned tokens = 3;             // keywords per synthetic line
+    unsigned seed = 1;
+    bool shm = false;                // replies through the shared-memory ring
+};
+
+static vector<string> synthetic_lines(const LoadOptions &opts, size_t count) {
+    vector<string> vocab(cpp17_keywords().begin(), cpp17_keywords().end());
+    UserKeywordDb db;
+    load_user_keywords(db, opts.db_path, false);
+    for (const auto &kv : db.entries) vocab.push_back(kv.first);
+    std::sort(vocab.begin(), vocab.end()); // deterministic for a given seed
+    std::mt19937 rng(opts.seed);
+    std::uniform_int_distribution<size_t> pick(0, vocab.size() - 1);
+    vector<string> lines;
+    lines.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        string line;
+        for (unsigned t = 0; t < opts.tokens; ++t) {
+            if (t) line += ' ';
+            line += vocab[pick(rng)];
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// -------------------- Client connection --------------------
+
+class Connection {
+    int fd_ = -1;
+    string buf_;
+
+    bool fill() {
+        char chunk[65536];
+        while (true) {
+            ssize_t r = ::read(fd_, chunk, sizeof(chunk));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            buf_.append(chunk, static_cast<size_t>(r));
+            return true;
+        }
+    }
+
+public:
+    ~Connection() { if (fd_ >= 0) ::close(fd_); }
+
+    bool open(const string &address) {
+        string error;
+        fd_ = connect_to_server(address, error);
+        if (fd_ >= 0) return true;
+        cerr << error << "\n";
+        return false;
+    }
+
+    // Send one line and wait for its reply. Returns false if the connection
+    // broke or the reply cannot be framed; `ok` tells an OK reply from an ERR reply.
+    bool request(const string &line, bool &ok) {
+        string msg = line + "\n";
+        const char *p = msg.data();
+        size_t n = msg.size();
+        while (n > 0) {
+            ssize_t w = ::write(fd_, p, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            p += w;
+            n -= static_cast<size_t>(w);
+        }
+        size_t nl;
+        while ((nl = buf_.find('\n')) == string::npos) if (!fill()) return false;
+        string head = buf_.substr(0, nl);
+        buf_.erase(0, nl + 1);
+        if (head.rfind("OK ", 0) == 0) {
+            size_t len = 0;
+            try { len = std::stoul(head.substr(3)); } catch (const std::exception &) { ok = false; return false; }
+            while (buf_.size() < len) if (!fill()) return false;
+            buf_.erase(0, len);
+            ok = true;
+            return true;
+        }
+        ok = false;
+        return head.rfind("ERR", 0) == 0;
+    }
+};
+
+// -------------------- Load loop --------------------
+
+struct ClientStats {
+    vector<double> latencies_us;
+    size_t ok = 0;
+    size_t err = 0;
+    size_t broken = 0; // connection failures
+};
+
+// A session replying through the shared-memory ring; the reply is looked at in
+// place, as a latency-critical client would.
+class ShmConnection {
+    ShmClient client_;
+
+public:
+    bool open(const string &path) {
+        string error;
+        if (client_.connect(path, SHM_DEFAULT_RING, error)) return true;
+        cerr << "shm: " << error << "\n";
+        return false;
+    }
+
+    bool request(const string &line, bool &ok) {
+        std::string_view reply;
+        string error;
+        return client_.request(line, ok, reply, error);
+    }
+};
+
+template <typename Conn>
+static void run_client(const LoadOptions &opts, const vector<string> &lines, unsigned index,
+                       std::atomic<size_t> &next, Clock::time_point start, Clock::time_point deadline,
+                       ClientStats &st) {
+    Conn conn;
+    if (!conn.open(opts.socket_path)) { ++st.broken; return; }
+    const bool timed = opts.duration > 0;
+    const auto interval = opts.rate > 0 ? std::chrono::duration<double>(1.0 / opts.rate) : std::chrono::duration<double>(0);
+    while (true) {
+        size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (!timed && i >= opts.requests) break;
+        Clock::time_point scheduled = Clock::now();
+        if (opts.rate > 0) {
+            // request i belongs at start + i/rate, whichever connection sends it
+            scheduled = start + std::chrono::duration_cast<Clock::duration>(interval * static_cast<double>(i));
+            if (timed && scheduled >= deadline) break;
+            std::this_thread::sleep_until(scheduled);
+        } else if (timed && scheduled >= deadline) {
+            break;
+        }
+        bool ok = false;
+        if (!conn.request(lines[(i + index) % lines.size()], ok)) {
+            ++st.broken;
+            break;
+        }
+        st.latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - scheduled).count());
+        ++(ok ? st.ok : st.err);
+    }
+}
+
+static void print_usage(const char *argv0) {
+    cout << "Usage: " << argv0 << " [options]\n"
+         << "  --socket <address>   server socket path or tcp:<host>:<port> (default snippet_gen.sock)\n"
+         << "  --replay <file>      replay a recorded session (repeatable); default: synthetic lines\n"
+         << "  --db <file>          keywords for synthetic lines besides C++17 (default " << USER_KW_FILE << ")\n"
+         << "  --tokens N           keywords per synthetic line (default 3)\n"
+         << "  --seed N             synthetic line seed (default 1)\n"
+         << "  --connections N      concurrent connections (default 4)\n"
+         << "  --rate R             total requests per second (default: as fast as possible)\n"
+         << "  --requests N         stop after N requests (default 1000)\n"
+         << "  --duration S         run for S seconds instead of a request count\n"
+         << "  --shm                read replies from the server's shared-memory ring (Linux)\n";
+}
+
+int main(int argc, char *argv[]) {
+    LoadOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&]() -> string {
+            if (i + 1 >= argc) throw std::invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+        try {
+            if (arg == "--socket") opts.socket_path = value();
+            else if (arg == "--replay") opts.replay_files.push_back(value());
+            else if (arg == "--db") opts.db_path = value();
+            else if (arg == "--tokens") opts.tokens = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--seed") opts.seed = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--connections") opts.connections = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--rate") opts.rate = std::stod(value());
+            else if (arg == "--requests") opts.requests = std::stoul(value());
+            else if (arg == "--duration") opts.duration = std::stod(value());
+            else if (arg == "--shm") opts.shm = true;
+            else if (arg == "--help" || arg == "-h") { print_usage(argv[0]); return 0; }
+            else { cerr << "Unknown option '" << arg << "'.\n"; print_usage(argv[0]); return 2; }
+        } catch (const std::exception &) {
+            cerr << "Invalid value for " << arg << ".\n";
+            return 2;
+        }
+    }
+    if (opts.connections == 0 || opts.tokens == 0) { cerr << "--connections and --tokens must be positive.\n"; return 2; }
+
+    vector<string> lines;
+    for (const auto &f : opts.replay_files) {
+        if (!read_session(f, lines)) { cerr << "Cannot read " << f << ".\n"; return 1; }
+    }
+    if (opts.replay_files.empty()) lines = synthetic_lines(opts, 4096);
+    if (lines.empty()) { cerr << "No request lines to send.\n"; return 1; }
+
+    std::atomic<size_t> next{0};
+    vector<ClientStats> stats(opts.connections);
+    vector<std::thread> clients;
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.duration));
+    for (unsigned c = 0; c < opts.connections; ++c)
+        clients.emplace_back(opts.shm ? run_client<ShmConnection> : run_client<Connection>, std::cref(opts), std::cref(lines), c, std::ref(next), start, deadline, std::ref(stats[c]));
+    for (auto &t : clients) t.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    ClientStats total;
+    for (auto &st : stats) {
+        total.latencies_us.insert(total.latencies_us.end(), st.latencies_us.begin(), st.latencies_us.end());
+        total.ok += st.ok;
+        total.err += st.err;
+        total.broken += st.broken;
+    }
+    std::sort(total.latencies_us.begin(), total.latencies_us.end());
+    double mean = 0;
+    for (double v : total.latencies_us) mean += v;
+    if (!total.latencies_us.empty()) mean /= static_cast<double>(total.latencies_us.size());
+
+    const size_t done = total.latencies_us.size();
+    cout << std::fixed << std::setprecision(1);
+    cout << "requests:    " << done << " (" << total.ok << " OK, " << total.err << " ERR) over "
+         << opts.connections << " connection(s), " << lines.size() << " distinct line(s)\n";
+    if (total.broken) cout << "broken:      " << total.broken << " connection(s) failed or closed early\n";
+    cout << "elapsed:     " << std::setprecision(3) << elapsed << std::setprecision(1) << " s\n";
+    cout << "throughput:  " << (elapsed > 0 ? static_cast<double>(done) / elapsed : 0) << " req/s";
+    if (opts.rate > 0) cout << " (target " << opts.rate << ")";
+    cout << "\n";
+    cout << "latency us:  mean " << mean
+         << "  p50 " << percentile(total.latencies_us, 50)
+         << "  p90 " << percentile(total.latencies_us, 90)
+         << "  p99 " << percentile(total.latencies_us, 99)
+         << "  p99.9 " << percentile(total.latencies_us, 99.9)
+         << "  max " << (total.latencies_us.empty() ? 0 : total.latencies_us.back()) << "\n";
+    return total.broken ? 1 : 0;
+}
+
+#endif // _WIN32
@@ -0,0 +1,234 @@
+/*
+Server metrics implementation. See snippet_metrics.h.
+*/
+
+#include "snippet_metrics.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace snippetgen {
+
+using std::string;
+
+static const double LATENCY_BOUNDS[LATENCY_BUCKETS] = {
+    0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+    0.01, 0.025, 0.05, 0.1, 0.25, 1.0, 5.0,
+};
+
+static const char *const STAGE_NAMES[STAGE_COUNT] = {
+    "tokenize", "expand", "assemble", "validate", "lint", "write", "request",
+};
+
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyHistogram::observe(std::chrono::nanoseconds d) {
+    const double secs = std::chrono::duration<double>(d).count();
+    size_t b = 0;
+    while (b < LATENCY_BUCKETS && secs > LATENCY_BOUNDS[b]) ++b;
+    buckets[b].fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(static_cast<uint64_t>(d.count() > 0 ? d.count() : 0), std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WorkerMetrics::record(const GenerateResult &res) {
+    (res.ok ? requests_ok : requests_failed).fetch_add(1, std::memory_order_relaxed);
+    stages[STAGE_TOKENIZE].observe(res.timings.tokenize);
+    if (res.ok) {
+        stages[STAGE_EXPAND].observe(res.timings.expand);
+        stages[STAGE_ASSEMBLE].observe(res.timings.assemble);
+        // zero when the request turned the pass off
+        if (res.timings.validate.count() > 0) stages[STAGE_VALIDATE].observe(res.timings.validate);
+        if (res.timings.lint.count() > 0) stages[STAGE_LINT].observe(res.timings.lint);
+    }
+}
+
+void WorkerMetrics::sample_allocator() {
+    const int64_t now = steady_now_ns();
+    if (now - heap_sampled_ns.load(std::memory_order_relaxed) < 100000000) return;
+    heap_sampled_ns.store(now, std::memory_order_relaxed);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = ::mallinfo2();
+    heap_in_use_bytes.store(mi.uordblks + mi.hblkhd, std::memory_order_relaxed);
+    heap_mapped_bytes.store(mi.arena + mi.hblkhd, std::memory_order_relaxed);
+#elif defined(__GLIBC__)
+    struct mallinfo mi = ::mallinfo();
+    heap_in_use_bytes.store(static_cast<unsigned>(mi.uordblks) + static_cast<unsigned>(mi.hblkhd), std::memory_order_relaxed);
+    heap_mapped_bytes.store(static_cast<unsigned>(mi.arena) + static_cast<unsigned>(mi.hblkhd), std::memory_order_relaxed);
+#endif
+}
+
+ServerMetrics::ServerMetrics(unsigned slots) : slots_(slots ? slots : 1) {
+    size_ = sizeof(std::atomic<uint64_t>) + sizeof(WorkerMetrics) * slots_;
+    mem_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem_ == MAP_FAILED) {
+        mem_ = nullptr;
+        throw std::runtime_error(string("mmap metrics: ") + std::strerror(errno));
+    }
+    // the mapping is zero-filled, which is the initial state of every counter
+    restarts_ = new (mem_) std::atomic<uint64_t>(0);
+    slot_base_ = reinterpret_cast<WorkerMetrics*>(static_cast<char*>(mem_) + sizeof(std::atomic<uint64_t>));
+    for (unsigned i = 0; i < slots_; ++i) new (&slot_base_[i]) WorkerMetrics();
+}
+
+ServerMetrics::~ServerMetrics() {
+    if (mem_) ::munmap(mem_, size_);
+}
+
+void ServerMetrics::note_restart(unsigned i) {
+    restarts_->fetch_add(1, std::memory_order_relaxed);
+    slot_base_[i].active_connections.store(0, std::memory_order_relaxed);
+    slot_base_[i].queued_sessions.store(0, std::memory_order_relaxed);
+    slot_base_[i].admission_permits.store(0, std::memory_order_relaxed);
+    slot_base_[i].pid.store(0, std::memory_order_relaxed);
+}
+
+// Sum one counter over every slot.
+template <typename Field>
+static uint64_t sum_slots(const WorkerMetrics *slots, unsigned n, Field field) {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        int64_t v = static_cast<int64_t>((slots[i].*field).load(std::memory_order_relaxed));
+        if (v > 0) total += static_cast<uint64_t>(v);
+    }
+    return total;
+}
+
+string ServerMetrics::render(const UserKeywordDb &db) const {
+    std::ostringstream os;
+    os.precision(9);
+
+    os << "# HELP snippetgen_requests_total Keyword lines answered, by result.\n"
+       << "# TYPE snippetgen_requests_total counter\n"
+       << "snippetgen_requests_total{result=\"ok\"} " << sum_slots(slot_base_, slots_, &WorkerMetrics::requests_ok) << "\n"
+       << "snippetgen_requests_total{result=\"error\"} " << sum_slots(slot_base_, slots_, &WorkerMetrics::requests_failed) << "\n";
+
+    os << "# HELP snippetgen_stage_duration_seconds Time spent per request stage.\n"
+       << "# TYPE snippetgen_stage_duration_seconds histogram\n";
+    for (int st = 0; st < STAGE_COUNT; ++st) {
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b <= LATENCY_BUCKETS; ++b) {
+            for (unsigned i = 0; i < slots_; ++i)
+                cumulative += slot_base_[i].stages[st].buckets[b].load(std::memory_order_relaxed);
+            os << "snippetgen_stage_duration_seconds_bucket{stage=\"" << STAGE_NAMES[st] << "\",le=\"";
+            if (b < LATENCY_BUCKETS) os << LATENCY_BOUNDS[b];
+            else os << "+Inf";
+            os << "\"} " << cumulative << "\n";
+        }
+        uint64_t sum_ns = 0, count = 0;
+        for (unsigned i = 0; i < slots_; ++i) {
+            sum_ns += slot_base_[i].stages[st].sum_ns.load(std::memory_order_relaxed);
+            count += slot_base_[i].stages[st].count.load(std::memory_order_relaxed);
+        }
+        os << "snippetgen_stage_duration_seconds_sum{stage=\"" << STAGE_NAMES[st] << "\"} " << static_cast<double>(sum_ns) / 1e9 << "\n"
+           << "snippetgen_stage_duration_seconds_count{stage=\"" << STAGE_NAMES[st] << "\"} " << count << "\n";
+    }
+
+    const DbLoadStats loads = db_load_stats();
+    os << "# HELP snippetgen_db_image_loads_total Database loads served from the fast-start image (hit) or parsed from text (miss).\n"
+       << "# TYPE snippetgen_db_image_loads_total counter\n"
+       << "snippetgen_db_image_loads_total{result=\"hit\"} " << loads.image_hits << "\n"
+       << "snippetgen_db_image_loads_total{result=\"miss\"} " << loads.image_misses << "\n";
+
+    size_t snippet_bytes = 0;
+    for (const auto &kv : db.entries) snippet_bytes += kv.first.size() + kv.second.snippet.size();
+    os << "# HELP snippetgen_db_keywords Custom keywords loaded.\n"
+       << "# TYPE snippetgen_db_keywords gauge\n"
+       << "snippetgen_db_keywords " << db.entries.size() << "\n"
+       << "# HELP snippetgen_db_snippet_bytes Bytes of keyword names and snippet text loaded.\n"
+       << "# TYPE snippetgen_db_snippet_bytes gauge\n"
+       << "snippetgen_db_snippet_bytes " << snippet_bytes << "\n"
+       << "# HELP snippetgen_db_version Version of the loaded database.\n"
+       << "# TYPE snippetgen_db_version gauge\n"
+       << "snippetgen_db_version " << db.version << "\n";
+
+    os << "# HELP snippetgen_connections_total Client connections accepted.\n"
+       << "# TYPE snippetgen_connections_total counter\n"
+       << "snippetgen_connections_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::connections) << "\n"
+       << "# HELP snippetgen_active_sessions Client connections currently open.\n"
+       << "# TYPE snippetgen_active_sessions gauge\n"
+       << "snippetgen_active_sessions " << sum_slots(slot_base_, slots_, &WorkerMetrics::active_connections) << "\n"
+       << "# HELP snippetgen_queued_sessions Connections waiting for a session slot.\n"
+       << "# TYPE snippetgen_queued_sessions gauge\n"
+       << "snippetgen_queued_sessions " << sum_slots(slot_base_, slots_, &WorkerMetrics::queued_sessions) << "\n"
+       << "# HELP snippetgen_sessions_rejected_total Connections turned away because the wait queue was full or timed out.\n"
+       << "# TYPE snippetgen_sessions_rejected_total counter\n"
+       << "snippetgen_sessions_rejected_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::sessions_rejected) << "\n"
+       << "# HELP snippetgen_sessions_idle_closed_total Sessions closed after the idle timeout.\n"
+       << "# TYPE snippetgen_sessions_idle_closed_total counter\n"
+       << "snippetgen_sessions_idle_closed_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::sessions_idle_closed) << "\n"
+       << "# HELP snippetgen_requests_cancelled_total Requests unwound mid-generation (deadline, disconnect or shutdown).\n"
+       << "# TYPE snippetgen_requests_cancelled_total counter\n"
+       << "snippetgen_requests_cancelled_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::requests_cancelled) << "\n"
+       << "# HELP snippetgen_shm_sessions_total Sessions that switched their replies to a shared-memory ring.\n"
+       << "# TYPE snippetgen_shm_sessions_total counter\n"
+       << "snippetgen_shm_sessions_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::shm_sessions) << "\n";
+
+    os << "# HELP snippetgen_tenants_loaded Tenant databases in memory.\n"
+       << "# TYPE snippetgen_tenants_loaded gauge\n"
+       << "snippetgen_tenants_loaded " << sum_slots(slot_base_, slots_, &WorkerMetrics::tenants_loaded) << "\n"
+       << "# HELP snippetgen_tenant_bytes Approximate memory held by loaded tenant databases.\n"
+       << "# TYPE snippetgen_tenant_bytes gauge\n"
+       << "snippetgen_tenant_bytes " << sum_slots(slot_base_, slots_, &WorkerMetrics::tenant_bytes) << "\n"
+       << "# HELP snippetgen_tenant_lookups_total Tenant selections, by whether the database was already loaded.\n"
+       << "# TYPE snippetgen_tenant_lookups_total counter\n"
+       << "snippetgen_tenant_lookups_total{result=\"hit\"} " << sum_slots(slot_base_, slots_, &WorkerMetrics::tenant_hits) << "\n"
+       << "snippetgen_tenant_lookups_total{result=\"load\"} " << sum_slots(slot_base_, slots_, &WorkerMetrics::tenant_loads) << "\n"
+       << "# HELP snippetgen_tenant_evictions_total Tenant databases evicted to stay under the memory budget.\n"
+       << "# TYPE snippetgen_tenant_evictions_total counter\n"
+       << "snippetgen_tenant_evictions_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::tenant_evictions) << "\n";
+
+    os << "# HELP snippetgen_replica_version Database version served, per worker (replicas).\n"
+       << "# TYPE snippetgen_replica_version gauge\n";
+    for (unsigned i = 0; i < slots_; ++i)
+        os << "snippetgen_replica_version{worker=\"" << i << "\"} " << slot_base_[i].replica_version.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP snippetgen_replica_journal_version Newest committed version seen in the journal, per worker.\n"
+       << "# TYPE snippetgen_replica_journal_version gauge\n";
+    for (unsigned i = 0; i < slots_; ++i)
+        os << "snippetgen_replica_journal_version{worker=\"" << i << "\"} " << slot_base_[i].replica_journal_version.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP snippetgen_replica_lag_seconds Delay between the writer committing the last applied change and this worker applying it.\n"
+       << "# TYPE snippetgen_replica_lag_seconds gauge\n";
+    for (unsigned i = 0; i < slots_; ++i)
+        os << "snippetgen_replica_lag_seconds{worker=\"" << i << "\"} " << static_cast<double>(slot_base_[i].replica_lag_ms.load(std::memory_order_relaxed)) / 1e3 << "\n";
+    os << "# HELP snippetgen_replica_records_applied_total Journal records applied.\n"
+       << "# TYPE snippetgen_replica_records_applied_total counter\n"
+       << "snippetgen_replica_records_applied_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::replica_records_applied) << "\n"
+       << "# HELP snippetgen_replica_read_errors_total Journal polls that could not open the journal.\n"
+       << "# TYPE snippetgen_replica_read_errors_total counter\n"
+       << "snippetgen_replica_read_errors_total " << sum_slots(slot_base_, slots_, &WorkerMetrics::replica_read_errors) << "\n";
+
+    unsigned alive = 0;
+    for (unsigned i = 0; i < slots_; ++i) if (slot_base_[i].pid.load(std::memory_order_relaxed) > 0) ++alive;
+    os << "# HELP snippetgen_workers Worker processes running.\n"
+       << "# TYPE snippetgen_workers gauge\n"
+       << "snippetgen_workers " << alive << "\n"
+       << "# HELP snippetgen_worker_restarts_total Workers restarted after exiting or crashing.\n"
+       << "# TYPE snippetgen_worker_restarts_total counter\n"
+       << "snippetgen_worker_restarts_total " << restarts_->load(std::memory_order_relaxed) << "\n";
+
+    os << "# HELP snippetgen_heap_in_use_bytes Allocator bytes in use, per worker (sampled after requests).\n"
+       << "# TYPE snippetgen_heap_in_use_bytes gauge\n";
+    for (unsigned i = 0; i < slots_; ++i)
+        os << "snippetgen_heap_in_use_bytes{worker=\"" << i << "\"} " << slot_base_[i].heap_in_use_bytes.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP snippetgen_heap_mapped_bytes Memory the allocator obtained from the OS, per worker.\n"
+       << "# TYPE snippetgen_heap_mapped_bytes gauge\n";
+    for (unsigned i = 0; i < slots_; ++i)
+        os << "snippetgen_heap_mapped_bytes{worker=\"" << i << "\"} " << slot_base_[i].heap_mapped_bytes.load(std::memory_order_relaxed) << "\n";
+    return os.str();
+}
+
+} // namespace snippetgen
+
+#endif // _WIN32
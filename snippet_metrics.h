@@ -0,0 +1,102 @@
+/*
+Server metrics: counters and latency histograms kept in one shared anonymous
+mapping, so pre-forked workers record into their own slot and whichever process
+answers a scrape sums every slot. Rendered in the Prometheus text format
+(version 0.0.4). POSIX only.
+*/
+
+#ifndef SNIPPET_METRICS_H
+#define SNIPPET_METRICS_H
+
+#include "snippetgen.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace snippetgen {
+
+enum MetricStage {
+    STAGE_TOKENIZE,
+    STAGE_EXPAND,
+    STAGE_ASSEMBLE,
+    STAGE_VALIDATE, // validate_program() on the assembled program
+    STAGE_LINT,     // lint_program()
+    STAGE_WRITE,   // sending the reply to the client
+    STAGE_REQUEST, // whole request, from line received to reply sent
+    STAGE_COUNT
+};
+
+// Upper bounds in seconds; one more bucket holds +Inf.
+const size_t LATENCY_BUCKETS = 14;
+
+struct LatencyHistogram {
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS + 1];
+    std::atomic<uint64_t> sum_ns;
+    std::atomic<uint64_t> count;
+
+    void observe(std::chrono::nanoseconds d);
+};
+
+// Written only by the process that owns the slot.
+struct WorkerMetrics {
+    std::atomic<int64_t> pid;
+    std::atomic<uint64_t> requests_ok;
+    std::atomic<uint64_t> requests_failed;
+    std::atomic<uint64_t> connections;
+    std::atomic<int64_t> active_connections; // admitted sessions (each holds an admission slot)
+    std::atomic<int64_t> queued_sessions;    // accepted, waiting for an admission slot
+    std::atomic<int64_t> admission_permits;  // admission slots this process holds; given back if it dies
+    std::atomic<uint64_t> sessions_rejected; // turned away: wait queue full or queue timeout
+    std::atomic<uint64_t> sessions_idle_closed;
+    std::atomic<uint64_t> requests_cancelled;
+    std::atomic<uint64_t> shm_sessions;      // sessions switched to the shared-memory ring
+    std::atomic<uint64_t> tenants_loaded;    // this process's tenant pool
+    std::atomic<uint64_t> tenant_bytes;
+    std::atomic<uint64_t> tenant_loads;
+    std::atomic<uint64_t> tenant_hits;
+    std::atomic<uint64_t> tenant_evictions;
+    std::atomic<uint64_t> replica_version;         // database version this process serves (replicas)
+    std::atomic<uint64_t> replica_journal_version; // newest committed version seen in the journal
+    std::atomic<int64_t> replica_lag_ms;           // commit-to-apply delay of the last applied record
+    std::atomic<uint64_t> replica_records_applied;
+    std::atomic<uint64_t> replica_read_errors;     // polls that could not open the journal
+    std::atomic<uint64_t> heap_in_use_bytes; // allocator sample, refreshed after requests
+    std::atomic<uint64_t> heap_mapped_bytes;
+    std::atomic<int64_t> heap_sampled_ns;    // steady_clock time of the last sample
+    LatencyHistogram stages[STAGE_COUNT];
+
+    void record(const GenerateResult &res);
+    // Refresh the allocator sample at most every 100 ms.
+    void sample_allocator();
+};
+
+class ServerMetrics {
+public:
+    // Maps room for `slots` workers, shared with processes forked afterwards.
+    // Throws std::runtime_error if the mapping fails.
+    explicit ServerMetrics(unsigned slots);
+    ~ServerMetrics();
+    ServerMetrics(const ServerMetrics &) = delete;
+    ServerMetrics &operator=(const ServerMetrics &) = delete;
+
+    unsigned slots() const { return slots_; }
+    WorkerMetrics &slot(unsigned i) { return slot_base_[i]; }
+    // A worker died; its slot is handed to the replacement with counters kept.
+    void note_restart(unsigned i);
+
+    std::string render(const UserKeywordDb &db) const;
+
+private:
+    void *mem_ = nullptr;
+    size_t size_ = 0;
+    unsigned slots_ = 0;
+    std::atomic<uint64_t> *restarts_ = nullptr;
+    WorkerMetrics *slot_base_ = nullptr;
+};
+
+} // namespace snippetgen
+
+#endif // SNIPPET_METRICS_H
@@ -0,0 +1,854 @@
+/*
+Server mode implementation (POSIX only). See snippet_server.h.
+*/
+
+#include "snippet_server.h"
+#include "snippet_jsonl.h"
+#include "snippet_metrics.h"
+#include "snippet_shm.h"
+#include "snippet_tenants.h"
+
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace snippetgen {
+
+#ifdef _WIN32
+
+int run_server(Generator &, const ServerOptions &) {
+    std::cerr << "Server mode is not supported on this platform.\n";
+    return 1;
+}
+
+int connect_to_server(const std::string &, std::string &error) {
+    error = "server connections are not supported on this platform";
+    return -1;
+}
+
+#else
+
+using std::string;
+
+// Set by the stop signals, read by every thread (lock-free, so async-signal-safe).
+static std::atomic<int> g_stop{0};
+static_assert(std::atomic<int>::is_always_lock_free, "g_stop is written from a signal handler");
+
+static void on_stop_signal(int) { g_stop = 1; }
+
+// Install handlers without SA_RESTART so blocking accept()/waitpid() return EINTR.
+static void install_stop_handlers() {
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+// -------------------- Admission control --------------------
+
+// Shared by every process of the server (mapped before the workers fork):
+// `permits` counts free session slots across all workers, `queued` the
+// connections waiting for one.
+struct Admission {
+    sem_t permits;
+    std::atomic<int64_t> queued;
+};
+
+static Admission *map_admission(unsigned max_sessions) {
+    void *mem = ::mmap(nullptr, sizeof(Admission), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return nullptr;
+    Admission *adm = new (mem) Admission();
+    if (::sem_init(&adm->permits, 1, max_sessions) != 0) {
+        ::munmap(mem, sizeof(Admission));
+        return nullptr;
+    }
+    return adm;
+}
+
+static void unmap_admission(Admission *adm) {
+    ::sem_destroy(&adm->permits);
+    adm->~Admission();
+    ::munmap(adm, sizeof(Admission));
+}
+
+// Take a session slot, waiting in the bounded queue if none is free. Every
+// slot taken is counted in metrics.admission_permits before admit() returns,
+// and a queue place in metrics.queued_sessions before it is taken, so
+// reclaim_worker() can give back what a worker held when it died.
+static bool admit(Admission &adm, const ServerOptions &opts, WorkerMetrics &metrics) {
+    if (::sem_trywait(&adm.permits) == 0) {
+        metrics.admission_permits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    metrics.queued_sessions.fetch_add(1, std::memory_order_relaxed);
+    if (adm.queued.fetch_add(1) >= static_cast<int64_t>(opts.max_queue)) {
+        adm.queued.fetch_sub(1);
+        metrics.queued_sessions.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    timespec deadline;
+    ::clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += opts.queue_timeout_ms / 1000;
+    deadline.tv_nsec += static_cast<long>(opts.queue_timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec += 1; deadline.tv_nsec -= 1000000000L; }
+    int rc;
+    while ((rc = ::sem_timedwait(&adm.permits, &deadline)) != 0 && errno == EINTR && !g_stop) {}
+    if (rc == 0) metrics.admission_permits.fetch_add(1, std::memory_order_relaxed);
+    adm.queued.fetch_sub(1);
+    metrics.queued_sessions.fetch_sub(1, std::memory_order_relaxed);
+    return rc == 0;
+}
+
+// Give back a slot taken by admit().
+static void release_admission(Admission &adm, WorkerMetrics &metrics) {
+    metrics.admission_permits.fetch_sub(1, std::memory_order_relaxed);
+    ::sem_post(&adm.permits);
+}
+
+// -------------------- Replication --------------------
+
+// Guards gen.db() on a replica: requests read it, the journal follower writes
+// it. Writer-preferring, so a steady stream of requests cannot starve updates.
+class DbLock {
+    pthread_rwlock_t lock_;
+
+public:
+    DbLock() {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        pthread_rwlock_init(&lock_, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+    ~DbLock() { pthread_rwlock_destroy(&lock_); }
+    DbLock(const DbLock &) = delete;
+    DbLock &operator=(const DbLock &) = delete;
+
+    void lock() { pthread_rwlock_wrlock(&lock_); }
+    void unlock() { pthread_rwlock_unlock(&lock_); }
+    void lock_shared() { pthread_rwlock_rdlock(&lock_); }
+    void unlock_shared() { pthread_rwlock_unlock(&lock_); }
+};
+
+// Everything a serving process needs; built once by run_server before forking.
+struct ServerState {
+    Generator &gen;          // the server's database; with tenants, the shared system keywords
+    const ServerOptions &opts;
+    int listen_fd;
+    int metrics_fd;          // -1 without a metrics endpoint
+    ServerMetrics &metrics;
+    Admission &adm;
+    TenantPool *tenants;     // nullptr unless tenants_dir is set; one pool per process
+    JournalTailer *journal;  // nullptr unless replica_journal is set; each process follows it
+    DbLock &db_lock;         // taken around reads of gen.db() when following a journal
+};
+
+// Apply whatever the writer committed since the last call. Returns the number
+// of records applied.
+static size_t follow_journal(ServerState &srv, WorkerMetrics *metrics) {
+    std::vector<JournalRecord> records;
+    if (!srv.journal->read_new(records)) {
+        if (metrics) metrics->replica_read_errors.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    size_t applied = 0;
+    int64_t last_commit_ms = 0;
+    if (!records.empty()) {
+        std::lock_guard<DbLock> lk(srv.db_lock);
+        for (const auto &rec : records) {
+            if (apply_journal_record(srv.gen.db(), rec)) {
+                ++applied;
+                last_commit_ms = rec.committed_ms;
+            }
+        }
+    }
+    if (metrics) {
+        metrics->replica_version.store(srv.gen.db().version, std::memory_order_relaxed);
+        metrics->replica_journal_version.store(srv.journal->head_version(), std::memory_order_relaxed);
+        if (applied) {
+            const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            metrics->replica_lag_ms.store(std::max<int64_t>(0, now_ms - last_commit_ms), std::memory_order_relaxed);
+            metrics->replica_records_applied.fetch_add(applied, std::memory_order_relaxed);
+        }
+    }
+    return applied;
+}
+
+// -------------------- Addresses --------------------
+
+static bool is_tcp_address(const string &address) { return address.rfind("tcp:", 0) == 0; }
+
+// "tcp:<host>:<port>" (an IPv6 host in brackets) to getaddrinfo results.
+static addrinfo *resolve_tcp(const string &address, bool passive, string &error) {
+    const string rest = address.substr(4);
+    const size_t colon = rest.rfind(':');
+    if (colon == string::npos || colon + 1 == rest.size()) {
+        error = "expected tcp:<host>:<port>, got '" + address + "'";
+        return nullptr;
+    }
+    string host = rest.substr(0, colon);
+    const string port = rest.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (passive) hints.ai_flags = AI_PASSIVE;
+    addrinfo *res = nullptr;
+    int rc = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        error = address + ": " + ::gai_strerror(rc);
+        return nullptr;
+    }
+    return res;
+}
+
+static bool unix_address(const string &path, sockaddr_un &addr, string &error) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        error = "socket path too long: " + path;
+        return false;
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return true;
+}
+
+// Requests and replies are small and strictly alternate; don't let Nagle
+// hold them back waiting for an ACK.
+static void set_nodelay(int fd) {
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static int open_listen_socket(const string &address) {
+    string error;
+    if (is_tcp_address(address)) {
+        addrinfo *res = resolve_tcp(address, true, error);
+        if (!res) { std::cerr << error << "\n"; return -1; }
+        int fd = -1;
+        for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, 128) == 0) break;
+            error = std::strerror(errno);
+            ::close(fd);
+            fd = -1;
+        }
+        ::freeaddrinfo(res);
+        if (fd < 0) std::cerr << "bind/listen " << address << ": " << error << "\n";
+        return fd;
+    }
+    sockaddr_un addr;
+    if (!unix_address(address, addr, error)) { std::cerr << error << "\n"; return -1; }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { std::cerr << "socket: " << std::strerror(errno) << "\n"; return -1; }
+    ::unlink(address.c_str()); // stale socket from a previous run
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, 128) < 0) {
+        std::cerr << "bind/listen " << address << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void remove_listen_socket(const string &address) {
+    if (!is_tcp_address(address)) ::unlink(address.c_str());
+}
+
+int connect_to_server(const string &address, string &error) {
+    if (is_tcp_address(address)) {
+        addrinfo *res = resolve_tcp(address, false, error);
+        if (!res) return -1;
+        int fd = -1;
+        for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+            error = address + ": " + std::strerror(errno);
+            ::close(fd);
+            fd = -1;
+        }
+        ::freeaddrinfo(res);
+        if (fd >= 0) set_nodelay(fd);
+        return fd;
+    }
+    sockaddr_un addr;
+    if (!unix_address(address, addr, error)) return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { error = std::strerror(errno); return -1; }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        error = address + ": " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// -------------------- Sessions --------------------
+
+static bool write_all(int fd, const char *data, size_t n) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+// A socket reply: header line and body in one writev, without joining them.
+static bool write_framed(int fd, const string &head, const string &body) {
+    iovec iov[2];
+    iov[0].iov_base = const_cast<char *>(head.data());
+    iov[0].iov_len = head.size();
+    iov[1].iov_base = const_cast<char *>(body.data());
+    iov[1].iov_len = body.size();
+    iovec *v = iov;
+    int cnt = body.empty() ? 1 : 2;
+    while (cnt > 0) {
+        ssize_t w = ::writev(fd, v, cnt);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        size_t done = static_cast<size_t>(w);
+        while (cnt > 0 && done >= v->iov_len) { done -= v->iov_len; ++v; --cnt; }
+        if (cnt > 0) {
+            v->iov_base = static_cast<char *>(v->iov_base) + done;
+            v->iov_len -= done;
+        }
+    }
+    return true;
+}
+
+// Buffered line reader over a socket that gives up after an idle period and
+// notices a server stop while waiting.
+class LineReader {
+    int fd_;
+    string buf_;
+public:
+    enum Status { LINE, CLOSED, IDLE, STOPPED };
+
+    explicit LineReader(int fd) : fd_(fd) {}
+
+    Status next(string &line, unsigned idle_timeout_ms) {
+        using clock = std::chrono::steady_clock;
+        const clock::time_point deadline = clock::now() + std::chrono::milliseconds(idle_timeout_ms);
+        while (true) {
+            size_t nl = buf_.find('\n');
+            if (nl != string::npos) {
+                line.assign(buf_, 0, nl);
+                buf_.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return LINE;
+            }
+            if (g_stop) return STOPPED;
+            // wake at least every 200 ms to notice a stop
+            long long wait_ms = 200;
+            if (idle_timeout_ms) {
+                long long left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+                if (left <= 0) return IDLE;
+                wait_ms = std::min(wait_ms, left);
+            }
+            pollfd pfd;
+            pfd.fd = fd_;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int pr = ::poll(&pfd, 1, static_cast<int>(wait_ms));
+            if (pr == 0 || (pr < 0 && errno == EINTR)) continue;
+            if (pr < 0) return CLOSED;
+            char chunk[4096];
+            ssize_t r = ::read(fd_, chunk, sizeof(chunk));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return CLOSED;
+            buf_.append(chunk, static_cast<size_t>(r));
+        }
+    }
+};
+
+// True once the client has closed the connection completely.
+static bool peer_gone(int fd) {
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR));
+}
+
+// Answer every request on one admitted connection until the peer closes it,
+// it goes idle or the server stops.
+static void serve_connection(ServerState &srv, int fd, WorkerMetrics &metrics) {
+    using clock = std::chrono::steady_clock;
+    const ServerOptions &sopts = srv.opts;
+    // the session's tenant, pinned (not evictable) while the session holds it
+    std::shared_ptr<Generator> tenant;
+    LineReader reader(fd);
+    string line;
+    GenerateOptions opts;
+    opts.offer_definitions = false; // the server never writes the database
+
+    // Every follow-up question is a cancellation point: returning nullopt
+    // unwinds the handlers exactly like end of input (EOFExit) does.
+    const char *cancelled = nullptr;
+    clock::time_point deadline;
+    const std::function<bool()> should_cancel = [&] {
+        if (g_stop) cancelled = "server shutting down";
+        else if (sopts.request_timeout_ms && clock::now() > deadline) cancelled = "request timed out";
+        else if (peer_gone(fd)) cancelled = "client disconnected";
+        return cancelled != nullptr;
+    };
+    const AnswerProvider answers = [&](const Prompt &q) -> std::optional<string> {
+        if (should_cancel()) return std::nullopt;
+        return string(q.body_line ? "QED" : "");
+    };
+
+    // Replies go over the socket, or into the session's ring after "@shm".
+    std::unique_ptr<ShmReplyWriter> shm;
+    const auto send_reply = [&](bool ok, const string &body) {
+        if (shm) {
+            const clock::time_point since = clock::now();
+            const auto give_up = [&] {
+                return g_stop || peer_gone(fd) ||
+                       (sopts.idle_timeout_ms && clock::now() - since > std::chrono::milliseconds(sopts.idle_timeout_ms));
+            };
+            return shm->write(ok, body, give_up);
+        }
+        if (ok) return write_framed(fd, "OK " + std::to_string(body.size()) + "\n", body);
+        return write_framed(fd, "ERR " + body + "\n", string());
+    };
+
+    while (true) {
+        LineReader::Status st = reader.next(line, sopts.idle_timeout_ms);
+        if (st == LineReader::IDLE) {
+            metrics.sessions_idle_closed.fetch_add(1, std::memory_order_relaxed);
+            send_reply(false, "idle timeout");
+            break;
+        }
+        if (st != LineReader::LINE) break;
+        if (trim(line).empty()) continue;
+        if (line == "@shm" || line.rfind("@shm ", 0) == 0) {
+            string error;
+            size_t capacity = SHM_DEFAULT_RING;
+            try {
+                if (line.size() > 5) capacity = std::stoul(line.substr(5));
+            } catch (const std::exception &) {
+                error = "expected @shm [ring bytes]";
+            }
+            if (error.empty() && shm) error = "this session already replies through shared memory";
+            if (error.empty() && is_tcp_address(sopts.socket_path)) error = "shared memory needs the Unix socket";
+            if (error.empty()) {
+                std::unique_ptr<ShmReplyWriter> ring(new ShmReplyWriter);
+                if (ring->open(fd, capacity, "OK 0\n", error)) {
+                    shm = std::move(ring);
+                    metrics.shm_sessions.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+            if (!send_reply(false, error)) break;
+            continue;
+        }
+        if (line.rfind("@tenant ", 0) == 0) {
+            bool ok = true;
+            string error;
+            if (!srv.tenants) {
+                ok = false;
+                error = "this server has no tenants";
+            } else {
+                std::shared_ptr<Generator> next;
+                try {
+                    next = srv.tenants->acquire(trim(line.substr(8)), error);
+                } catch (const std::exception &ex) {
+                    error = ex.what();
+                }
+                if (next) tenant = std::move(next);
+                else ok = false;
+                const TenantPool::Stats ts = srv.tenants->stats();
+                metrics.tenants_loaded.store(ts.loaded, std::memory_order_relaxed);
+                metrics.tenant_bytes.store(ts.bytes, std::memory_order_relaxed);
+                metrics.tenant_loads.store(ts.loads, std::memory_order_relaxed);
+                metrics.tenant_hits.store(ts.hits, std::memory_order_relaxed);
+                metrics.tenant_evictions.store(ts.evictions, std::memory_order_relaxed);
+            }
+            if (!send_reply(ok, error)) break;
+            continue;
+        }
+        Generator &gen = tenant ? *tenant : srv.gen;
+        const clock::time_point received = clock::now();
+        // tenants read the server's database too, as their system keywords
+        std::shared_lock<DbLock> db_guard(srv.db_lock, std::defer_lock);
+        if (srv.journal) db_guard.lock();
+        deadline = received + std::chrono::milliseconds(sopts.request_timeout_ms);
+        cancelled = nullptr;
+        bool ok = false;
+        string body; // the program, or the error message
+        try {
+            if (line.rfind("@jsonl ", 0) == 0) {
+                // a --jsonl request; the reply body is its response line
+                GenerateResult res;
+                body = handle_jsonl_request(gen, line.substr(7), should_cancel, &res) + "\n";
+                metrics.record(res);
+                ok = !cancelled;
+            } else {
+                GenerateResult res = gen.generate(line, answers, opts);
+                metrics.record(res);
+                ok = res.ok;
+                body = res.ok ? std::move(res.program) : std::move(res.error);
+            }
+            if (cancelled) body = string("cancelled: ") + cancelled;
+        } catch (const std::exception &ex) {
+            metrics.requests_failed.fetch_add(1, std::memory_order_relaxed);
+            ok = false;
+            body = ex.what();
+        }
+        if (db_guard.owns_lock()) db_guard.unlock(); // a slow client must not hold up the follower
+        if (cancelled) metrics.requests_cancelled.fetch_add(1, std::memory_order_relaxed);
+        const clock::time_point write_start = clock::now();
+        bool sent = send_reply(ok, body);
+        const clock::time_point done = clock::now();
+        metrics.stages[STAGE_WRITE].observe(done - write_start);
+        metrics.stages[STAGE_REQUEST].observe(done - received);
+        metrics.sample_allocator();
+        if (!sent || cancelled) break;
+    }
+}
+
+// Session threads still running in this process.
+struct SessionThreads {
+    std::mutex mu;
+    std::condition_variable idle;
+    size_t running = 0;
+};
+
+static void run_session(ServerState &srv, int fd, WorkerMetrics &metrics, SessionThreads &threads) {
+    const ServerOptions &opts = srv.opts;
+    Admission &adm = srv.adm;
+    if (opts.idle_timeout_ms) {
+        // a client that stops reading must not pin the session on write()
+        timeval tv;
+        tv.tv_sec = static_cast<time_t>(opts.idle_timeout_ms / 1000);
+        tv.tv_usec = static_cast<suseconds_t>((opts.idle_timeout_ms % 1000) * 1000);
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    if (admit(adm, opts, metrics)) {
+        metrics.active_connections.fetch_add(1, std::memory_order_relaxed);
+        serve_connection(srv, fd, metrics);
+        metrics.active_connections.fetch_sub(1, std::memory_order_relaxed);
+        release_admission(adm, metrics);
+    } else {
+        metrics.sessions_rejected.fetch_add(1, std::memory_order_relaxed);
+        const string msg = "ERR server busy\n";
+        write_all(fd, msg.data(), msg.size());
+    }
+    ::close(fd);
+    std::lock_guard<std::mutex> lk(threads.mu);
+    if (--threads.running == 0) threads.idle.notify_all();
+}
+
+// Accept connections until stopped, one thread per session; then let the
+// sessions wind down (each notices the stop within 200 ms).
+static void accept_loop(ServerState &srv, WorkerMetrics &metrics) {
+    SessionThreads threads;
+    // session threads never take the stop signals, so they interrupt accept()
+    sigset_t block, prev;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    std::thread follower;
+    if (srv.journal) {
+        pthread_sigmask(SIG_BLOCK, &block, &prev);
+        follower = std::thread([&] {
+            while (!g_stop) {
+                follow_journal(srv, &metrics);
+                std::this_thread::sleep_for(std::chrono::milliseconds(srv.opts.replica_poll_ms));
+            }
+        });
+        pthread_sigmask(SIG_SETMASK, &prev, nullptr);
+    }
+    while (!g_stop) {
+        int fd = ::accept(srv.listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept: " << std::strerror(errno) << "\n";
+            break;
+        }
+        metrics.connections.fetch_add(1, std::memory_order_relaxed);
+        if (is_tcp_address(srv.opts.socket_path)) set_nodelay(fd);
+        {
+            std::lock_guard<std::mutex> lk(threads.mu);
+            ++threads.running;
+        }
+        pthread_sigmask(SIG_BLOCK, &block, &prev);
+        try {
+            std::thread(run_session, std::ref(srv), fd, std::ref(metrics), std::ref(threads)).detach();
+        } catch (const std::system_error &) {
+            std::lock_guard<std::mutex> lk(threads.mu);
+            --threads.running;
+            ::close(fd);
+        }
+        pthread_sigmask(SIG_SETMASK, &prev, nullptr);
+    }
+    std::unique_lock<std::mutex> lk(threads.mu);
+    threads.idle.wait(lk, [&] { return threads.running == 0; });
+    lk.unlock();
+    g_stop = 1; // stops the follower also when accept() failed without a signal
+    if (follower.joinable()) follower.join();
+}
+
+// -------------------- Metrics endpoint --------------------
+
+static int open_metrics_socket(unsigned short port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { std::cerr << "socket: " << std::strerror(errno) << "\n"; return -1; }
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // never exposed beyond this host
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, 16) < 0) {
+        std::cerr << "bind/listen 127.0.0.1:" << port << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Accept one scrape and answer it; HTTP/1.0 style, one request per connection.
+static void answer_metrics_request(ServerState &st) {
+    int fd = ::accept(st.metrics_fd, nullptr, nullptr);
+    if (fd < 0) return;
+    timeval tv{2, 0}; // a stalled scraper must not hold up the caller
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    string request;
+    char chunk[1024];
+    while (request.find("\r\n\r\n") == string::npos && request.find("\n\n") == string::npos && request.size() < 8192) {
+        ssize_t r = ::read(fd, chunk, sizeof(chunk));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        request.append(chunk, static_cast<size_t>(r));
+    }
+    string status = "200 OK", type = "text/plain; version=0.0.4; charset=utf-8", body;
+    size_t eol = request.find_first_of("\r\n");
+    std::istringstream first(request.substr(0, eol));
+    string method, target;
+    first >> method >> target;
+    if (method != "GET" && method != "HEAD") { status = "405 Method Not Allowed"; type = "text/plain"; body = "GET only\n"; }
+    else if (target != "/metrics") { status = "404 Not Found"; type = "text/plain"; body = "try /metrics\n"; }
+    else {
+        std::shared_lock<DbLock> db_guard(st.db_lock, std::defer_lock);
+        if (st.journal) db_guard.lock();
+        body = st.metrics.render(st.gen.db());
+    }
+    string reply = "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " +
+                   std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    if (method != "HEAD") reply += body;
+    write_all(fd, reply.data(), reply.size());
+    ::close(fd);
+}
+
+// Wait up to `timeout_ms` for a scrape and answer it.
+static void poll_metrics(ServerState &st, int timeout_ms) {
+    pollfd pfd;
+    pfd.fd = st.metrics_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (::poll(&pfd, 1, timeout_ms) > 0) answer_metrics_request(st);
+}
+
+// -------------------- Workers --------------------
+
+// Fork one worker; the child serves until stopped and never returns.
+static pid_t spawn_worker(ServerState &st, unsigned slot) {
+    pid_t pid = ::fork();
+    if (pid != 0) return pid; // parent (or -1 on failure)
+    // child: Ctrl-C goes to the supervisor, which stops us with SIGTERM; the
+    // inherited SIGTERM handler lets the sessions unwind before we exit
+    signal(SIGINT, SIG_IGN);
+    if (st.metrics_fd >= 0) ::close(st.metrics_fd); // scrapes are answered by the supervisor
+    st.metrics.slot(slot).pid.store(::getpid(), std::memory_order_relaxed);
+    accept_loop(st, st.metrics.slot(slot));
+    ::_exit(0);
+}
+
+// Give back what a dead worker held: its session slots and queue places.
+static void reclaim_worker(ServerState &st, unsigned slot) {
+    WorkerMetrics &wm = st.metrics.slot(slot);
+    for (int64_t n = wm.admission_permits.load(); n > 0; --n) ::sem_post(&st.adm.permits);
+    st.adm.queued.fetch_sub(std::max<int64_t>(0, wm.queued_sessions.load()));
+    st.metrics.note_restart(slot);
+}
+
+// Keep `opts.workers` workers alive until asked to stop, then terminate them.
+static int supervise_workers(ServerState &st) {
+    using clock = std::chrono::steady_clock;
+    struct Worker { clock::time_point started; unsigned slot; };
+    std::map<pid_t, Worker> workers;
+    for (unsigned i = 0; i < st.metrics.slots(); ++i) {
+        pid_t pid = spawn_worker(st, i);
+        if (pid < 0) { std::cerr << "fork: " << std::strerror(errno) << "\n"; break; }
+        workers[pid] = Worker{clock::now(), i};
+    }
+    std::cerr << "Serving with " << workers.size() << " pre-forked worker(s).\n";
+
+    while (!g_stop && !workers.empty()) {
+        // with a metrics endpoint or a journal to follow, alternate between
+        // that and reaping; otherwise just wait for a worker to exit
+        const bool periodic = st.metrics_fd >= 0 || st.journal;
+        if (st.metrics_fd >= 0) poll_metrics(st, 250);
+        else if (st.journal) std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        // keep the supervisor's copy current for scrapes and for workers forked later
+        if (st.journal) follow_journal(st, nullptr);
+        int status = 0;
+        pid_t pid = ::waitpid(-1, &status, periodic ? WNOHANG : 0);
+        if (pid == 0) continue;
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        auto it = workers.find(pid);
+        if (it == workers.end()) continue;
+        bool crashed_fast = clock::now() - it->second.started < std::chrono::seconds(1);
+        unsigned slot = it->second.slot;
+        workers.erase(it);
+        if (g_stop) break;
+        if (WIFSIGNALED(status)) std::cerr << "Worker " << pid << " died with signal " << WTERMSIG(status) << "; restarting.\n";
+        else std::cerr << "Worker " << pid << " exited with status " << WEXITSTATUS(status) << "; restarting.\n";
+        reclaim_worker(st, slot);
+        // back off when a worker dies right after starting, to avoid a fork storm
+        if (crashed_fast) std::this_thread::sleep_for(std::chrono::seconds(1));
+        pid_t np = spawn_worker(st, slot);
+        if (np > 0) workers[np] = Worker{clock::now(), slot};
+    }
+
+    for (const auto &w : workers) ::kill(w.first, SIGTERM);
+    for (const auto &w : workers) ::waitpid(w.first, nullptr, 0);
+    return 0;
+}
+
+int run_server(Generator &gen, const ServerOptions &opts) {
+    install_stop_handlers();
+    if (opts.max_sessions == 0) {
+        std::cerr << "max_sessions must be at least 1.\n";
+        return 1;
+    }
+    std::unique_ptr<ServerMetrics> metrics;
+    try {
+        metrics.reset(new ServerMetrics(opts.workers));
+    } catch (const std::exception &ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    Admission *adm = map_admission(opts.max_sessions);
+    if (!adm) { std::cerr << "admission semaphore: " << std::strerror(errno) << "\n"; return 1; }
+    int listen_fd = open_listen_socket(opts.socket_path);
+    if (listen_fd < 0) { unmap_admission(adm); return 1; }
+    int metrics_fd = -1;
+    if (opts.metrics_port) {
+        metrics_fd = open_metrics_socket(opts.metrics_port);
+        if (metrics_fd < 0) { ::close(listen_fd); remove_listen_socket(opts.socket_path); unmap_admission(adm); return 1; }
+        std::cerr << "Metrics on http://127.0.0.1:" << opts.metrics_port << "/metrics\n";
+    }
+    std::cerr << "Listening on " << opts.socket_path << " (" << gen.db().entries.size() << " custom keyword(s) loaded, "
+              << opts.max_sessions << " concurrent session(s), " << opts.max_queue << " queued).\n";
+
+    // with tenants the server's own database becomes the shared system keyword
+    // set; it is not copied (gen outlives the pool)
+    std::unique_ptr<TenantPool> tenants;
+    if (!opts.tenants_dir.empty()) {
+        std::shared_ptr<const UserKeywordDb> system(&gen.db(), [](const UserKeywordDb *) {});
+        // the budget is global: each serving process gets an equal share
+        tenants.reset(new TenantPool(opts.tenants_dir, opts.tenant_memory_budget / std::max(1u, opts.workers), system));
+        std::cerr << "Tenants from " << opts.tenants_dir << "/<name>.db, budget "
+                  << (opts.tenant_memory_budget >> 20) << " MiB.\n";
+    }
+
+    std::unique_ptr<JournalTailer> journal;
+    if (!opts.replica_journal.empty()) {
+        journal.reset(new JournalTailer(opts.replica_journal));
+        std::vector<JournalRecord> records;
+        if (!journal->read_new(records)) std::cerr << "Journal " << opts.replica_journal << " not readable yet; will keep trying.\n";
+        size_t applied = 0;
+        for (const auto &rec : records) applied += apply_journal_record(gen.db(), rec);
+        std::cerr << "Replica of " << opts.replica_journal << ": caught up to version " << gen.db().version
+                  << " (" << applied << " record(s) applied at start).\n";
+    }
+    DbLock db_lock;
+    ServerState st{gen, opts, listen_fd, metrics_fd, *metrics, *adm, tenants.get(), journal.get(), db_lock};
+    int rc = 0;
+    if (opts.workers == 0) {
+        metrics->slot(0).pid.store(::getpid(), std::memory_order_relaxed);
+        // single process: scrapes get their own thread, with the stop signals
+        // blocked there so they keep interrupting accept() in this one
+        std::thread scraper;
+        if (metrics_fd >= 0) {
+            sigset_t block, prev;
+            sigemptyset(&block);
+            sigaddset(&block, SIGINT);
+            sigaddset(&block, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &block, &prev);
+            scraper = std::thread([&] { while (!g_stop) poll_metrics(st, 250); });
+            pthread_sigmask(SIG_SETMASK, &prev, nullptr);
+        }
+        accept_loop(st, metrics->slot(0));
+        g_stop = 1;
+        if (scraper.joinable()) scraper.join();
+    } else {
+        rc = supervise_workers(st);
+    }
+
+    if (metrics_fd >= 0) ::close(metrics_fd);
+    ::close(listen_fd);
+    remove_listen_socket(opts.socket_path);
+    unmap_admission(adm);
+    return rc;
+}
+
+#endif // _WIN32
+
+} // namespace snippetgen
@@ -0,0 +1,80 @@
+/*
+Server mode for the snippet generator: answers keyword lines over a Unix domain
+socket (or a TCP address "tcp:<host>:<port>") from a keyword database loaded once.
+
+Protocol (one request per line, any number per connection):
+  request:  <keyword line>\n             follow-ups take their defaults
+            @tenant <name>\n             (with tenants_dir) use that tenant's keywords
+            @jsonl <request>\n           a --jsonl request object; the program bytes are
+                                         its response line (newline included)
+            @shm [ring bytes]\n          (Unix socket, Linux) answered "OK 0" with a memfd ring
+                                         and two eventfds; later replies go into the ring
+                                         (see snippet_shm.h)
+  response: OK <nbytes>\n<program bytes>
+            ERR <message>\n
+A cancelled request ("ERR cancelled: ...") ends its session; "ERR server busy" and
+"ERR idle timeout" are sent just before the server closes the connection.
+
+With a metrics port the server also answers GET /metrics on 127.0.0.1:<port> in
+the Prometheus text format.
+*/
+
+#ifndef SNIPPET_SERVER_H
+#define SNIPPET_SERVER_H
+
+#include "snippetgen.h"
+
+#include <cstddef>
+#include <string>
+
+namespace snippetgen {
+
+struct ServerOptions {
+    // A Unix socket path, or "tcp:<host>:<port>". TCP has no authentication:
+    // bind it to localhost or a trusted network only.
+    std::string socket_path = "snippet_gen.sock";
+    // 0 serves from this process. N > 0 pre-forks N workers after the database
+    // is loaded; they share its pages copy-on-write and the parent restarts any
+    // worker that dies.
+    unsigned workers = 0;
+    // > 0: serve GET /metrics on 127.0.0.1:metrics_port.
+    unsigned short metrics_port = 0;
+
+    // Admission control, global across workers. At most max_sessions
+    // connections are served at once; up to max_queue more wait for a slot
+    // for at most queue_timeout_ms, and anything beyond gets "ERR server busy".
+    unsigned max_sessions = 64;
+    unsigned max_queue = 64;
+    unsigned queue_timeout_ms = 5000;
+    // A session with no request for idle_timeout_ms is sent "ERR idle timeout"
+    // and closed (0 = never).
+    unsigned idle_timeout_ms = 30000;
+    // A request still generating after request_timeout_ms is cancelled at its
+    // next follow-up question and answered "ERR cancelled: ..." (0 = never).
+    // Server shutdown and client disconnects cancel the same way.
+    unsigned request_timeout_ms = 10000;
+
+    // Multi-tenant mode: a session line "@tenant <name>" switches the session to
+    // <tenants_dir>/<name>.db (loaded on first use, answered "OK 0"). The
+    // server's own database is shared read-only by every tenant as the system
+    // keywords. Idle tenants are evicted LRU to stay under the memory budget.
+    std::string tenants_dir;
+    size_t tenant_memory_budget = 256u << 20;
+
+    // Read replica: follow the writer's journal (see keyword_journal_path) and
+    // apply its committed changes to the loaded database every poll, without
+    // reloading. Empty = serve the database as loaded.
+    std::string replica_journal;
+    unsigned replica_poll_ms = 200;
+};
+
+// Serve until SIGINT/SIGTERM. Returns the process exit code.
+int run_server(Generator &gen, const ServerOptions &opts);
+
+// Connect to a server address (as in ServerOptions::socket_path). Returns the
+// connected descriptor, or -1 with `error` set.
+int connect_to_server(const std::string &address, std::string &error);
+
+} // namespace snippetgen
+
+#endif // SNIPPET_SERVER_H
@@ -0,0 +1,324 @@
+/*
+Shared-memory reply transport implementation. See snippet_shm.h.
+*/
+
+#include "snippet_shm.h"
+#include "snippet_server.h"
+
+#if defined(__linux__)
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace snippetgen {
+
+#if !defined(__linux__)
+
+ShmReplyWriter::~ShmReplyWriter() {}
+
+bool ShmReplyWriter::open(int, size_t, const std::string &, std::string &error) {
+    error = "shared memory transport needs Linux";
+    return false;
+}
+
+bool ShmReplyWriter::write(bool, std::string_view, const std::function<bool()> &) { return false; }
+
+ShmClient::~ShmClient() {}
+
+bool ShmClient::connect(const std::string &, size_t, std::string &error) {
+    error = "shared memory transport needs Linux";
+    return false;
+}
+
+bool ShmClient::request(const std::string &, bool &, std::string_view &, std::string &error) {
+    error = "shared memory transport needs Linux";
+    return false;
+}
+
+void ShmClient::release() {}
+
+#else
+
+using std::string;
+
+static const uint64_t SHM_MAGIC = 0x31304d4853475321ull; // "!SGSHM01"
+static const size_t HEADER_PAGE = 4096;
+
+enum RecordKind : uint32_t { REC_OK = 0, REC_ERR = 1, REC_PAD = 2 };
+
+struct RecordHeader {
+    uint32_t length;
+    uint32_t kind;
+};
+
+// Lives in the first page of the memfd; head and tail on separate cache lines.
+struct ShmRingHeader {
+    uint64_t magic;
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> head;          // bytes written by the server
+    alignas(64) std::atomic<uint64_t> tail;          // bytes released by the client
+    std::atomic<uint32_t> writer_waiting;            // server blocked on ring space
+};
+static_assert(sizeof(ShmRingHeader) <= HEADER_PAGE, "ring header must fit its page");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters are shared between processes");
+
+static size_t record_size(size_t length) { return sizeof(RecordHeader) + ((length + 7) & ~size_t(7)); }
+
+// Free ring bytes for the server's `head` and the client's `tail`; false if
+// the tail is outside [head - capacity, head], which no client in step with
+// the server can produce.
+static bool ring_space(uint64_t head, uint64_t tail, uint64_t capacity, uint64_t &space) {
+    if (tail > head || head - tail > capacity) return false;
+    space = capacity - (head - tail);
+    return true;
+}
+
+static void close_fd(int &fd) {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+static void signal_efd(int efd) {
+    const uint64_t one = 1;
+    while (::write(efd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+static void drain_efd(int efd) {
+    uint64_t v;
+    while (::read(efd, &v, sizeof(v)) < 0 && errno == EINTR) {}
+}
+
+// -------------------- Server side --------------------
+
+ShmReplyWriter::~ShmReplyWriter() {
+    if (hdr_) ::munmap(hdr_, map_size_);
+    close_fd(memfd_);
+    close_fd(reply_efd_);
+    close_fd(space_efd_);
+}
+
+bool ShmReplyWriter::open(int sock, size_t capacity, const string &reply, string &error) {
+    capacity = std::min(std::max(capacity, SHM_MIN_RING), SHM_MAX_RING) & ~size_t(7);
+    map_size_ = HEADER_PAGE + capacity;
+    memfd_ = ::memfd_create("snippetgen-replies", MFD_CLOEXEC);
+    reply_efd_ = ::eventfd(0, EFD_CLOEXEC);
+    space_efd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (memfd_ < 0 || reply_efd_ < 0 || space_efd_ < 0 || ::ftruncate(memfd_, static_cast<off_t>(map_size_)) < 0) {
+        error = string("shared memory: ") + std::strerror(errno);
+        return false;
+    }
+    void *mem = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, memfd_, 0);
+    if (mem == MAP_FAILED) {
+        error = string("mmap: ") + std::strerror(errno);
+        return false;
+    }
+    hdr_ = new (mem) ShmRingHeader();
+    hdr_->magic = SHM_MAGIC;
+    hdr_->capacity = capacity;
+    capacity_ = capacity;
+    head_ = 0;
+    data_ = static_cast<char *>(mem) + HEADER_PAGE;
+
+    // the reply line and the descriptors travel in one message
+    int fds[3] = {memfd_, reply_efd_, space_efd_};
+    char control[CMSG_SPACE(sizeof(fds))];
+    std::memset(control, 0, sizeof(control));
+    iovec iov;
+    iov.iov_base = const_cast<char *>(reply.data());
+    iov.iov_len = reply.size();
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    ssize_t n;
+    while ((n = ::sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    if (n != static_cast<ssize_t>(reply.size())) {
+        error = string("sendmsg: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool ShmReplyWriter::write(bool ok, std::string_view body, const std::function<bool()> &give_up) {
+    const uint64_t cap = capacity_;
+    // at most half the ring, so a record plus the padding before it always fits
+    string too_large;
+    if (record_size(body.size()) > cap / 2) {
+        too_large = "reply of " + std::to_string(body.size()) + " bytes is over half the " +
+                    std::to_string(cap) + "-byte shared memory ring";
+        body = too_large;
+        ok = false;
+    }
+    const size_t rec = record_size(body.size());
+    const uint64_t head = head_;
+    const uint64_t pos = head % cap;
+    const uint64_t pad = cap - pos < rec ? cap - pos : 0; // skip to the start instead of wrapping
+    const uint64_t need = pad + rec;
+
+    uint64_t space = 0;
+    while (true) {
+        if (!ring_space(head, hdr_->tail.load(std::memory_order_acquire), cap, space)) return false;
+        if (space >= need) break;
+        hdr_->writer_waiting.store(1, std::memory_order_seq_cst);
+        if (!ring_space(head, hdr_->tail.load(std::memory_order_seq_cst), cap, space)) return false;
+        if (space >= need) break; // freed meanwhile
+        pollfd pfd;
+        pfd.fd = space_efd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (::poll(&pfd, 1, 200) > 0) drain_efd(space_efd_);
+        else if (give_up && give_up()) return false;
+    }
+    hdr_->writer_waiting.store(0, std::memory_order_relaxed);
+
+    if (pad) {
+        RecordHeader ph{static_cast<uint32_t>(pad - sizeof(RecordHeader)), REC_PAD};
+        std::memcpy(data_ + pos, &ph, sizeof(ph));
+    }
+    char *at = data_ + (head + pad) % cap;
+    RecordHeader rh{static_cast<uint32_t>(body.size()), ok ? REC_OK : REC_ERR};
+    std::memcpy(at, &rh, sizeof(rh));
+    std::memcpy(at + sizeof(rh), body.data(), body.size());
+    head_ = head + need;
+    hdr_->head.store(head_, std::memory_order_release);
+    signal_efd(reply_efd_);
+    return true;
+}
+
+// -------------------- Client side --------------------
+
+ShmClient::~ShmClient() {
+    if (hdr_) ::munmap(hdr_, map_size_);
+    close_fd(sock_);
+    close_fd(reply_efd_);
+    close_fd(space_efd_);
+}
+
+bool ShmClient::connect(const string &socket_path, size_t capacity, string &error) {
+    sock_ = connect_to_server(socket_path, error);
+    if (sock_ < 0) return false;
+    const string hello = "@shm " + std::to_string(capacity) + "\n";
+    if (::send(sock_, hello.data(), hello.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(hello.size())) {
+        error = string("send: ") + std::strerror(errno);
+        return false;
+    }
+
+    // the reply line ("OK 0" or "ERR ...") and, on success, the descriptors
+    string line;
+    int fds[3] = {-1, -1, -1};
+    while (line.find('\n') == string::npos) {
+        char buf[256];
+        char control[CMSG_SPACE(sizeof(fds))];
+        iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = sizeof(buf);
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = ::recvmsg(sock_, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { error = "server closed the connection"; return false; }
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS && cm->cmsg_len == CMSG_LEN(sizeof(fds)))
+                std::memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+        }
+        line.append(buf, static_cast<size_t>(n));
+    }
+    int memfd = fds[0];
+    reply_efd_ = fds[1];
+    space_efd_ = fds[2];
+    if (line.rfind("OK", 0) != 0 || memfd < 0) {
+        if (memfd >= 0) ::close(memfd);
+        error = line.substr(0, line.find('\n'));
+        return false;
+    }
+    void *mem = ::mmap(nullptr, HEADER_PAGE, PROT_READ, MAP_SHARED, memfd, 0);
+    uint64_t cap = mem == MAP_FAILED ? 0 : static_cast<const ShmRingHeader *>(mem)->capacity;
+    if (mem != MAP_FAILED) ::munmap(mem, HEADER_PAGE);
+    if (cap == 0) { ::close(memfd); error = "cannot map the reply ring"; return false; }
+    map_size_ = HEADER_PAGE + cap;
+    // writable for the tail counter; the data pages are only read
+    mem = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    ::close(memfd);
+    if (mem == MAP_FAILED || static_cast<ShmRingHeader *>(mem)->magic != SHM_MAGIC) {
+        if (mem != MAP_FAILED) ::munmap(mem, map_size_);
+        error = "cannot map the reply ring";
+        return false;
+    }
+    hdr_ = static_cast<ShmRingHeader *>(mem);
+    data_ = static_cast<const char *>(mem) + HEADER_PAGE;
+    return true;
+}
+
+void ShmClient::release() {
+    if (!held_) return;
+    hdr_->tail.fetch_add(held_, std::memory_order_seq_cst);
+    held_ = 0;
+    if (hdr_->writer_waiting.exchange(0, std::memory_order_seq_cst)) signal_efd(space_efd_);
+}
+
+bool ShmClient::request(const string &line, bool &ok, std::string_view &reply, string &error) {
+    release();
+    const string msg = line + "\n";
+    size_t off = 0;
+    while (off < msg.size()) {
+        ssize_t w = ::send(sock_, msg.data() + off, msg.size() - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { error = "connection lost"; return false; }
+        off += static_cast<size_t>(w);
+    }
+    const uint64_t cap = hdr_->capacity;
+    while (true) {
+        const uint64_t tail = hdr_->tail.load(std::memory_order_relaxed);
+        if (hdr_->head.load(std::memory_order_acquire) == tail) {
+            // wait for the server's signal; the socket only becomes readable
+            // when the server closes the session
+            pollfd pfd[2];
+            pfd[0].fd = reply_efd_;
+            pfd[0].events = POLLIN;
+            pfd[1].fd = sock_;
+            pfd[1].events = POLLIN;
+            pfd[0].revents = pfd[1].revents = 0;
+            if (::poll(pfd, 2, -1) < 0 && errno != EINTR) { error = "poll failed"; return false; }
+            if (pfd[0].revents & POLLIN) drain_efd(reply_efd_);
+            else if (pfd[1].revents && hdr_->head.load(std::memory_order_acquire) == tail) {
+                error = "server closed the connection";
+                return false;
+            }
+            continue;
+        }
+        RecordHeader rh;
+        std::memcpy(&rh, data_ + tail % cap, sizeof(rh));
+        if (rh.kind == REC_PAD) {
+            held_ = record_size(rh.length);
+            release();
+            continue;
+        }
+        ok = rh.kind == REC_OK;
+        reply = std::string_view(data_ + tail % cap + sizeof(rh), rh.length);
+        held_ = record_size(rh.length);
+        return true;
+    }
+}
+
+#endif // __linux__
+
+} // namespace snippetgen
@@ -0,0 +1,96 @@
+/*
+Shared-memory reply transport for same-host clients of server mode (Linux).
+
+A client on the Unix socket sends "@shm [ring bytes]". The server answers
+"OK 0\n" and passes three descriptors with it (SCM_RIGHTS): a memfd holding the
+reply ring, an eventfd the server signals after every reply, and an eventfd the
+client signals when it frees ring space the server is waiting for. Requests
+keep going over the socket, but from then on every reply of the session (OK and
+ERR alike) is written once into the ring and the client reads it in place,
+without copying the program through the socket.
+
+Ring layout: a 4 KiB header page, then `capacity` data bytes holding 8-byte
+aligned records {uint32 length, uint32 kind} followed by `length` bytes. A
+record never wraps; a PAD record fills the end of the ring when the next one
+does not fit. A reply larger than half the ring is answered with an ERR
+record instead.
+*/
+
+#ifndef SNIPPET_SHM_H
+#define SNIPPET_SHM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace snippetgen {
+
+const size_t SHM_DEFAULT_RING = 4u << 20;
+const size_t SHM_MIN_RING = 64u << 10;
+const size_t SHM_MAX_RING = 256u << 20;
+
+struct ShmRingHeader;
+
+// Server side of one session's ring.
+class ShmReplyWriter {
+public:
+    ShmReplyWriter() = default;
+    ~ShmReplyWriter();
+    ShmReplyWriter(const ShmReplyWriter &) = delete;
+    ShmReplyWriter &operator=(const ShmReplyWriter &) = delete;
+
+    // Create the ring (capacity clamped to [SHM_MIN_RING, SHM_MAX_RING]) and
+    // send `reply` over the Unix socket `sock` together with the descriptors.
+    bool open(int sock, size_t capacity, const std::string &reply, std::string &error);
+
+    // Write one reply record and notify the client. While the ring is full it
+    // waits for the client, asking `give_up` every 200 ms. Returns false if it
+    // gave up, or if the client's tail counter is impossible (the session is
+    // broken). A reply over half the ring is replaced by an ERR record.
+    bool write(bool ok, std::string_view body, const std::function<bool()> &give_up);
+
+private:
+    int memfd_ = -1;
+    int reply_efd_ = -1; // server -> client: a record was written
+    int space_efd_ = -1; // client -> server: space freed while the server waited
+    ShmRingHeader *hdr_ = nullptr;
+    char *data_ = nullptr;
+    size_t map_size_ = 0;
+    // The client can write the whole header page, so the server never reads
+    // back what only it writes: these are the values of record.
+    uint64_t capacity_ = 0;
+    uint64_t head_ = 0;
+};
+
+// Client side: a session on `socket_path` upgraded to the shared-memory ring.
+class ShmClient {
+public:
+    ShmClient() = default;
+    ~ShmClient();
+    ShmClient(const ShmClient &) = delete;
+    ShmClient &operator=(const ShmClient &) = delete;
+
+    bool connect(const std::string &socket_path, size_t capacity, std::string &error);
+
+    // Send one request line and wait for its reply. `reply` points into the
+    // ring and stays valid until the next request() call. Returns false (with
+    // `error`) if the session broke; `ok` tells an OK reply from an ERR reply.
+    bool request(const std::string &line, bool &ok, std::string_view &reply, std::string &error);
+
+private:
+    void release();
+
+    int sock_ = -1;
+    int reply_efd_ = -1;
+    int space_efd_ = -1;
+    ShmRingHeader *hdr_ = nullptr;
+    const char *data_ = nullptr;
+    size_t map_size_ = 0;
+    uint64_t held_ = 0; // bytes of the record handed out by the last request()
+};
+
+} // namespace snippetgen
+
+#endif // SNIPPET_SHM_H
@@ -0,0 +1,136 @@
+/*
+Tenant pool implementation. See snippet_tenants.h.
+*/
+
+#include "snippet_tenants.h"
+
+#include <fstream>
+#include <utility>
+
+namespace snippetgen {
+
+using std::string;
+
+size_t approx_db_bytes(const UserKeywordDb &db) {
+    // per-node overhead of the hash map and the bucket array, plus string payloads;
+    // every entry also has a node in the sorted index and usually a lexed snippet
+    const size_t node_overhead = sizeof(void*) * 2 + sizeof(string) + sizeof(UserKeyword);
+    const size_t index_node = sizeof(void*) * 4 + sizeof(string);
+    size_t bytes = sizeof(db) + db.entries.bucket_count() * sizeof(void*);
+    for (const auto &kv : db.entries) {
+        bytes += node_overhead + kv.first.capacity() + kv.second.snippet.capacity();
+        for (const auto &pp : kv.second.params)
+            bytes += sizeof(pp) + pp.first.capacity() + pp.second.capacity();
+        bytes += lexed_snippet_bytes(kv.second.lexed.get());
+    }
+    for (const auto &name : db.index) bytes += index_node + name.capacity();
+    for (const auto &kv : db.deleted) bytes += sizeof(void*) * 4 + sizeof(kv) + kv.first.capacity();
+    return bytes;
+}
+
+TenantPool::TenantPool(string dir, size_t budget_bytes, std::shared_ptr<const UserKeywordDb> system)
+    : dir_(std::move(dir)), budget_(budget_bytes), system_(std::move(system)) {}
+
+bool TenantPool::valid_name(const string &name) {
+    if (name.empty() || name.size() > 128 || name[0] == '.') return false;
+    for (char c : name) {
+        if (!ascii::is_alnum(c) && c != '_' && c != '-' && c != '.') return false;
+    }
+    return true;
+}
+
+std::shared_ptr<Generator> TenantPool::acquire(const string &name, string &error) {
+    if (!valid_name(name)) {
+        error = "invalid tenant name '" + name + "'";
+        return nullptr;
+    }
+    const string path = dir_ + "/" + name + ".db";
+    std::promise<std::shared_ptr<Generator>> promise;
+    std::unique_lock<std::mutex> lk(mu_);
+    auto it = tenants_.find(name);
+    if (it != tenants_.end()) {
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        std::shared_future<std::shared_ptr<Generator>> f = it->second.gen;
+        lk.unlock(); // another session may still be loading it
+        return pin(f.get());
+    }
+    if (!std::ifstream(path)) {
+        error = "unknown tenant '" + name + "'";
+        return nullptr;
+    }
+    ++stats_.loads;
+    lru_.push_front(name);
+    Entry e;
+    e.gen = promise.get_future().share();
+    e.lru = lru_.begin();
+    tenants_.emplace(name, std::move(e));
+    lk.unlock();
+
+    // load outside the lock so other tenants are not held up
+    std::shared_ptr<Generator> gen;
+    try {
+        gen = std::make_shared<Generator>(path);
+        gen->load(false);
+        gen->set_shared(system_);
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        lk.lock();
+        auto failed = tenants_.find(name);
+        lru_.erase(failed->second.lru);
+        tenants_.erase(failed);
+        throw;
+    }
+    const size_t bytes = approx_db_bytes(gen->db());
+    promise.set_value(gen);
+
+    lk.lock();
+    auto loaded = tenants_.find(name);
+    loaded->second.bytes = bytes;
+    stats_.bytes += bytes;
+    ++stats_.loaded;
+    evict_locked();
+    return pin(std::move(gen));
+}
+
+// The pool's references to a loaded tenant are its future and one per pin;
+// the tenant becomes evictable once every pin is gone.
+std::shared_ptr<Generator> TenantPool::pin(std::shared_ptr<Generator> gen) {
+    Generator *raw = gen.get();
+    return std::shared_ptr<Generator>(raw, [this, held = std::move(gen)](Generator *) mutable {
+        held.reset();
+        release();
+    });
+}
+
+// A session dropped a tenant: it may be the one keeping the pool over budget.
+void TenantPool::release() {
+    std::lock_guard<std::mutex> lk(mu_);
+    evict_locked();
+}
+
+// Drop least-recently-used tenants nobody holds until the budget is met.
+// Loading tenants (future not ready) and pinned ones are skipped.
+void TenantPool::evict_locked() {
+    auto it = lru_.end();
+    while (stats_.bytes > budget_ && it != lru_.begin()) {
+        --it;
+        auto t = tenants_.find(*it);
+        const auto &f = t->second.gen;
+        if (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+        // the pool's own future holds one reference
+        if (f.get().use_count() > 1) continue;
+        stats_.bytes -= t->second.bytes;
+        --stats_.loaded;
+        ++stats_.evictions;
+        tenants_.erase(t);
+        it = lru_.erase(it);
+    }
+}
+
+TenantPool::Stats TenantPool::stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+} // namespace snippetgen
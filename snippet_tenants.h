@@ -0,0 +1,77 @@
+/*
+Tenant pool for server mode: one keyword database per tenant, loaded on the
+tenant's first request and evicted least-recently-used when the loaded
+databases exceed a memory budget. Every tenant Generator shares one read-only
+system keyword set (the server's own database plus any system packs), so the
+system keywords are in memory once no matter how many tenants are loaded.
+
+Tenant "alice" lives in <dir>/alice.db; names are limited to letters, digits,
+'_', '-' and '.', and may not start with '.'.
+*/
+
+#ifndef SNIPPET_TENANTS_H
+#define SNIPPET_TENANTS_H
+
+#include "snippetgen.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace snippetgen {
+
+// Rough heap footprint of a loaded database (strings, nodes and buckets).
+size_t approx_db_bytes(const UserKeywordDb &db);
+
+class TenantPool {
+public:
+    struct Stats {
+        size_t loaded = 0;     // tenants in memory
+        size_t bytes = 0;      // their approx_db_bytes total
+        uint64_t loads = 0;    // first requests that read a database
+        uint64_t hits = 0;     // requests served by an already loaded tenant
+        uint64_t evictions = 0;
+    };
+
+    TenantPool(std::string dir, size_t budget_bytes, std::shared_ptr<const UserKeywordDb> system);
+
+    // The tenant's Generator, loading it if needed. Holding the returned
+    // pointer pins the tenant: only tenants nobody holds are evicted, and
+    // dropping the last one re-runs eviction. The pool must outlive the
+    // pointers it returns. Returns nullptr with `error` set for an invalid
+    // name or a missing database.
+    std::shared_ptr<Generator> acquire(const std::string &name, std::string &error);
+
+    Stats stats() const;
+
+    static bool valid_name(const std::string &name);
+
+private:
+    struct Entry {
+        std::shared_future<std::shared_ptr<Generator>> gen; // ready once loaded
+        size_t bytes = 0;
+        std::list<std::string>::iterator lru;               // position in lru_
+    };
+
+    void evict_locked();
+    // What acquire() hands out: `gen` with a deleter that calls release().
+    std::shared_ptr<Generator> pin(std::shared_ptr<Generator> gen);
+    void release();
+
+    std::string dir_;
+    size_t budget_;
+    std::shared_ptr<const UserKeywordDb> system_;
+    mutable std::mutex mu_;
+    std::unordered_map<std::string, Entry> tenants_;
+    std::list<std::string> lru_; // most recently used first
+    Stats stats_;
+};
+
+} // namespace snippetgen
+
+#endif // SNIPPET_TENANTS_H
@@ -0,0 +1,34 @@
+/*
+Helpers shared by the measuring programs. See snippet_tools.h.
+*/
+
+#include "snippet_tools.h"
+#include "snippetgen.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace snippetgen {
+
+using std::string;
+using std::vector;
+
+bool read_session(const string &path, vector<string> &lines) {
+    std::ifstream ifs(path);
+    if (!ifs) return false;
+    string line;
+    while (std::getline(ifs, line)) {
+        string t = trim(line);
+        if (t.empty() || t[0] == ':' || t == "exit") continue;
+        lines.push_back(t);
+    }
+    return true;
+}
+
+double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+} // namespace snippetgen
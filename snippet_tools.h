@@ -0,0 +1,25 @@
+/*
+Helpers shared by the measuring programs, snippet_bench (in process) and
+snippet_load (against a server): the recorded-session format they replay and
+the percentiles they report.
+*/
+
+#ifndef SNIPPET_TOOLS_H
+#define SNIPPET_TOOLS_H
+
+#include <string>
+#include <vector>
+
+namespace snippetgen {
+
+// Append the lines a user typed at the interactive prompt to `lines`, in
+// order; blank lines, ':' commands and 'exit' are skipped. Returns false if
+// the file cannot be read.
+bool read_session(const std::string &path, std::vector<std::string> &lines);
+
+// The p-th percentile (0..100) of ascending `sorted`, nearest rank; 0 if empty.
+double percentile(const std::vector<double> &sorted, double p);
+
+} // namespace snippetgen
+
+#endif // SNIPPET_TOOLS_H
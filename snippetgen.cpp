@@ -0,0 +1,4423 @@
+/*
+snippetgen library implementation: prompting, keyword persistence, the built-in
+keyword handlers, nested expansion and program assembly. See snippetgen.h.
+*/
+
+#include "snippetgen.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <unordered_set>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace snippetgen {
+
+using std::endl;
+using std::string;
+using std::getline;
+using std::optional;
+using std::nullopt;
+using std::ostringstream;
+using std::vector;
+using std::map;
+using std::set;
+using std::unordered_set;
+
+// -------------------- Session I/O --------------------
+
+// The answer provider and progress stream of the generate() call running on this
+// thread. Outside generate() prompts fall back to stdio, as in the interactive CLI.
+struct SessionIO {
+    const AnswerProvider *answers;
+    std::ostream *out;
+};
+static thread_local SessionIO *t_session = nullptr;
+
+static std::ostream &session_out() {
+    return t_session ? *t_session->out : std::cout;
+}
+
+static optional<string> next_answer(const Prompt &q) {
+    if (t_session) return (*t_session->answers)(q);
+    static const AnswerProvider stdio = stdio_answers();
+    return stdio(q);
+}
+
+AnswerProvider stdio_answers() {
+    return [](const Prompt &q) -> optional<string> {
+        if (q.body_line) std::cout << "> ";
+        else std::cout << q.question << " [" << q.default_value << "]: ";
+        std::cout.flush();
+        string line;
+        if (!getline(std::cin, line)) return nullopt;
+        return line;
+    };
+}
+
+AnswerProvider default_answers() {
+    return [](const Prompt &q) -> optional<string> {
+        return string(q.body_line ? "QED" : "");
+    };
+}
+
+// -------------------- Small helpers (required names) --------------------
+
+static optional<string> prompt_opt(const string &prompt, const string &def) {
+    auto line = next_answer(Prompt{prompt, def, false});
+    if (!line) throw EOFExit();
+    if (line->empty()) return nullopt;
+    return line;
+}
+
+string ask(const string &prompt, const string &def) {
+    auto res = prompt_opt(prompt, def);
+    if (!res.has_value()) return def;
+    return *res;
+}
+
+std::string_view trim_view(std::string_view s) {
+    return trim_trailing_view(trim_leading_view(s));
+}
+
+std::string_view trim_leading_view(std::string_view s) {
+    size_t b = 0;
+    while (b < s.size() && ascii::is_space(s[b])) ++b;
+    return s.substr(b);
+}
+
+std::string_view trim_trailing_view(std::string_view s) {
+    size_t e = s.size();
+    while (e > 0 && ascii::is_space(s[e - 1])) --e;
+    return s.substr(0, e);
+}
+
+std::string_view strip_punct_view(std::string_view s) {
+    size_t i = 0, j = s.size();
+    while (i < j && ascii::is_punct(s[i])) ++i;
+    while (j > i && ascii::is_punct(s[j - 1])) --j;
+    return s.substr(i, j - i);
+}
+
+void lowercase_inplace(string &s) {
+    for (char &c : s) c = ascii::to_lower(c);
+}
+
+string trim(std::string_view s) {
+    return string(trim_view(s));
+}
+
+uint64_t fnv1a64(std::string_view data, uint64_t h) {
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+string normalize_token(std::string_view token) {
+    string t(strip_punct_view(token));
+    lowercase_inplace(t);
+    return t;
+}
+
+vector<string> split_csv(const string &s) {
+    vector<string> out;
+    std::istringstream iss(s);
+    string item;
+    while (std::getline(iss, item, ',')) out.push_back(trim(item));
+    return out;
+}
+
+// Normalize an include string into a "printable key" that retains angle/quote
+// semantics for printing and allows deduplication.
+// Input forms we accept here:
+//   - "<vector>"  (already bracketed)
+//   - "\"my.h\""  (already quoted)
+//   - "vector"    (plain token like earlier code used)
+// The returned key will be: "<vector>", "\"my.h\"" or "<vector>" for plain "vector".
+static string normalize_include_for_key(const string &raw) {
+    string s = trim(raw);
+    if (s.empty()) return s;
+    if (s.front() == '<' && s.back() == '>') return s;            // already <...>
+    if (s.front() == '"' && s.back() == '"') return s;            // already "..."
+    // otherwise assume a plain header name -> print with angle brackets
+    return string("<") + s + string(">");
+}
+
+// `top_lines`, if given, receives the first line number of each extra_top entry
+// and then the line after the last one.
+static string make_program_from_body_lines(const vector<string> &body_lines,
+                                          const vector<string> &extra_includes = {},
+                                          const vector<string> &extra_top = {},
+                                          vector<int> *top_lines = nullptr) {
+    std::ostringstream out;
+    // Always print iostream first
+    out << "#include <iostream>\n";
+
+    // build set of unique include keys (like "<vector>" or "\"my.h\"")
+    std::set<string> uniq;
+    for (const auto &h : extra_includes) {
+        string key = normalize_include_for_key(h);
+        if (key.empty()) continue;
+        if (key == "<iostream>") continue; // iostream already emitted
+        uniq.insert(key);
+    }
+    for (const auto &h : uniq) {
+        out << "#include " << h << "\n";
+    }
+    out << "\n";
+
+    int line = 3 + static_cast<int>(uniq.size()); // first line after the includes
+    for (auto &t : extra_top) {
+        if (top_lines) top_lines->push_back(line);
+        line += 1 + static_cast<int>(std::count(t.begin(), t.end(), '\n'));
+        out << t << "\n";
+    }
+    if (top_lines) top_lines->push_back(line);
+    out << "\nusing namespace std;\n\n";
+    out << "int main(int argc, char *argv[]) {\n";
+    for (auto &line : body_lines) out << "    " << line << "\n";
+    out << "    return 0;\n";
+    out << "}\n";
+    return out.str();
+}
+
+// read_multiline_body implementation: reads lines until a single 'QED' line.
+// Returns collected lines (excluding the 'QED') and throws EOFExit on EOF.
+std::vector<std::string> read_multiline_body(const std::string &instruction) {
+    session_out() << instruction << std::endl;
+    std::vector<std::string> lines;
+    lines.reserve(16);
+    while (true) {
+        auto line = next_answer(Prompt{instruction, "QED", true});
+        if (!line) throw EOFExit();
+        if (*line == "QED") break;
+        lines.push_back(std::move(*line));
+    }
+    return lines;
+}
+
+// -------------------- C++17 keyword set (function-local static) --------------------
+
+const unordered_set<string>& cpp17_keywords() {
+    static const unordered_set<string> kws = [](){
+        const char* arr[] = {
+            "alignas","alignof","and","and_eq","asm","auto","bitand","bitor","bool","break",
+            "case","catch","char","char16_t","char32_t","class","compl","const","constexpr","const_cast",
+            "continue","decltype","default","delete","do","double","dynamic_cast","else","enum","explicit",
+            "export","extern","false","float","for","friend","goto","if","inline","int",
+            "long","mutable","namespace","new","noexcept","not","not_eq","nullptr","operator","or",
+            "or_eq","private","protected","public","register","reinterpret_cast","return","short","signed","sizeof",
+            "static","static_assert","static_cast","struct","switch","template","this","thread_local","throw","true",
+            "try","typedef","typeid","typename","union","unsigned","using","virtual","void","volatile",
+            "wchar_t","while","xor","xor_eq"
+        };
+        unordered_set<string> s;
+        s.reserve(256);
+        for (auto p : arr) s.insert(string(p));
+        return s;
+    }();
+    return kws;
+}
+
+// -------------------- Persistence for user-defined keywords with parameters ----
+
+static void lex_user_keyword(UserKeyword &uk);
+
+// File format:
+// ===VERSION:<n>===                     (optional; database version at save time)
+// ===SYNCED:<n>===                      (optional; version at the last delta export/import)
+// ===KEYWORD:<name>===
+// ===REV:<n>===                         (optional; version of the entry's last change)
+// ===PARAMS:name=default,other=val===   (optional; if absent there are no params)
+// <snippet lines...>
+// ===END===
+// ===DELETED:<rev>:<name>===            (tombstone; lets deltas carry deletions)
+//
+// Entries and tombstones are written sorted by name so that saving an unchanged
+// database reproduces the file byte-for-byte and a change only touches its block.
+// A delta file (:export-delta) uses the same format restricted to changes.
+
+const char *USER_KW_FILE = "user_keywords.db";
+const char *USER_KW_DELTA_FILE = "user_keywords.delta";
+
+// Parse the "<n>" out of a "===TAG:<n>===" marker line; returns 0 when malformed.
+static uint64_t parse_marker_number(const string &line) {
+    size_t colon = line.find(':');
+    size_t last = line.rfind("===");
+    if (colon == string::npos || last == string::npos || last <= colon + 1) return 0;
+    try { return std::stoull(trim(line.substr(colon + 1, last - (colon + 1)))); } catch (...) { return 0; }
+}
+
+// Read keyword blocks (and version/tombstone markers) from `in` into `out`.
+// Entries without a REV marker (files written before versioning) get rev 1 so
+// that ":export-delta 0" always yields the complete set.
+void read_user_keywords(std::istream &in, UserKeywordDb &out) {
+    string line;
+    string current_key;
+    vector<std::pair<string,string>> current_params;
+    uint64_t current_rev = 0;
+    std::ostringstream buffer;
+    bool in_entry = false;
+    auto commit = [&]() {
+        UserKeyword uk;
+        uk.snippet = buffer.str();
+        uk.params = current_params;
+        uk.rev = current_rev ? current_rev : 1;
+        out.version = std::max(out.version, uk.rev);
+        string key = trim(current_key);
+        out.index.emplace_hint(out.index.end(), key); // the file is sorted by name
+        lex_user_keyword(uk);
+        out.entries[std::move(key)] = std::move(uk);
+    };
+    while (std::getline(in, line)) {
+        // tolerate CRLF files (e.g. edited on Windows); output is always LF
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!in_entry) {
+            if (line.rfind("===KEYWORD:", 0) == 0) {
+                // parse key
+                size_t colon = line.find(':');
+                size_t last = line.rfind("===");
+                if (colon != string::npos && last != string::npos && last > colon+1) {
+                    current_key = trim(line.substr(colon + 1, last - (colon + 1)));
+                    current_params.clear();
+                    current_rev = 0;
+                    buffer.str("");
+                    buffer.clear();
+                    in_entry = true;
+                    // peek next line to see if it's PARAMS, but we continue loop
+                }
+            } else if (line.rfind("===VERSION:", 0) == 0) {
+                out.version = std::max(out.version, parse_marker_number(line));
+            } else if (line.rfind("===SYNCED:", 0) == 0) {
+                out.synced = parse_marker_number(line);
+            } else if (line.rfind("===DELETED:", 0) == 0) {
+                // ===DELETED:<rev>:<name>===
+                size_t colon = line.find(':');
+                size_t colon2 = line.find(':', colon + 1);
+                size_t last = line.rfind("===");
+                if (colon2 != string::npos && last != string::npos && last > colon2 + 1) {
+                    uint64_t rev = parse_marker_number(line.substr(0, colon2) + "===");
+                    string name = trim(line.substr(colon2 + 1, last - (colon2 + 1)));
+                    if (!name.empty()) {
+                        out.deleted[name] = rev;
+                        out.version = std::max(out.version, rev);
+                    }
+                }
+            }
+        } else {
+            if (line.rfind("===PARAMS:", 0) == 0) {
+                // parse params line
+                size_t colon = line.find(':');
+                size_t last = line.rfind("===");
+                if (colon != string::npos && last != string::npos && last > colon+1) {
+                    string paramstr = trim(line.substr(colon + 1, last - (colon + 1)));
+                    if (!paramstr.empty()) {
+                        auto parts = split_csv(paramstr);
+                        for (auto &p : parts) {
+                            size_t eq = p.find('=');
+                            string name = trim((eq==string::npos)?p:p.substr(0,eq));
+                            string def = trim((eq==string::npos)?"":p.substr(eq+1));
+                            if (!name.empty()) current_params.emplace_back(name, def);
+                        }
+                    }
+                }
+            } else if (line.rfind("===REV:", 0) == 0) {
+                current_rev = parse_marker_number(line);
+            } else if (line == "===END===") {
+                commit();
+                in_entry = false;
+                current_key.clear();
+                current_params.clear();
+                buffer.str("");
+                buffer.clear();
+            } else {
+                buffer << line << "\n";
+            }
+        }
+    }
+    // commit if file ended mid-entry
+    if (in_entry && !current_key.empty()) commit();
+}
+
+// -------------------- Fast-start image --------------------
+
+// Next to the text database we keep "<db>.img": a binary, pointer-free copy of
+// the parsed UserKeywordDb, lexed snippets included, with the entries in index
+// (name) order. It is trusted when the text file's size and mtime match the
+// values recorded in its header; neither file is hashed and the text is not
+// read. Only when the text was modified within IMAGE_RACY_WINDOW of the image
+// being written, so a later edit could share its mtime, is the text read and
+// compared by FNV-1a hash as well. Otherwise the text is parsed and, unless the
+// caller only reads the database, the image rewritten.
+//
+// Layout (native byte order, checked via the byte-order marker):
+//   "SGIMG\0\0\0" u32 format, u32 0x01020304, u32 sizeof(SnippetToken), u32 0,
+//   u64 src_size, i64 src_mtime, u64 src_hash, i64 written,
+//   u64 db_version, u64 db_synced, u64 n_entries, u64 n_deleted,
+//   entries  { str name, u64 rev, str snippet, u32 n_params, { str name, str def }*, lexed }*
+//   deleted  { str name, u64 rev }*
+// where str = u32 length + bytes and lexed is described at put_lexed_image().
+
+static const char IMAGE_MAGIC[8] = {'S','G','I','M','G','\0','\0','\0'};
+static const uint32_t IMAGE_FORMAT = 3;
+static const uint32_t IMAGE_BOM = 0x01020304u;
+static const std::chrono::seconds IMAGE_RACY_WINDOW(2);
+
+// Identity of the text file an image was built from.
+struct ImageSource {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0; // only filled in when the text has been read
+};
+
+static bool stat_image_source(const string &path, ImageSource &src) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    auto t = std::filesystem::last_write_time(path, ec);
+    if (ec) return false;
+    src.size = static_cast<uint64_t>(size);
+    src.mtime = static_cast<int64_t>(t.time_since_epoch().count());
+    return true;
+}
+
+static bool read_file(const string &path, string &content) {
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) return false;
+    content.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// A whole file mapped read-only (read into memory where mmap is unavailable).
+class MappedFile {
+public:
+    explicit MappedFile(const string &path) {
+#ifdef _WIN32
+        if (read_file(path, copy_)) { data_ = copy_.data(); size_ = copy_.size(); ok_ = true; }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0) {
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ == 0) {
+                ok_ = true;
+            } else {
+                void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) { map_ = p; data_ = static_cast<const char*>(p); ok_ = true; }
+            }
+        }
+        ::close(fd);
+#endif
+    }
+    ~MappedFile() {
+#ifndef _WIN32
+        if (map_) ::munmap(map_, size_);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    bool ok() const { return ok_; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+    const char *data_ = "";
+    size_t size_ = 0;
+    bool ok_ = false;
+#ifdef _WIN32
+    string copy_;
+#else
+    void *map_ = nullptr;
+#endif
+};
+
+template <typename T>
+static void put_pod(string &out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put_str(string &out, const string &s) {
+    put_pod<uint32_t>(out, static_cast<uint32_t>(s.size()));
+    out.append(s);
+}
+
+// Bounds-checked reader over an image buffer.
+class ImageReader {
+    std::string_view buf_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+public:
+    explicit ImageReader(std::string_view buf) : buf_(buf) {}
+    bool ok() const { return ok_; }
+    void fail() { ok_ = false; }
+    size_t pos() const { return pos_; }
+    size_t remaining() const { return buf_.size() - pos_; }
+    template <typename T>
+    T pod() {
+        T v{};
+        if (!ok_ || remaining() < sizeof(T)) { ok_ = false; return v; }
+        std::memcpy(&v, buf_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return v;
+    }
+    // The next n bytes, in place.
+    std::string_view bytes(size_t n) {
+        if (!ok_ || remaining() < n) { ok_ = false; return std::string_view(); }
+        std::string_view v = buf_.substr(pos_, n);
+        pos_ += n;
+        return v;
+    }
+    string str() {
+        uint32_t n = pod<uint32_t>();
+        return string(bytes(n));
+    }
+};
+
+// The lexed form of uk.snippet, written after the entry and read back into
+// uk.lexed; both are defined with the lexer.
+static void put_lexed_image(string &out, const UserKeyword &uk);
+static void read_lexed_image(ImageReader &r, UserKeyword &uk);
+static uint32_t lexed_token_size();
+
+static string image_path_for(const string &path) {
+    return path + ".img";
+}
+
+// A name next to `path` that no other process or thread is using.
+static string unique_temp_path(const string &path) {
+    static std::atomic<uint64_t> counter{0};
+#ifdef _WIN32
+    const long pid = static_cast<long>(::_getpid());
+#else
+    const long pid = static_cast<long>(::getpid());
+#endif
+    return path + ".tmp." + std::to_string(pid) + "." + std::to_string(counter.fetch_add(1));
+}
+
+static bool write_keyword_image(const UserKeywordDb &db, const string &path, const ImageSource &src) {
+    string out;
+    out.append(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    put_pod(out, IMAGE_FORMAT);
+    put_pod(out, IMAGE_BOM);
+    put_pod(out, lexed_token_size());
+    put_pod<uint32_t>(out, 0);
+    put_pod(out, src.size);
+    put_pod(out, src.mtime);
+    put_pod(out, src.hash);
+    put_pod<int64_t>(out, std::filesystem::file_time_type::clock::now().time_since_epoch().count());
+    put_pod<uint64_t>(out, db.version);
+    put_pod<uint64_t>(out, db.synced);
+    put_pod<uint64_t>(out, db.entries.size());
+    put_pod<uint64_t>(out, db.deleted.size());
+    for (const auto &name : db.index) { // in name order, so loading rebuilds the index in linear time
+        const UserKeyword &uk = db.entries.at(name);
+        put_str(out, name);
+        put_pod<uint64_t>(out, uk.rev);
+        put_str(out, uk.snippet);
+        put_pod<uint32_t>(out, static_cast<uint32_t>(uk.params.size()));
+        for (const auto &pp : uk.params) {
+            put_str(out, pp.first);
+            put_str(out, pp.second);
+        }
+        put_lexed_image(out, uk);
+    }
+    for (const auto &kv : db.deleted) {
+        put_str(out, kv.first);
+        put_pod<uint64_t>(out, kv.second);
+    }
+
+    // write-then-rename so a concurrent reader never sees a partial image
+    const string img = image_path_for(path);
+    const string tmp = unique_temp_path(img);
+    {
+        std::ofstream ofs(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!ofs) return false;
+        ofs.write(out.data(), static_cast<std::streamsize>(out.size()));
+        ofs.close();
+        std::error_code ec;
+        if (!ofs) { std::filesystem::remove(tmp, ec); return false; }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, img, ec);
+    if (ec) { std::filesystem::remove(tmp, ec); return false; }
+    return true;
+}
+
+// Load db from the image if it was built from the text file `src` describes;
+// false otherwise. `hashed` tells whether the text had to be read to decide;
+// then src.hash is filled in.
+static bool read_keyword_image(UserKeywordDb &db, const string &path, ImageSource &src, bool &hashed) {
+    MappedFile file(image_path_for(path));
+    if (!file.ok()) return false;
+    ImageReader r(file.view());
+    if (r.bytes(sizeof(IMAGE_MAGIC)) != std::string_view(IMAGE_MAGIC, sizeof(IMAGE_MAGIC))) return false;
+    if (r.pod<uint32_t>() != IMAGE_FORMAT || r.pod<uint32_t>() != IMAGE_BOM) return false;
+    if (r.pod<uint32_t>() != lexed_token_size()) return false;
+    r.pod<uint32_t>();
+    if (r.pod<uint64_t>() != src.size || r.pod<int64_t>() != src.mtime) return false;
+    const uint64_t src_hash = r.pod<uint64_t>();
+    const int64_t written = r.pod<int64_t>();
+    if (!r.ok()) return false;
+    hashed = false;
+    const int64_t racy = std::chrono::duration_cast<std::filesystem::file_time_type::duration>(IMAGE_RACY_WINDOW).count();
+    if (src.mtime > written - racy) {
+        // the text may have changed again since without its size or mtime changing
+        string content;
+        if (!read_file(path, content) || content.size() != src.size ||
+            fnv1a64(content) != src_hash)
+            return false;
+        hashed = true;
+        src.hash = src_hash;
+    }
+
+    UserKeywordDb out;
+    out.version = r.pod<uint64_t>();
+    out.synced = r.pod<uint64_t>();
+    uint64_t n_entries = r.pod<uint64_t>();
+    uint64_t n_deleted = r.pod<uint64_t>();
+    if (!r.ok() || n_entries > r.remaining() || n_deleted > r.remaining()) return false;
+    out.entries.reserve(static_cast<size_t>(n_entries));
+    for (uint64_t i = 0; i < n_entries && r.ok(); ++i) {
+        string name = r.str();
+        UserKeyword uk;
+        uk.rev = r.pod<uint64_t>();
+        uk.snippet = r.str();
+        uint32_t np = r.pod<uint32_t>();
+        for (uint32_t j = 0; j < np && r.ok(); ++j) {
+            string pn = r.str();
+            string pd = r.str();
+            uk.params.emplace_back(std::move(pn), std::move(pd));
+        }
+        read_lexed_image(r, uk);
+        if (!r.ok() || (!out.index.empty() && !(*out.index.rbegin() < name))) return false;
+        out.index.emplace_hint(out.index.end(), name);
+        out.entries.emplace(std::move(name), std::move(uk));
+    }
+    for (uint64_t i = 0; i < n_deleted && r.ok(); ++i) {
+        string name = r.str();
+        out.deleted[name] = r.pod<uint64_t>();
+    }
+    if (!r.ok() || r.remaining() != 0) return false;
+    db = std::move(out);
+    return true;
+}
+
+static std::atomic<uint64_t> g_image_hits{0};
+static std::atomic<uint64_t> g_image_misses{0};
+
+DbLoadStats db_load_stats() {
+    DbLoadStats st;
+    st.image_hits = g_image_hits.load(std::memory_order_relaxed);
+    st.image_misses = g_image_misses.load(std::memory_order_relaxed);
+    return st;
+}
+
+// Load user keywords from disk into db (missing file -> empty db). Uses the
+// fast-start image when it matches the text file and, with refresh_image,
+// rewrites it otherwise.
+void load_user_keywords(UserKeywordDb &db, const string &path, bool refresh_image) {
+    db = UserKeywordDb{};
+    ImageSource src;
+    const bool have_src = stat_image_source(path, src); // before reading, so a later change stays visible
+    bool hashed = false;
+    if (have_src && read_keyword_image(db, path, src, hashed)) {
+        g_image_hits.fetch_add(1, std::memory_order_relaxed);
+        // rewritten now, the image is no longer racy and later loads skip the hash
+        const auto now = std::filesystem::file_time_type::clock::now().time_since_epoch();
+        if (hashed && refresh_image &&
+            src.mtime < std::chrono::duration_cast<std::filesystem::file_time_type::duration>(now - IMAGE_RACY_WINDOW).count())
+            write_keyword_image(db, path, src);
+        return;
+    }
+    string content;
+    if (!read_file(path, content)) return;
+    g_image_misses.fetch_add(1, std::memory_order_relaxed);
+    std::istringstream iss(content);
+    read_user_keywords(iss, db);
+    if (have_src && refresh_image && content.size() == src.size) {
+        src.hash = fnv1a64(content);
+        write_keyword_image(db, path, src);
+    }
+}
+
+// Write every entry and tombstone changed after version `since`, sorted by name.
+// since == 0 writes the whole database, with its last sync once there was one.
+void write_user_keywords(std::ostream &os, const UserKeywordDb &db, uint64_t since) {
+    os << "===VERSION:" << db.version << "===\n";
+    if (since == 0 && db.synced) os << "===SYNCED:" << db.synced << "===\n";
+    for (const auto &name : db.index) {
+        const auto *kv = &*db.entries.find(name);
+        if (kv->second.rev <= since) continue;
+        os << "===KEYWORD:" << kv->first << "===\n";
+        os << "===REV:" << kv->second.rev << "===\n";
+        // write params
+        if (!kv->second.params.empty()) {
+            os << "===PARAMS:";
+            bool first = true;
+            for (const auto &pp : kv->second.params) {
+                if (!first) os << ",";
+                os << pp.first << "=" << pp.second;
+                first = false;
+            }
+            os << "===\n";
+        }
+        // snippet
+        os << kv->second.snippet;
+        if (!kv->second.snippet.empty() && kv->second.snippet.back() != '\n') os << "\n";
+        os << "===END===\n";
+    }
+    // tombstones (std::map keeps them sorted)
+    for (const auto &kv : db.deleted) {
+        if (kv.second > since) os << "===DELETED:" << kv.second << ":" << kv.first << "===\n";
+    }
+}
+
+static void append_journal_record(const UserKeywordDb &db, const string &db_path);
+
+// Save user keywords to disk (and refresh the fast-start image and, when the
+// database is journaled, append the changes to the journal)
+bool save_user_keywords(const UserKeywordDb &db, const string &path) {
+    std::ostringstream text;
+    write_user_keywords(text, db);
+    const string content = text.str();
+    {
+        std::ofstream ofs(path, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!ofs) return false;
+        ofs << content;
+        if (!ofs) return false;
+    }
+    ImageSource src;
+    if (stat_image_source(path, src) && src.size == content.size()) {
+        src.hash = fnv1a64(content);
+        write_keyword_image(db, path, src);
+    }
+    append_journal_record(db, path);
+    return true;
+}
+
+// Insert or replace a keyword, stamping it with a new database version.
+void put_user_keyword(UserKeywordDb &db, const string &name, UserKeyword uk) {
+    uk.rev = ++db.version;
+    lex_user_keyword(uk);
+    db.deleted.erase(name);
+    db.index.insert(name);
+    db.entries[name] = std::move(uk);
+}
+
+// Remove a keyword and leave a tombstone so deltas propagate the deletion.
+bool erase_user_keyword(UserKeywordDb &db, const string &name) {
+    if (!db.entries.erase(name)) return false;
+    db.index.erase(name);
+    db.deleted[name] = ++db.version;
+    return true;
+}
+
+vector<string> list_user_keywords(const UserKeywordDb &db, std::string_view prefix,
+                                  size_t offset, size_t limit, size_t &total) {
+    vector<string> page;
+    auto it = db.index.lower_bound(prefix);
+    if (prefix.empty()) {
+        total = db.index.size();
+        for (size_t i = 0; i < offset && it != db.index.end(); ++i) ++it;
+        for (; it != db.index.end() && page.size() < limit; ++it) page.push_back(*it);
+        return page;
+    }
+    total = 0;
+    for (; it != db.index.end() && it->compare(0, prefix.size(), prefix) == 0; ++it, ++total) {
+        if (total >= offset && page.size() < limit) page.push_back(*it);
+    }
+    return page;
+}
+
+// Write the changes made after version `since` to `path`. Returns the number of
+// entries plus tombstones written, or -1 if the file could not be written.
+long export_user_keywords_delta(UserKeywordDb &db, uint64_t since, const string &path) {
+    std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+    if (!ofs) return -1;
+    write_user_keywords(ofs, db, since);
+    if (!ofs) return -1;
+    db.synced = db.version;
+    long count = 0;
+    for (const auto &kv : db.entries) if (kv.second.rev > since) ++count;
+    for (const auto &kv : db.deleted) if (kv.second > since) ++count;
+    return count;
+}
+
+// Whether `name` was added, updated or deleted here after the last sync.
+static bool changed_since_sync(const UserKeywordDb &db, const string &name) {
+    auto it = db.entries.find(name);
+    if (it != db.entries.end()) return it->second.rev > db.synced;
+    auto del = db.deleted.find(name);
+    return del != db.deleted.end() && del->second > db.synced;
+}
+
+// Apply a delta file to db. Entries identical to the local copy are skipped so
+// re-importing a delta (or syncing it back) does not bump versions. A local
+// change made after the last sync is kept and reported as a conflict instead
+// of being overwritten; since the import is itself a sync, importing the same
+// delta again takes the delta's side. Returns the number of local changes, or
+// -1 if the file could not be read.
+long import_user_keywords_delta(UserKeywordDb &db, const string &path, vector<string> *conflicts) {
+    std::ifstream ifs(path, std::ios::in);
+    if (!ifs) return -1;
+    UserKeywordDb delta;
+    read_user_keywords(ifs, delta);
+    long changed = 0;
+    const auto conflict = [&](const string &name) {
+        if (!changed_since_sync(db, name)) return false;
+        if (conflicts) conflicts->push_back(name);
+        return true;
+    };
+    for (const auto &name : delta.index) {
+        UserKeyword &uk = delta.entries.at(name);
+        auto it = db.entries.find(name);
+        if (it != db.entries.end() && it->second.snippet == uk.snippet && it->second.params == uk.params) continue;
+        if (conflict(name)) continue;
+        put_user_keyword(db, name, std::move(uk));
+        ++changed;
+    }
+    for (const auto &kv : delta.deleted) {
+        if (!db.entries.count(kv.first) || conflict(kv.first)) continue;
+        erase_user_keyword(db, kv.first);
+        ++changed;
+    }
+    db.synced = db.version;
+    return changed;
+}
+
+// -------------------- Journal --------------------
+
+// "<db>.journal" is an append-only log of the writer's saves, for read
+// replicas. Each record is the delta since the previous record (the file
+// format above, starting with ===VERSION===) closed by
+//   ===COMMIT:<version>:<unix ms>===
+// A record without its COMMIT line is still being written (or was torn by a
+// crash) and is not applied. Saves only append while the journal exists, so
+// journaling is switched on by init_keyword_journal.
+//
+// The file starts with ===JOURNAL:<epoch>===, a value picked at random by each
+// init_keyword_journal. A replica that finds a different epoch knows the
+// journal was started over, even if it has since grown past where it stopped
+// reading, and starts over from its first record.
+
+string keyword_journal_path(const string &db_path) {
+    return db_path + ".journal";
+}
+
+static bool parse_commit_line(const string &line, uint64_t &version, int64_t &committed_ms) {
+    if (line.rfind("===COMMIT:", 0) != 0 || line.size() < 13 || line.compare(line.size() - 3, 3, "===") != 0) return false;
+    const string body = line.substr(10, line.size() - 13);
+    const size_t colon = body.find(':');
+    try {
+        version = std::stoull(body.substr(0, colon));
+        committed_ms = colon == string::npos ? 0 : std::stoll(body.substr(colon + 1));
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+static string journal_epoch_line() {
+    std::random_device rd;
+    const uint64_t epoch = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^
+        static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    return "===JOURNAL:" + std::to_string(epoch) + "===\n";
+}
+
+// The journal's ===JOURNAL:...=== line, "" for a journal without one.
+static string read_journal_epoch(std::istream &in) {
+    string line;
+    in.seekg(0);
+    if (!std::getline(in, line) || line.rfind("===JOURNAL:", 0) != 0) return string();
+    return line;
+}
+
+static string commit_line(uint64_t version) {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    return "===COMMIT:" + std::to_string(version) + ":" +
+           std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) + "===\n";
+}
+
+// Version of the last committed record and the offset just past it. Usually
+// the COMMIT line is the file's last line; otherwise the whole file is scanned.
+static void journal_head(const string &path, uint64_t &version, uint64_t &end) {
+    version = 0;
+    end = 0;
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) return;
+    ifs.seekg(0, std::ios::end);
+    const uint64_t size = static_cast<uint64_t>(ifs.tellg());
+    const uint64_t tail = std::min<uint64_t>(size, 256);
+    string buf(tail, '\0');
+    ifs.seekg(static_cast<std::streamoff>(size - tail));
+    ifs.read(&buf[0], static_cast<std::streamsize>(tail));
+    if (!buf.empty() && buf.back() == '\n') {
+        size_t start = buf.rfind('\n', buf.size() - 2);
+        start = start == string::npos ? 0 : start + 1;
+        int64_t ms = 0;
+        if ((start > 0 || tail == size) && parse_commit_line(buf.substr(start, buf.size() - 1 - start), version, ms)) {
+            end = size;
+            return;
+        }
+    }
+    ifs.clear();
+    ifs.seekg(0);
+    string line;
+    uint64_t pos = 0;
+    while (std::getline(ifs, line)) {
+        pos += line.size() + 1;
+        uint64_t v = 0;
+        int64_t ms = 0;
+        if (parse_commit_line(line, v, ms)) {
+            version = v;
+            end = pos;
+        }
+    }
+}
+
+static void append_journal_record(const UserKeywordDb &db, const string &db_path) {
+    const string path = keyword_journal_path(db_path);
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) return;
+    uint64_t head = 0, end = 0;
+    journal_head(path, head, end);
+    if (db.version <= head) return; // nothing new since the last record
+    if (std::filesystem::file_size(path, ec) != end && !ec) std::filesystem::resize_file(path, end, ec); // drop a torn record
+    std::ostringstream rec;
+    write_user_keywords(rec, db, head);
+    rec << commit_line(db.version);
+    // one write, so a replica sees either nothing or a prefix of the record
+    std::ofstream ofs(path, std::ios::out | std::ios::app | std::ios::binary);
+    ofs << rec.str();
+}
+
+bool init_keyword_journal(const UserKeywordDb &db, const string &db_path) {
+    std::ostringstream rec;
+    rec << journal_epoch_line();
+    write_user_keywords(rec, db);
+    rec << commit_line(db.version);
+    // write-then-rename: a replica sees the old journal or the whole new one
+    const string path = keyword_journal_path(db_path);
+    const string tmp = unique_temp_path(path);
+    {
+        std::ofstream ofs(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+        ofs << rec.str();
+        ofs.close();
+        std::error_code ec;
+        if (!ofs) { std::filesystem::remove(tmp, ec); return false; }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) { std::filesystem::remove(tmp, ec); return false; }
+    return true;
+}
+
+JournalTailer::JournalTailer(string path) : path_(std::move(path)) {}
+
+bool JournalTailer::read_new(vector<JournalRecord> &out) {
+    std::ifstream ifs(path_, std::ios::in | std::ios::binary);
+    if (!ifs) return false;
+    const string epoch = read_journal_epoch(ifs);
+    ifs.clear();
+    ifs.seekg(0, std::ios::end);
+    const uint64_t size = static_cast<uint64_t>(ifs.tellg());
+    bool restart = false;
+    if (offset_ > 0 && (size < offset_ || epoch != epoch_)) {
+        // re-initialized: start over; the first record replaces the database
+        offset_ = 0;
+        head_ = 0;
+        restart = true;
+    }
+    epoch_ = epoch;
+    if (size == offset_) return true;
+    string buf(size - offset_, '\0');
+    ifs.seekg(static_cast<std::streamoff>(offset_));
+    ifs.read(&buf[0], static_cast<std::streamsize>(buf.size()));
+    buf.resize(static_cast<size_t>(ifs.gcount()));
+
+    size_t record_start = 0, pos = 0;
+    while (true) {
+        const size_t nl = buf.find('\n', pos);
+        if (nl == string::npos) break; // partial line: wait for the rest
+        JournalRecord rec;
+        if (parse_commit_line(buf.substr(pos, nl - pos), rec.version, rec.committed_ms)) {
+            std::istringstream body(buf.substr(record_start, pos - record_start));
+            read_user_keywords(body, rec.changes);
+            rec.restart = restart;
+            restart = false;
+            head_ = std::max(head_, rec.version);
+            out.push_back(std::move(rec));
+            record_start = nl + 1;
+        }
+        pos = nl + 1;
+    }
+    offset_ += record_start;
+    return true;
+}
+
+bool apply_journal_record(UserKeywordDb &db, const JournalRecord &rec) {
+    if (rec.restart) {
+        // the writer's whole database, possibly at a lower version than ours
+        db.entries = rec.changes.entries;
+        db.index = rec.changes.index;
+        db.deleted = rec.changes.deleted;
+        db.version = rec.version;
+        return true;
+    }
+    if (rec.version <= db.version) return false;
+    for (const auto &kv : rec.changes.entries) {
+        if (kv.second.rev <= db.version) continue;
+        db.deleted.erase(kv.first);
+        db.index.insert(kv.first);
+        db.entries[kv.first] = kv.second;
+    }
+    for (const auto &kv : rec.changes.deleted) {
+        if (kv.second <= db.version) continue;
+        db.entries.erase(kv.first);
+        db.index.erase(kv.first);
+        db.deleted[kv.first] = kv.second;
+    }
+    db.version = rec.version;
+    return true;
+}
+
+// -------------------- Bulk import of keyword packs --------------------
+
+// A pack is either a directory (searched recursively) or a single file:
+//   *.snip  one keyword named after the file stem; an optional first line
+//           ===PARAMS:...=== declares its parameters, the rest is the snippet.
+//   other   parsed as a database/delta file (===KEYWORD:...=== blocks).
+// Files are parsed in parallel; validation and conflict resolution then run
+// sequentially in path order so the result does not depend on thread timing.
+
+struct ImportCandidate {
+    string name;
+    UserKeyword uk;
+    string source; // file the entry came from (for reporting)
+};
+
+// Parse one pack file into candidates. Returns false (with err) if unreadable.
+static bool parse_import_file(const std::filesystem::path &file, vector<ImportCandidate> &out, string &err) {
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+    if (!ifs) { err = file.string() + ": cannot open"; return false; }
+    if (file.extension() == ".snip") {
+        ImportCandidate c;
+        c.name = normalize_token(file.stem().string());
+        c.source = file.string();
+        string line;
+        std::ostringstream body;
+        bool first = true;
+        while (std::getline(ifs, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (first && line.rfind("===PARAMS:", 0) == 0) {
+                size_t colon = line.find(':');
+                size_t last = line.rfind("===");
+                if (last != string::npos && last > colon + 1) {
+                    for (auto &p : split_csv(line.substr(colon + 1, last - (colon + 1)))) {
+                        size_t eq = p.find('=');
+                        string pname = trim((eq==string::npos)?p:p.substr(0,eq));
+                        string pdef = trim((eq==string::npos)?"":p.substr(eq+1));
+                        if (!pname.empty()) c.uk.params.emplace_back(pname, pdef);
+                    }
+                }
+            } else {
+                body << line << "\n";
+            }
+            first = false;
+        }
+        c.uk.snippet = body.str();
+        out.push_back(std::move(c));
+        return true;
+    }
+    UserKeywordDb pack;
+    read_user_keywords(ifs, pack);
+    vector<const UserKeywordMap::value_type*> sorted;
+    for (const auto &kv : pack.entries) sorted.push_back(&kv);
+    std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b){ return a->first < b->first; });
+    for (const auto *kv : sorted) {
+        ImportCandidate c;
+        c.name = normalize_token(kv->first);
+        c.uk = kv->second;
+        c.source = file.string();
+        out.push_back(std::move(c));
+    }
+    return true;
+}
+
+// Reason an entry cannot be stored, or empty if it is acceptable.
+static string validate_user_keyword(const string &name, const UserKeyword &uk) {
+    if (name.empty()) return "empty keyword name";
+    if (cpp17_keywords().count(name)) return "'" + name + "' conflicts with a built-in C++17 keyword";
+    if (uk.snippet.find("int main(") != string::npos) return "'" + name + "' contains 'int main('";
+    for (const auto &pp : uk.params) {
+        if (pp.first.empty() || pp.first.find_first_of("{}=,") != string::npos)
+            return "'" + name + "' has invalid parameter name '" + pp.first + "'";
+    }
+    return string();
+}
+
+// Import every pack file under `root` into db. The caller saves once afterwards.
+ImportReport import_user_keyword_packs(UserKeywordDb &db, const string &root, ImportConflict policy) {
+    namespace fs = std::filesystem;
+    ImportReport rep;
+
+    // collect files in a stable order
+    vector<fs::path> files;
+    std::error_code ec;
+    if (fs::is_directory(root, ec)) {
+        for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec)) continue;
+            const auto ext = it->path().extension();
+            if (ext == ".snip" || ext == ".db" || ext == ".delta") files.push_back(it->path());
+        }
+        std::sort(files.begin(), files.end());
+    } else if (fs::is_regular_file(root, ec)) {
+        files.push_back(root);
+    } else {
+        rep.problems.push_back(root + ": no such file or directory");
+        return rep;
+    }
+    rep.files = files.size();
+
+    // parse in parallel; each worker owns whole slots of `parsed`
+    vector<vector<ImportCandidate>> parsed(files.size());
+    vector<string> errors(files.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            if (!parse_import_file(files[i], parsed[i], errors[i]) && errors[i].empty())
+                errors[i] = files[i].string() + ": unreadable";
+        }
+    };
+    size_t nthreads = std::min<size_t>(files.size(), std::max(1u, std::thread::hardware_concurrency()));
+    vector<std::thread> pool;
+    for (size_t t = 1; t < nthreads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool) th.join();
+
+    // validate and merge sequentially in path order
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!errors[i].empty()) { rep.problems.push_back(errors[i]); continue; }
+        for (auto &c : parsed[i]) {
+            string why = validate_user_keyword(c.name, c.uk);
+            if (!why.empty()) { rep.problems.push_back(c.source + ": " + why); continue; }
+            string name = c.name;
+            if (db.entries.count(name)) {
+                if (policy == ImportConflict::Skip) { ++rep.skipped; continue; }
+                if (policy == ImportConflict::Rename) {
+                    int suffix = 2;
+                    while (db.entries.count(name + "_" + std::to_string(suffix))) ++suffix;
+                    name += "_" + std::to_string(suffix);
+                    ++rep.renamed;
+                } else {
+                    ++rep.replaced;
+                }
+            } else {
+                ++rep.added;
+            }
+            put_user_keyword(db, name, std::move(c.uk));
+        }
+    }
+    return rep;
+}
+
+// -------------------- Parts & Context (unchanged) --------------------
+
+struct Parts {
+    vector<string> includes;
+    vector<string> top;
+    vector<string> body;
+};
+
+struct Frame {
+    Parts parts;       // header + inner lines (header stored in parts.body[0] if present)
+    size_t insert_pos; // index in aggregated.body where inner lines should be inserted
+};
+
+struct Context {
+    map<string,string> vars;
+    std::set<string> types;
+    string last_var;
+    string last_type;
+    map<string,string> meta;
+    std::vector<Frame> control_stack;
+    string db_path = USER_KW_FILE; // where keywords defined mid-expansion are saved
+    bool offer_definitions = true;  // false: never define (and save) unknown nested tokens
+    const UserKeywordMap *shared = nullptr; // read-only keywords consulted after the db's own
+};
+
+// A stored keyword by name: the db's own entry wins over the shared set.
+static const UserKeyword *find_user_keyword(const UserKeywordDb &db, const Context &ctx, const string &name) {
+    auto it = db.entries.find(name);
+    if (it != db.entries.end()) return &it->second;
+    if (ctx.shared) {
+        auto sit = ctx.shared->find(name);
+        if (sit != ctx.shared->end()) return &sit->second;
+    }
+    return nullptr;
+}
+
+static bool parts_is_opening_block(const Parts &p) {
+    // Look for a control-header line anywhere in the Parts body (conservative window).
+    // We consider the common headers: for(), while(), if(), switch(), do {, case <val>:
+    for (const auto &ln : p.body) {
+        // trim leading whitespace for pattern checks
+        std::string_view t = trim_leading_view(ln);
+        if (t.empty()) continue;
+        if (t.rfind("for (", 0) == 0 || t.rfind("while (", 0) == 0 ||
+            t.rfind("if (", 0) == 0 || t.rfind("switch (", 0) == 0 ||
+            t.rfind("do {", 0) == 0 || t.rfind("case ", 0) == 0 ||
+            t.rfind("try", 0) == 0 || t.rfind("catch(", 0) == 0 ||
+            t.rfind("catch (", 0) == 0 || t.rfind("else", 0) == 0) {
+                return true;
+        }
+        // generic: any non-empty line that ends with '{' is a candidate
+        if (!t.empty() && t.back() == '{') return true;
+    }
+    return false;
+}
+
+static void extract_block_header_and_inner(const Parts &p,
+                                           std::vector<std::string> &out_preceding,
+                                           std::string &out_header,
+                                           std::vector<std::string> &out_inner,
+                                           bool &had_closing) {
+    out_preceding.clear();
+    out_header.clear();
+    out_inner.clear();
+    had_closing = false;
+
+    // find index of the first header-like line
+    int header_idx = -1;
+    for (size_t i = 0; i < p.body.size(); ++i) {
+        const string &ln = p.body[i];
+        std::string_view t = trim_leading_view(ln);
+        if (t.empty()) {
+            // empty line -> treat as preceding
+            out_preceding.push_back(ln);
+            continue;
+        }
+        if (t.rfind("for (", 0) == 0 || t.rfind("while (", 0) == 0 ||
+            t.rfind("if (", 0) == 0 || t.rfind("switch (", 0) == 0 ||
+            t.rfind("do {", 0) == 0 || t.rfind("case ", 0) == 0 || (!t.empty() && t.back() == '{')) {
+            header_idx = static_cast<int>(i);
+            break;
+        } else {
+            out_preceding.push_back(ln);
+        }
+    }
+
+    if (header_idx == -1) {
+        // no header found: nothing special — treat entire body as "preceding"
+        return;
+    }
+
+    // header is at header_idx
+    out_header = p.body[header_idx];
+
+    // collect inner lines after header up to possibly a trailing single '}'
+    size_t j = header_idx + 1;
+    for (; j < p.body.size(); ++j) {
+        // check if final single '}' (trimmed) and it's the last line
+        if (j == p.body.size() - 1 && trim_view(p.body[j]) == "}") {
+            had_closing = true;
+            break;
+        }
+        out_inner.push_back(p.body[j]);
+    }
+}
+
+// ----------------- Identifier helpers & improved declare_variable -----------------
+static std::string sanitize_identifier(const std::string &raw) {
+    std::string out;
+    out.reserve(raw.size());
+    for (char c : raw) {
+        if (ascii::is_ident(c)) {
+            out.push_back(c);
+        } else if (c == ' ' || c == '-' || c == '.') {
+            out.push_back('_');
+        } else {
+            // drop other characters
+        }
+    }
+    if (out.empty()) out = "v";
+    if (ascii::is_digit(out[0])) out.insert(out.begin(), '_');
+    return out;
+}
+
+/*
+ Improved declare_variable:
+  - Sanitizes the requested base name.
+  - If the sanitized name already exists in ctx.vars, repeatedly asks the user
+    for another name (showing a suggested alternative) until a unique name is provided.
+  - Registers the chosen name in ctx.vars and sets ctx.last_var.
+  - Returns the textual declaration (e.g. "int foo = 0;").
+*/
+static std::string declare_variable(Context &ctx,
+                                    const std::string &type,
+                                    const std::string &base_name,
+                                    const std::string &init = "")
+{
+    std::string base = sanitize_identifier(base_name);
+    std::string candidate = base;
+
+    if (ctx.vars.find(candidate) != ctx.vars.end()) {
+        // Build an initial suggestion
+        std::string suggestion;
+        int suffix = 1;
+        do {
+            suggestion = base + std::to_string(suffix++);
+        } while (ctx.vars.find(suggestion) != ctx.vars.end());
+
+        // Prompt user until they provide a unique identifier
+        while (true) {
+            std::string prompt = "Variable name '" + candidate + "' is already used. "
+                                 "Choose another variable name (suggestion: " + suggestion + "):";
+            std::string reply = ask(prompt, suggestion);
+            std::string sanitized = sanitize_identifier(reply);
+            if (sanitized.empty()) sanitized = suggestion;
+
+            if (ctx.vars.find(sanitized) == ctx.vars.end()) {
+                candidate = sanitized;
+                break;
+            }
+
+            // prepare a different suggestion if needed
+            // simple incremental global suggestion to avoid stuck collisions
+            static std::atomic<int> __global_sugg{1000};
+            while (ctx.vars.find(suggestion) != ctx.vars.end()) {
+                suggestion = base + std::to_string(__global_sugg++);
+            }
+            // loop will re-prompt
+            candidate = sanitized;
+        }
+    }
+
+    // Register and return declaration
+    ctx.vars[candidate] = type;
+    ctx.last_var = candidate;
+
+    std::string decl;
+    if (init.empty()) decl = type + " " + candidate + ";";
+    else decl = type + " " + candidate + " = " + init + ";";
+
+    return decl;
+}
+
+static void append_parts(Parts &acc, const Parts &p) {
+    for (auto &inc : p.includes) acc.includes.push_back(inc);
+    for (auto &b : p.body) acc.body.push_back(b);
+}
+
+// Helper: `line` re-indented by `indent`; a blank line stays empty.
+static std::string reindent(const std::string &indent, std::string_view line) {
+    std::string_view t = trim_leading_view(line);
+    if (t.empty()) return std::string();
+    std::string out;
+    out.reserve(indent.size() + t.size());
+    out += indent;
+    out += t;
+    return out;
+}
+
+// Helper: get leading whitespace substring of a line
+static std::string leading_ws_of(const std::string &line) {
+    size_t i = 0;
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) ++i;
+    return line.substr(0, i);
+}
+
+// Helper: find the index of the nearest *unclosed* header line (a line whose trimmed trailing char is '{')
+// that corresponds to the position `search_from`. We scan backward and account for braces so that we find
+// the most-recent header that is still open at search_from. Returns string::npos if not found.
+static size_t find_unclosed_header_index(const Parts &acc, size_t search_from) {
+    if (acc.body.empty()) return std::string::npos;
+    size_t i = (search_from == 0 ? 0 : (search_from > acc.body.size() ? acc.body.size() : search_from));
+    int depth = 0;
+    while (i > 0) {
+        --i;
+        std::string_view line = trim_trailing_view(acc.body[i]);
+        // check if line ends with '}' or '{'
+        if (!line.empty()) {
+            char last = line.back();
+            if (last == '}') {
+                ++depth;
+                continue;
+            } else if (last == '{') {
+                if (depth == 0) {
+                    return i;
+                } else {
+                    --depth;
+                    continue;
+                }
+            }
+        }
+    }
+    return std::string::npos;
+}
+
+// Helper: produce a preview for a stored open frame: prefer the header line (if found in acc) else first non-empty stored inner line.
+static std::string preview_for_frame(const Parts &acc, const Frame &f) {
+    size_t hi = find_unclosed_header_index(acc, f.insert_pos);
+    if (hi != std::string::npos) return acc.body[hi];
+    for (const auto &ln : f.parts.body) {
+        if (!trim_leading_view(ln).empty()) return ln;
+    }
+    return std::string("(open block)");
+}
+
+// Replaces previous append_parts_with_nesting with corrected header-matching, previewing, indentation,
+// insert_pos bookkeeping and "try next older" flow. p.top has been moved into
+// acc by merge_top() already.
+static void append_parts_with_nesting(Parts &acc, const Parts &p, Context &ctx, const std::string &kw) {
+    const std::string INDENT = std::string(4, ' ');
+
+    // 1) If there are open frames, ask from most-recent to older whether to insert there.
+    if (!ctx.control_stack.empty()) {
+        for (int fi = static_cast<int>(ctx.control_stack.size()) - 1; fi >= 0; --fi) {
+            const Frame &frame = ctx.control_stack[fi];
+            std::string preview = preview_for_frame(acc, frame);
+            std::string q = "Insert snippet for '" + kw + "' inside open block: " + preview + " ? (y/n)";
+            std::string resp = ask(q, "y");
+            if (!resp.empty() && (resp[0] == 'y' || resp[0] == 'Y')) {
+                // chosen to insert into this frame
+                for (const auto &inc : p.includes) acc.includes.push_back(inc);
+
+                // insertion position
+                size_t pos = frame.insert_pos;
+                if (pos > acc.body.size()) pos = acc.body.size();
+
+                // find the header corresponding to this frame
+                size_t header_idx = find_unclosed_header_index(acc, pos);
+                std::string header_ws = (header_idx == std::string::npos) ? std::string() : leading_ws_of(acc.body[header_idx]);
+
+                // If incoming snippet is an opening control block, treat header & inner specially
+                if (parts_is_opening_block(p)) {
+                    std::vector<std::string> preceding;
+                    std::string header;
+                    std::vector<std::string> inner;
+                    bool had_closing = false;
+                    extract_block_header_and_inner(p, preceding, header, inner, had_closing);
+
+                    // Build insertion lines: preceding (at header level), header (one indent deeper than parent), initial inner (one more)
+                    std::vector<std::string> to_insert;
+                    std::string header_indent = header_ws + INDENT;
+                    std::string nested_inner_indent = header_indent + INDENT;
+
+                    for (const auto &pr : preceding) to_insert.push_back(reindent(header_indent, pr));
+                    to_insert.push_back(header_indent);
+                    to_insert.back() += trim_leading_view(header);
+                    for (const auto &ln : inner) to_insert.push_back(reindent(nested_inner_indent, ln));
+
+                    // insert at pos
+                    acc.body.insert(acc.body.begin() + pos, to_insert.begin(), to_insert.end());
+
+                    // update insert_pos for all frames whose insert_pos >= pos
+                    size_t inserted_count = to_insert.size();
+                    for (size_t fj = 0; fj < ctx.control_stack.size(); ++fj) {
+                        if (ctx.control_stack[fj].insert_pos >= pos) ctx.control_stack[fj].insert_pos += inserted_count;
+                    }
+
+                    // ask whether to keep the newly-inserted block open
+                    std::string keep = ask("Detected control block header for '" + kw + "'.\nKeep this block open for nested inserts? (y/n)", "y");
+                    if (!keep.empty() && (keep[0] == 'y' || keep[0] == 'Y')) {
+                        // push new frame: insert_pos immediately after the header + any initial inner lines
+                        Frame nf;
+                        // The new insert position should be at the end of the inserted chunk (i.e. pos + inserted_count)
+                        nf.parts.body.clear();
+                        nf.insert_pos = pos + inserted_count;
+                        ctx.control_stack.push_back(std::move(nf));
+                        return;
+                    } else {
+                        // not keeping open -> ensure closing brace present aligned with header_indent
+                        size_t close_pos = pos + inserted_count; // after inserted lines
+                        if (!had_closing) {
+                            if (close_pos > acc.body.size()) close_pos = acc.body.size();
+                            bool has_closing = false;
+                            if (close_pos < acc.body.size() && trim_leading_view(acc.body[close_pos]) == "}")
+                                has_closing = true;
+                            if (!has_closing) {
+                                acc.body.insert(acc.body.begin() + close_pos, header_ws + "}");
+                                // bump insert_pos of earlier frames (older) so their positions remain valid
+                                for (size_t oj = 0; oj < ctx.control_stack.size(); ++oj) {
+                                    if (ctx.control_stack[oj].insert_pos >= close_pos) ctx.control_stack[oj].insert_pos += 1;
+                                }
+                            }
+                        }
+                        return;
+                    }
+                } // end opening-block handling
+
+                // Non-opening snippet: indent relative to the header_ws
+                std::string insert_indent = header_ws + INDENT;
+                std::vector<std::string> to_insert;
+                for (const auto &ln : p.body) to_insert.push_back(reindent(insert_indent, ln));
+
+                // Insert and update bookkeeping
+                acc.body.insert(acc.body.begin() + pos, to_insert.begin(), to_insert.end());
+                size_t inserted_count = to_insert.size();
+
+                // update this frame's insert_pos
+                ctx.control_stack[fi].insert_pos += inserted_count;
+                // bump other frames' insert_pos if necessary
+                for (size_t fj = 0; fj < ctx.control_stack.size(); ++fj) {
+                    if (fj == static_cast<size_t>(fi)) continue;
+                    if (ctx.control_stack[fj].insert_pos >= pos) ctx.control_stack[fj].insert_pos += inserted_count;
+                }
+                return;
+            } // end if user accepted this frame
+
+            // user declined this frame -> ask whether to try the next older open frame
+            if (fi > 0) {
+                std::string try_next = ask("Try the next older open block? (y/n)", "y");
+                if (try_next.empty() || (try_next[0] != 'y' && try_next[0] != 'Y')) {
+                    break; // stop trying older frames and fall through to top-level handling
+                } else {
+                    continue; // try next older
+                }
+            }
+            // no older frames: fall through
+        } // end for frames
+        // fell out: no open frame chosen.
+    } // end if control_stack not empty
+
+    // Continue with top-level handling.
+    // 2) No frame chosen (or none existed). Handle opening-block at top-level.
+    if (parts_is_opening_block(p)) {
+        std::vector<std::string> preceding;
+        std::string header;
+        std::vector<std::string> inner;
+        bool had_closing = false;
+        extract_block_header_and_inner(p, preceding, header, inner, had_closing);
+
+        // emit includes and preceding lines
+        for (const auto &inc : p.includes) acc.includes.push_back(inc);
+        for (const auto &ln : preceding) acc.body.emplace_back(trim_leading_view(ln));
+
+        // ask whether to keep open
+        std::string keep = ask("Detected control block header for '" + kw + "'.\nKeep this block open for nested inserts? (y/n)", "y");
+        if (!keep.empty() && (keep[0] == 'y' || keep[0] == 'Y')) {
+            // write header (top-level)
+            acc.body.emplace_back(trim_leading_view(header));
+            // initial inner lines indented one level
+            for (const auto &ln : inner) acc.body.push_back(reindent(INDENT, ln));
+            // push frame with insert_pos after header + any initial inner
+            Frame f;
+            f.parts.body.clear();
+            f.insert_pos = acc.body.size();
+            ctx.control_stack.push_back(std::move(f));
+            return;
+        }
+
+        // not keeping open: emit header+inner+closing immediately
+        if (!header.empty()) acc.body.emplace_back(trim_leading_view(header));
+        for (const auto &ln : inner) acc.body.push_back(reindent(INDENT, ln));
+        if (!had_closing) acc.body.push_back(std::string("}"));
+        return;
+    }
+
+    // 3) Default: append normally to top-level
+    append_parts(acc, p);
+}
+
+// Replaces previous flush_control_stack: closes frames in LIFO order, aligns braces to the matching header,
+// and updates other frames' insert_pos accordingly.
+static void flush_control_stack(Parts &acc, Context &ctx) {
+    if (ctx.control_stack.empty()) return;
+
+    // close frames in LIFO order
+    for (int fi = static_cast<int>(ctx.control_stack.size()) - 1; fi >= 0; --fi) {
+        Frame &frame = ctx.control_stack[fi];
+        size_t close_pos = frame.insert_pos;
+        if (close_pos > acc.body.size()) close_pos = acc.body.size();
+
+        // skip if there's already a closing brace at close_pos
+        bool already = false;
+        if (close_pos < acc.body.size() && trim_leading_view(acc.body[close_pos]) == "}") already = true;
+
+        if (!already) {
+            // find corresponding header and its leading whitespace
+            size_t header_idx = find_unclosed_header_index(acc, close_pos);
+            std::string header_ws;
+            if (header_idx != std::string::npos) header_ws = leading_ws_of(acc.body[header_idx]);
+            else header_ws = std::string();
+
+            // insert aligned closing brace
+            acc.body.insert(acc.body.begin() + close_pos, header_ws + "}");
+
+            // bump insert_pos of earlier frames (older) so their positions remain valid
+            for (int oj = 0; oj < fi; ++oj) {
+                if (ctx.control_stack[oj].insert_pos >= close_pos) ctx.control_stack[oj].insert_pos += 1;
+            }
+        }
+    }
+
+    ctx.control_stack.clear();
+}
+
+// Replace all occurrences of token in s with repl.
+static void replace_all(string &s, const string &token, const string &repl) {
+    if (token.empty()) return;
+    size_t pos = 0;
+    while ((pos = s.find(token, pos)) != string::npos) {
+        s.replace(pos, token.size(), repl);
+        pos += repl.size();
+    }
+}
+
+// -------------------- C++ scanner --------------------
+
+// The one tokenizer behind the snippet lexer, validate_program() and the lint:
+// each consumes these tokens rather than re-scanning the text its own way.
+// Every byte belongs to exactly one token. Only block comments and raw string
+// literals can span lines; unterminated ones run to the end of the text, an
+// unterminated ordinary literal to the end of its line.
+struct CppToken {
+    enum Kind : uint8_t { SPACE, NEWLINE, IDENT, NUMBER, LITERAL, COMMENT, PUNCT };
+    enum Error : uint8_t { NONE, UNTERMINATED, NO_RAW_OPEN };
+    Kind kind = SPACE;
+    Error error = NONE;
+    bool line_first = false; // the first token on its line other than SPACE
+    size_t begin = 0, size = 0;
+    int line = 1, column = 1; // of `begin`, from 1
+};
+
+static bool is_encoding_prefix(std::string_view id) {
+    return id == "u8" || id == "u" || id == "U" || id == "L";
+}
+
+static bool is_raw_prefix(std::string_view id) {
+    return id == "R" || id == "u8R" || id == "uR" || id == "UR" || id == "LR";
+}
+
+class CppScanner {
+    std::string_view s_;
+    size_t i_ = 0;
+    size_t line_start_ = 0;
+    int line_ = 1;
+    bool blank_ = true; // nothing but spaces so far on this line
+
+    // An ordinary literal whose opening quote is at q: it ends at its unescaped
+    // quote or, unterminated, at the line end.
+    CppToken::Error quoted(size_t q) {
+        const char c = s_[q];
+        size_t k = q + 1;
+        while (k < s_.size() && s_[k] != c && s_[k] != '\n')
+            k += (s_[k] == '\\' && k + 1 < s_.size() && s_[k + 1] != '\n') ? 2 : 1;
+        if (k < s_.size() && s_[k] == c) { i_ = k + 1; return CppToken::NONE; }
+        i_ = k;
+        return CppToken::UNTERMINATED;
+    }
+
+    // Ends the multi-line token [b, e) at e, counting the lines it spans.
+    void span_to(size_t b, size_t e) {
+        for (size_t k = b; k < e; ++k) {
+            if (s_[k] == '\n') { ++line_; line_start_ = k + 1; }
+        }
+        i_ = e;
+    }
+
+public:
+    explicit CppScanner(std::string_view s) : s_(s) {}
+
+    bool next(CppToken &tk) {
+        const size_t n = s_.size();
+        if (i_ >= n) return false;
+        const size_t b = i_;
+        const char c = s_[b];
+        tk.begin = b;
+        tk.line = line_;
+        tk.column = static_cast<int>(b - line_start_ + 1);
+        tk.error = CppToken::NONE;
+        tk.line_first = false;
+        if (c == '\n') {
+            tk.kind = CppToken::NEWLINE;
+            i_ = b + 1;
+            ++line_;
+            line_start_ = i_;
+            blank_ = true;
+        } else if (ascii::is_space(c)) {
+            tk.kind = CppToken::SPACE;
+            while (i_ < n && s_[i_] != '\n' && ascii::is_space(s_[i_])) ++i_;
+        } else {
+            tk.line_first = blank_;
+            blank_ = false;
+            if (c == '/' && b + 1 < n && s_[b + 1] == '/') {
+                tk.kind = CppToken::COMMENT;
+                i_ = s_.find('\n', b);
+                if (i_ == std::string_view::npos) i_ = n;
+            } else if (c == '/' && b + 1 < n && s_[b + 1] == '*') {
+                tk.kind = CppToken::COMMENT;
+                size_t e = s_.find("*/", b + 2);
+                if (e == std::string_view::npos) { tk.error = CppToken::UNTERMINATED; e = n; }
+                else e += 2;
+                span_to(b, e);
+            } else if (c == '"' || c == '\'') {
+                tk.kind = CppToken::LITERAL;
+                tk.error = quoted(b);
+            } else if (ascii::is_digit(c) || (c == '.' && b + 1 < n && ascii::is_digit(s_[b + 1]))) {
+                // pp-number, digit separators and exponent signs included
+                tk.kind = CppToken::NUMBER;
+                ++i_;
+                while (i_ < n) {
+                    const char d = s_[i_];
+                    const char p = s_[i_ - 1];
+                    if (ascii::is_ident(d) || d == '.') ++i_;
+                    else if (d == '\'' && i_ + 1 < n && ascii::is_ident(s_[i_ + 1])) i_ += 2;
+                    else if ((d == '+' || d == '-') && (p == 'e' || p == 'E' || p == 'p' || p == 'P')) ++i_;
+                    else break;
+                }
+            } else if (ascii::is_ident(c)) {
+                tk.kind = CppToken::IDENT;
+                while (i_ < n && ascii::is_ident(s_[i_])) ++i_;
+                const std::string_view id = s_.substr(b, i_ - b);
+                if (i_ < n && s_[i_] == '"' && is_raw_prefix(id)) {
+                    tk.kind = CppToken::LITERAL;
+                    const size_t open = s_.find('(', i_ + 1);
+                    const size_t nl = s_.find('\n', i_ + 1);
+                    if (open == std::string_view::npos || open > nl) {
+                        quoted(i_);
+                        tk.error = CppToken::NO_RAW_OPEN;
+                    } else {
+                        const string end = ")" + string(s_.substr(i_ + 1, open - i_ - 1)) + "\"";
+                        size_t e = s_.find(end, open + 1);
+                        if (e == std::string_view::npos) { tk.error = CppToken::UNTERMINATED; e = n; }
+                        else e += end.size();
+                        span_to(b, e);
+                    }
+                } else if (i_ < n && (s_[i_] == '"' || s_[i_] == '\'') && is_encoding_prefix(id)) {
+                    tk.kind = CppToken::LITERAL;
+                    tk.error = quoted(i_);
+                }
+            } else {
+                tk.kind = CppToken::PUNCT;
+                i_ = b + 1;
+            }
+        }
+        tk.size = i_ - tk.begin;
+        return true;
+    }
+};
+
+// -------------------- Snippet lexer --------------------
+
+// A snippet is scanned as a whole (CppScanner), so block comments and raw
+// string literals that span lines stay comments and literals. Only identifiers outside comments and
+// literals become IDENT tokens (the candidates for nested expansion);
+// everything else, whitespace, punctuation, numbers, literals and comments, is
+// kept verbatim as TEXT. No token crosses a line break.
+struct SnippetToken {
+    enum Kind : uint8_t { TEXT, IDENT };
+    Kind kind;
+    uint32_t begin; // offset into LexedSnippet::text
+    uint32_t size;
+};
+
+struct LexedLine {
+    size_t first = 0, last = 0; // token range [first, last)
+    bool is_include = false;    // an #include line: not part of the body
+    string include;             // its remainder ("<vector>", "\"my.h\"", "vector")
+};
+
+struct LexedSnippet {
+    string text;                // the snippet the tokens point into
+    vector<SnippetToken> tokens;
+    vector<LexedLine> lines;    // as std::getline splits `text`
+    bool has_main = false;      // contains "int main(", which snippets must not
+    // The UserKeyword::snippet and params it was made from, compared on every
+    // use so an entry changed in place is never expanded from stale tokens.
+    // `source` is left empty when it equals `text` (no parameters substituted).
+    string source;
+    bool source_is_text = false;
+    vector<std::pair<string,string>> params;
+
+    bool made_from(const UserKeyword &uk) const {
+        return (source_is_text ? text : source) == uk.snippet && params == uk.params;
+    }
+};
+
+static void set_lexed_source(LexedSnippet &lx, const UserKeyword &uk) {
+    lx.source_is_text = lx.text == uk.snippet;
+    if (lx.source_is_text) lx.source.clear();
+    else lx.source = uk.snippet;
+    lx.params = uk.params;
+}
+
+static void lex_snippet(string text, LexedSnippet &out) {
+    out.text = std::move(text);
+    out.tokens.clear();
+    out.lines.clear();
+    const string &s = out.text;
+    const size_t n = s.size();
+    out.has_main = s.find("int main(") != string::npos;
+
+    auto emit = [&](SnippetToken::Kind kind, size_t b, size_t e) {
+        if (e <= b) return;
+        if (kind == SnippetToken::TEXT && out.tokens.size() > out.lines.back().first &&
+            out.tokens.back().kind == SnippetToken::TEXT) {
+            out.tokens.back().size += static_cast<uint32_t>(e - b); // extend this line's TEXT run
+            return;
+        }
+        out.tokens.push_back({kind, static_cast<uint32_t>(b), static_cast<uint32_t>(e - b)});
+    };
+    bool include_line = false; // the rest of this line is not lexed: it never reaches the body
+    // `fresh`: the line does not start inside a comment or literal
+    auto begin_line = [&](size_t at, bool fresh) {
+        LexedLine ln;
+        ln.first = ln.last = out.tokens.size();
+        out.lines.push_back(ln);
+        if (!fresh) return;
+        size_t e = s.find('\n', at);
+        if (e == string::npos) e = n;
+        std::string_view t = trim_view(std::string_view(s).substr(at, e - at));
+        size_t skip = t.rfind("#include", 0) == 0 ? 8 : (t.rfind("# include", 0) == 0 ? 9 : 0);
+        if (skip) {
+            out.lines.back().is_include = true;
+            out.lines.back().include = trim(t.substr(skip));
+            include_line = true;
+        }
+    };
+    auto end_line = [&] { out.lines.back().last = out.tokens.size(); };
+
+    if (n) begin_line(0, true);
+    CppScanner sc(s);
+    CppToken tk;
+    while (sc.next(tk)) {
+        if (tk.kind == CppToken::NEWLINE) {
+            end_line();
+            include_line = false;
+            if (tk.begin + 1 < n) begin_line(tk.begin + 1, true);
+            continue;
+        }
+        size_t b = tk.begin;
+        const size_t e = tk.begin + tk.size;
+        if (tk.kind == CppToken::COMMENT || tk.kind == CppToken::LITERAL) {
+            // no token crosses a line break: a comment or literal spanning lines is split
+            for (size_t nl; (nl = std::string_view(s).substr(b, e - b).find('\n')) != std::string_view::npos; ) {
+                nl += b;
+                if (!include_line) emit(SnippetToken::TEXT, b, nl);
+                end_line();
+                include_line = false;
+                b = nl + 1;
+                if (b < n) begin_line(b, false);
+            }
+        }
+        if (!include_line) emit(tk.kind == CppToken::IDENT ? SnippetToken::IDENT : SnippetToken::TEXT, b, e);
+    }
+    if (n) end_line();
+}
+
+// The snippet with parameter values substituted for their {name} placeholders.
+static string substitute_params(const UserKeyword &uk, const map<string,string> &values) {
+    string transformed = uk.snippet;
+    for (const auto &pp : uk.params) {
+        auto it = values.find(pp.first);
+        replace_all(transformed, "{" + pp.first + "}", it != values.end() ? it->second : pp.second);
+    }
+    return transformed;
+}
+
+static void lex_user_keyword(UserKeyword &uk) {
+    auto lx = std::make_shared<LexedSnippet>();
+    lex_snippet(substitute_params(uk, {}), *lx);
+    set_lexed_source(*lx, uk);
+    uk.lexed = std::move(lx);
+}
+
+// Image form of uk.lexed (see "Fast-start image"):
+//   u8 flags (1: has_main, 2: text is uk.snippet), [str text unless flag 2],
+//   u32 n_tokens, SnippetToken[n_tokens] as stored in memory,
+//   u32 n_lines, { u32 first, u32 last, u8 is_include, [str include if is_include] }*
+static uint32_t lexed_token_size() {
+    return static_cast<uint32_t>(sizeof(SnippetToken));
+}
+
+static void put_lexed_image(string &out, const UserKeyword &uk) {
+    const bool fresh = uk.lexed && uk.lexed->made_from(uk);
+    LexedSnippet own;
+    if (!fresh) lex_snippet(substitute_params(uk, {}), own);
+    const LexedSnippet &lx = fresh ? *uk.lexed : own;
+    const bool same = lx.text == uk.snippet;
+    put_pod<uint8_t>(out, static_cast<uint8_t>((lx.has_main ? 1 : 0) | (same ? 2 : 0)));
+    if (!same) put_str(out, lx.text);
+    put_pod<uint32_t>(out, static_cast<uint32_t>(lx.tokens.size()));
+    for (const SnippetToken &t : lx.tokens) {
+        SnippetToken z;
+        std::memset(&z, 0, sizeof(z)); // no stray padding bytes in the file
+        z.kind = t.kind;
+        z.begin = t.begin;
+        z.size = t.size;
+        put_pod(out, z);
+    }
+    put_pod<uint32_t>(out, static_cast<uint32_t>(lx.lines.size()));
+    for (const LexedLine &ln : lx.lines) {
+        put_pod<uint32_t>(out, static_cast<uint32_t>(ln.first));
+        put_pod<uint32_t>(out, static_cast<uint32_t>(ln.last));
+        put_pod<uint8_t>(out, ln.is_include ? 1 : 0);
+        if (ln.is_include) put_str(out, ln.include);
+    }
+}
+
+// Every offset is checked against the text, so a damaged image fails to load
+// rather than sending expansion out of bounds.
+static void read_lexed_image(ImageReader &r, UserKeyword &uk) {
+    auto lx = std::make_shared<LexedSnippet>();
+    const uint8_t flags = r.pod<uint8_t>();
+    lx->has_main = (flags & 1) != 0;
+    lx->text = (flags & 2) ? uk.snippet : r.str();
+    const uint32_t n_tokens = r.pod<uint32_t>();
+    const std::string_view raw = r.bytes(static_cast<size_t>(n_tokens) * sizeof(SnippetToken));
+    if (!r.ok()) return;
+    lx->tokens.resize(n_tokens);
+    if (n_tokens) std::memcpy(lx->tokens.data(), raw.data(), raw.size());
+    for (const SnippetToken &t : lx->tokens) {
+        if (t.kind > SnippetToken::IDENT || t.begin > lx->text.size() || t.size > lx->text.size() - t.begin) { r.fail(); return; }
+    }
+    const uint32_t n_lines = r.pod<uint32_t>();
+    if (!r.ok() || n_lines > r.remaining()) { r.fail(); return; }
+    lx->lines.resize(n_lines);
+    for (LexedLine &ln : lx->lines) {
+        ln.first = r.pod<uint32_t>();
+        ln.last = r.pod<uint32_t>();
+        ln.is_include = r.pod<uint8_t>() != 0;
+        if (ln.is_include) ln.include = r.str();
+        if (!r.ok() || ln.first > ln.last || ln.last > n_tokens) { r.fail(); return; }
+    }
+    set_lexed_source(*lx, uk);
+    uk.lexed = std::move(lx);
+}
+
+size_t lexed_snippet_bytes(const LexedSnippet *lx) {
+    if (!lx) return 0;
+    size_t bytes = sizeof(*lx) + sizeof(void*) * 2 // make_shared control block
+                 + lx->text.capacity() + lx->source.capacity()
+                 + lx->tokens.capacity() * sizeof(SnippetToken)
+                 + lx->lines.capacity() * sizeof(LexedLine);
+    for (const LexedLine &ln : lx->lines) bytes += ln.include.capacity();
+    for (const auto &pp : lx->params) bytes += sizeof(pp) + pp.first.capacity() + pp.second.capacity();
+    return bytes;
+}
+
+// The lexed snippet for these parameter values: the one cached with the entry
+// when every value is the default, otherwise `scratch` lexed now.
+static const LexedSnippet &lexed_snippet_for(const UserKeyword &uk, const map<string,string> &values,
+                                             LexedSnippet &scratch) {
+    bool defaults = true;
+    for (const auto &pp : uk.params) {
+        auto it = values.find(pp.first);
+        if (it != values.end() && it->second != pp.second) { defaults = false; break; }
+    }
+    if (defaults && uk.lexed && uk.lexed->made_from(uk)) return *uk.lexed;
+    lex_snippet(substitute_params(uk, values), scratch);
+    return scratch;
+}
+
+// Parts for a user snippet that contains main(), which custom keywords must not.
+static Parts user_snippet_with_main(const string &tag) {
+    Parts p;
+    p.body.push_back("// (" + tag + ") ERROR: user snippet contains 'int main('. This is disallowed for custom keywords.");
+    p.body.push_back("// Please redefine this custom keyword without a main() function.");
+    return p;
+}
+
+// -------------------- Top-level declarations --------------------
+
+// Every occurrence emits its own top-level declarations, so a keyword used twice
+// (or two keywords sharing helpers, like 'virtual' and 'dynamic_cast') would
+// define the same struct again. merge_top() moves an occurrence's Parts::top into
+// the program one declaration at a time: a declaration whose text was already
+// emitted is dropped, and one that reuses a name with a different definition is
+// renamed, together with every use of that name in the rest of the occurrence.
+struct TopIndex {
+    unordered_set<string> seen;     // normalized text of each emitted declaration
+    map<string,string> defined;     // declared name (functions: name and parameters) -> normalized text
+    map<string,string> renamed;     // normalized text of a renamed declaration -> its new name
+    set<string> names;              // every name declared so far
+    vector<string> tags;            // occurrence tag of each Parts::top entry merged
+};
+
+// The code of a declaration as identifiers, numbers and single punctuators
+// (views into `s`); comments, literals and whitespace are skipped.
+static vector<std::string_view> top_signature(std::string_view s) {
+    vector<std::string_view> sig;
+    CppScanner scanner(s);
+    CppToken tk;
+    while (scanner.next(tk)) {
+        if (tk.kind == CppToken::IDENT || tk.kind == CppToken::NUMBER || tk.kind == CppToken::PUNCT)
+            sig.push_back(s.substr(tk.begin, tk.size));
+    }
+    return sig;
+}
+
+// Parts::top entries grouped into declarations: a declaration may span several
+// entries (handle_alignas emits one line per entry) and ends at depth 0 on ';'
+// or '}'. Comment and blank entries between declarations stand alone. The
+// entries are scanned as one text, so a comment or raw string literal running
+// on into the next entry keeps it in the declaration.
+static vector<string> split_top_declarations(const vector<string> &top) {
+    vector<string> decls;
+    if (top.empty()) return decls;
+    string all;
+    vector<size_t> ends; // offset just past each entry in `all`
+    for (const auto &t : top) {
+        if (!ends.empty()) all += '\n';
+        all += t;
+        ends.push_back(all.size());
+    }
+    size_t k = 0;     // the entry whose end comes next
+    size_t first = 0; // the first entry of the current declaration
+    int depth = 0;
+    char last = 0;    // the last code character; 0: no code yet
+    auto entry_end = [&](bool inside_token) {
+        if (!inside_token && depth <= 0 && (last == 0 || last == ';' || last == '}')) {
+            const size_t b = first ? ends[first - 1] + 1 : 0;
+            decls.push_back(all.substr(b, ends[k] - b));
+            first = k + 1;
+            depth = 0;
+            last = 0;
+        }
+        ++k;
+    };
+    CppScanner scanner(all);
+    CppToken tk;
+    while (scanner.next(tk)) {
+        while (k < ends.size() && ends[k] <= tk.begin) entry_end(false);
+        while (k < ends.size() && ends[k] < tk.begin + tk.size) entry_end(true);
+        if (tk.kind == CppToken::SPACE || tk.kind == CppToken::NEWLINE || tk.kind == CppToken::COMMENT) continue;
+        const char c = all[tk.begin];
+        if (tk.kind == CppToken::PUNCT && c == '{') ++depth;
+        else if (tk.kind == CppToken::PUNCT && c == '}') --depth;
+        last = tk.kind == CppToken::LITERAL ? '"' : c;
+    }
+    while (k < ends.size()) entry_end(false);
+    if (first < top.size()) decls.push_back(all.substr(first ? ends[first - 1] + 1 : 0));
+    return decls;
+}
+
+// Whitespace runs outside comments and literals collapsed to one space, ends trimmed.
+static string normalize_declaration(std::string_view s) {
+    string out;
+    out.reserve(s.size());
+    CppScanner scanner(s);
+    CppToken tk;
+    while (scanner.next(tk)) {
+        if (tk.kind == CppToken::SPACE || tk.kind == CppToken::NEWLINE) {
+            if (!out.empty() && out.back() != ' ') out += ' ';
+        } else {
+            out += s.substr(tk.begin, tk.size);
+        }
+    }
+    if (!out.empty() && out.back() == ' ') out.pop_back();
+    return out;
+}
+
+// The key two definitions of the same entity share, or "" for anything that
+// may be repeated or is not worth renaming: declarations without a definition,
+// operators, out-of-class members, static_assert, using-directives. Types,
+// aliases and variables are keyed by name; functions by name and parameters,
+// so overloads do not conflict. `name` is set to the declared name.
+static string top_declaration_key(const vector<std::string_view> &sig, string &name) {
+    name.clear();
+    const size_t n = sig.size();
+    auto at = [&](size_t k) { return k < n ? sig[k] : std::string_view(); };
+    auto is_name = [](std::string_view v) {
+        return !v.empty() && (ascii::is_alpha(v[0]) || v[0] == '_') && !cpp17_keywords().count(string(v));
+    };
+    size_t i = 0;
+    if (at(i) == "template") {
+        int angle = 0;
+        for (++i; i < n; ++i) {
+            if (sig[i] == "<") ++angle;
+            else if (sig[i] == ">" && --angle == 0) { ++i; break; }
+        }
+    }
+    while (at(i) == "inline" || at(i) == "static" || at(i) == "constexpr" || at(i) == "thread_local") ++i;
+    const std::string_view w = at(i);
+    if (w == "extern" || w == "static_assert" || w == "friend") return string();
+    if (w == "using") {
+        if (is_name(at(i + 1)) && at(i + 2) == "=") name = string(at(i + 1));
+        return name;
+    }
+    if (w == "typedef") {
+        // the last name before ';' ("typedef unsigned long ulong;")
+        for (size_t k = i + 1; k < n && sig[k] != ";"; ++k) {
+            if (sig[k] == "(") return string(); // function pointer typedef: not worth parsing
+            if (is_name(sig[k])) name = string(sig[k]);
+        }
+        return name;
+    }
+    if (w == "struct" || w == "class" || w == "union" || w == "enum") {
+        ++i;
+        if (w == "enum" && (at(i) == "class" || at(i) == "struct")) ++i;
+        if (at(i) == "alignas") {
+            int paren = 0;
+            for (++i; i < n; ++i) {
+                if (sig[i] == "(") ++paren;
+                else if (sig[i] == ")" && --paren == 0) { ++i; break; }
+            }
+        }
+        if (!is_name(at(i))) return string();
+        for (size_t k = i + 1; k < n && sig[k] != ";"; ++k) {
+            if (sig[k] == "{") { name = string(sig[i]); return name; }
+        }
+        return string(); // forward declaration
+    }
+
+    // a variable or function: its name is the last identifier before ( = { [ or ;
+    size_t k = i;
+    while (k < n && sig[k] != "(" && sig[k] != "=" && sig[k] != "{" && sig[k] != "[" && sig[k] != ";") ++k;
+    if (k == n || k == i || !is_name(sig[k - 1])) return string(); // also "operator+(": '+' is no name
+    if (k >= 2 && sig[k - 2] == ":") return string();             // Class::member
+    for (size_t j = i; j < k; ++j) if (sig[j] == "operator") return string();
+    name = string(sig[k - 1]);
+    if (sig[k] != "(") return name;
+
+    // a function counts once it has a body
+    string key = name;
+    int paren = 0;
+    for (; k < n; ++k) {
+        key += ' ';
+        key += sig[k];
+        if (sig[k] == "(") ++paren;
+        else if (sig[k] == ")" && --paren == 0) { ++k; break; }
+    }
+    for (; k < n; ++k) {
+        if (sig[k] == ";") break;
+        if (sig[k] == "{") return key;
+    }
+    name.clear();
+    return string();
+}
+
+// Replace the identifier `from` by `to` outside comments and literals.
+static void rename_identifier(string &text, const string &from, const string &to) {
+    if (text.find(from) == string::npos) return;
+    LexedSnippet lx;
+    lex_snippet(text, lx);
+    string out;
+    size_t pos = 0;
+    for (const auto &tk : lx.tokens) {
+        if (tk.kind != SnippetToken::IDENT || std::string_view(lx.text).substr(tk.begin, tk.size) != from) continue;
+        out.append(lx.text, pos, tk.begin - pos);
+        out += to;
+        pos = tk.begin + tk.size;
+    }
+    if (pos == 0) return;
+    out.append(lx.text, pos, string::npos);
+    text = std::move(out);
+}
+
+// Move p.top into acc.top without repeating a declaration; see TopIndex.
+static void merge_top(TopIndex &ix, Parts &acc, Parts &p, Context &ctx, const string &tag, std::ostream &log) {
+    if (p.top.empty()) return;
+    vector<string> decls = split_top_declarations(p.top);
+    p.top.clear();
+    for (size_t d = 0; d < decls.size(); ++d) {
+        string norm = normalize_declaration(decls[d]);
+        const vector<std::string_view> sig = top_signature(decls[d]);
+        if (sig.empty()) { // comment or blank line
+            acc.top.push_back(std::move(decls[d]));
+            ix.tags.push_back(tag);
+            continue;
+        }
+        if (ix.seen.count(norm)) continue;
+
+        string name;
+        string key = top_declaration_key(sig, name);
+        if (!key.empty()) {
+            auto it = ix.defined.find(key);
+            if (it != ix.defined.end() && it->second != norm) {
+                // same name, different definition: rename it here and in what follows,
+                // reusing the name given to an identical definition before
+                string &fresh = ix.renamed[norm];
+                if (fresh.empty()) {
+                    for (int k = 2; ; ++k) {
+                        fresh = name + "_" + std::to_string(k);
+                        if (!ix.names.count(fresh) && !ctx.vars.count(fresh) && !ctx.types.count(fresh)) break;
+                    }
+                }
+                log << "Renamed '" << name << "' to '" << fresh << "': '" << name << "' is already defined differently.\n";
+                for (size_t r = d; r < decls.size(); ++r) rename_identifier(decls[r], name, fresh);
+                for (auto &b : p.body) rename_identifier(b, name, fresh);
+                if (ctx.types.count(name)) ctx.types.insert(fresh);
+                if (ctx.last_type == name) ctx.last_type = fresh;
+                --d; // look at the renamed declaration again: it may have been emitted already
+                continue;
+            }
+            ix.defined.emplace(key, norm);
+        }
+        if (!name.empty()) ix.names.insert(name);
+        ix.seen.insert(std::move(norm));
+        acc.top.push_back(std::move(decls[d]));
+        ix.tags.push_back(tag);
+    }
+}
+
+// -------------------- Program validation --------------------
+
+std::string_view occurrence_tag_in(std::string_view comment) {
+    size_t b = comment.find("(occurrence ");
+    if (b == std::string_view::npos) return std::string_view();
+    size_t e = comment.find("))", b);
+    if (e == std::string_view::npos) return std::string_view();
+    return comment.substr(b + 1, e - b);
+}
+
+static char closer_of(char open) {
+    return open == '(' ? ')' : (open == '[' ? ']' : '}');
+}
+
+// The issue for an unterminated literal token (prefix and opening quote included).
+static const char *unterminated_literal(std::string_view literal) {
+    const size_t q = literal.find_first_of("\"'");
+    if (q > 0 && literal[q - 1] == 'R') return "raw string literal is never closed";
+    return literal[q] == '"' ? "string literal is not terminated" : "character literal is not terminated";
+}
+
+std::vector<ProgramIssue> validate_program(std::string_view s) {
+    std::vector<ProgramIssue> issues;
+    struct Open { char c; int line, column; std::string_view tag; };
+    vector<Open> stack;
+    std::string_view tag; // of the last tag comment seen
+    auto issue = [&](int ln, int col, std::string_view tg, string msg) {
+        issues.push_back(ProgramIssue{ln, col, string(tg), std::move(msg)});
+    };
+
+    // top-level statements end once brackets are balanced again; what names
+    // them comes before their first '{', so only those tokens are kept
+    struct Definition { int line; std::string_view tag; };
+    std::unordered_map<string, Definition> defined;
+    vector<Definition> mains;
+    bool in_statement = false;
+    bool stmt_brace = false;          // its first '{' was seen
+    vector<std::string_view> stmt_sig; // as top_signature() gives it
+    int stmt_line = 0;
+    std::string_view stmt_tag;
+    auto end_statement = [&] {
+        string name;
+        string key = top_declaration_key(stmt_sig, name);
+        in_statement = stmt_brace = false;
+        stmt_sig.clear();
+        if (key.empty()) return;
+        if (name == "main" && key != name) { mains.push_back({stmt_line, stmt_tag}); return; }
+        auto ins = defined.emplace(key, Definition{stmt_line, stmt_tag});
+        if (!ins.second) {
+            issue(stmt_line, 1, stmt_tag, "'" + name + "' is already defined at line " + std::to_string(ins.first->second.line));
+        }
+    };
+
+    CppScanner scanner(s);
+    CppToken tk;
+    bool directive = false; // in a preprocessor line
+    while (scanner.next(tk)) {
+        const std::string_view text = s.substr(tk.begin, tk.size);
+        if (tk.kind == CppToken::NEWLINE) {
+            directive = false;
+            continue;
+        }
+        if (tk.kind == CppToken::SPACE || directive) continue;
+        if (tk.kind == CppToken::PUNCT && text[0] == '#' && tk.line_first) {
+            directive = true;
+            continue;
+        }
+        if (tk.kind == CppToken::COMMENT) {
+            if (tk.error == CppToken::UNTERMINATED) issue(tk.line, tk.column, tag, "block comment is never closed");
+            std::string_view t = text[1] == '/' ? occurrence_tag_in(text) : std::string_view();
+            if (!t.empty()) tag = t;
+            continue;
+        }
+        if (!in_statement) { in_statement = true; stmt_line = tk.line; stmt_tag = tag; }
+        if (tk.kind != CppToken::LITERAL && !stmt_brace) stmt_sig.push_back(text);
+        if (tk.kind == CppToken::LITERAL) {
+            if (tk.error == CppToken::NO_RAW_OPEN) {
+                issue(tk.line, tk.column, tag, "raw string literal has no opening '('");
+            } else if (tk.error == CppToken::UNTERMINATED) {
+                issue(tk.line, tk.column, tag, unterminated_literal(text));
+            }
+            continue;
+        }
+        if (tk.kind != CppToken::PUNCT) continue;
+        const char c = text[0];
+        if (c == '(' || c == '[' || c == '{') {
+            if (c == '{') stmt_brace = true;
+            stack.push_back({c, tk.line, tk.column, tag});
+        } else if (c == ')' || c == ']' || c == '}') {
+            // close the nearest matching opener; openers above it were never closed
+            size_t m = stack.size();
+            while (m > 0 && closer_of(stack[m - 1].c) != c) --m;
+            if (m == 0) {
+                issue(tk.line, tk.column, tag, string("'") + c + "' has no matching opening bracket");
+            } else {
+                for (size_t k = stack.size(); k > m; --k) {
+                    const Open &o = stack[k - 1];
+                    issue(o.line, o.column, o.tag, string("'") + o.c + "' is not closed before line " + std::to_string(tk.line));
+                }
+                stack.resize(m - 1);
+            }
+            if (c == '}' && stack.empty()) end_statement();
+        } else if (c == ';' && stack.empty()) {
+            end_statement();
+        }
+    }
+    for (const auto &o : stack) issue(o.line, o.column, o.tag, string("'") + o.c + "' is never closed");
+    if (in_statement) end_statement(); // e.g. a main() missing its '}'
+
+    if (mains.empty()) issue(0, 0, std::string_view(), "no main() is defined");
+    for (size_t k = 1; k < mains.size(); ++k) {
+        issue(mains[k].line, 1, mains[k].tag, "main() is already defined at line " + std::to_string(mains[0].line));
+    }
+    std::stable_sort(issues.begin(), issues.end(), [](const ProgramIssue &a, const ProgramIssue &b) {
+        return a.line < b.line || (a.line == b.line && a.column < b.column);
+    });
+    return issues;
+}
+
+std::string describe_issue(const ProgramIssue &issue) {
+    string out = issue.line ? "line " + std::to_string(issue.line) + ":" + std::to_string(issue.column) : string("program");
+    if (!issue.tag.empty()) out += " [" + issue.tag + "]";
+    out += ": ";
+    out += issue.message;
+    return out;
+}
+
+// -------------------- Performance lint --------------------
+
+struct LintToken {
+    std::string_view text; // an identifier or one punctuation character
+    int line;
+};
+
+struct LintSource {
+    vector<LintToken> tokens;
+    vector<std::string_view> line_tags; // per line (index 0 unused): the last tag comment before it
+};
+
+// Tokens of `s` outside comments, literals and preprocessor lines. Tag comments
+// are followed as validate_program() follows them.
+static LintSource lint_tokens(std::string_view s) {
+    LintSource src;
+    src.line_tags.push_back(std::string_view());
+    std::string_view tag;
+    CppScanner scanner(s);
+    CppToken tk;
+    bool directive = false;
+    while (scanner.next(tk)) {
+        while (src.line_tags.size() <= static_cast<size_t>(tk.line)) src.line_tags.push_back(tag);
+        const std::string_view text = s.substr(tk.begin, tk.size);
+        if (tk.kind == CppToken::NEWLINE) {
+            directive = false;
+        } else if (tk.kind == CppToken::PUNCT && text[0] == '#' && tk.line_first) {
+            directive = true;
+        } else if (directive) {
+            continue;
+        } else if (tk.kind == CppToken::COMMENT) {
+            std::string_view t = text[1] == '/' ? occurrence_tag_in(text) : std::string_view();
+            if (!t.empty()) tag = t;
+        } else if (tk.kind == CppToken::IDENT || tk.kind == CppToken::PUNCT) {
+            src.tokens.push_back({text, tk.line});
+        }
+    }
+    return src;
+}
+
+// Index of the token closing the bracket at `open`, or tokens.size().
+static size_t lint_match(const vector<LintToken> &t, size_t open) {
+    const char o = t[open].text[0];
+    const char c = o == '(' ? ')' : (o == '{' ? '}' : (o == '[' ? ']' : '>'));
+    int depth = 0;
+    for (size_t k = open; k < t.size(); ++k) {
+        if (t[k].text.size() != 1) continue;
+        if (t[k].text[0] == o) ++depth;
+        else if (t[k].text[0] == c && --depth == 0) return k;
+        else if (o == '<' && (t[k].text[0] == ';' || t[k].text[0] == '{')) break; // a comparison, not a template
+    }
+    return t.size();
+}
+
+// What a copy of a user type costs, estimated from its definition.
+struct TypeCost {
+    size_t bytes = 0;
+    bool owning = false; // owns heap storage: a copy allocates
+    bool large() const { return owning || bytes > 16; }
+};
+
+static size_t fundamental_size(std::string_view id) {
+    static const std::unordered_map<std::string_view, size_t> sizes = {
+        {"bool", 1}, {"char", 1}, {"int8_t", 1}, {"uint8_t", 1}, {"byte", 1}, {"char8_t", 1},
+        {"short", 2}, {"int16_t", 2}, {"uint16_t", 2}, {"char16_t", 2},
+        {"int", 4}, {"unsigned", 4}, {"float", 4}, {"int32_t", 4}, {"uint32_t", 4}, {"char32_t", 4}, {"wchar_t", 4},
+        {"long", 8}, {"double", 8}, {"size_t", 8}, {"ptrdiff_t", 8}, {"int64_t", 8}, {"uint64_t", 8},
+        {"intptr_t", 8}, {"uintptr_t", 8}};
+    auto it = sizes.find(id);
+    return it == sizes.end() ? 0 : it->second;
+}
+
+static bool owning_type(std::string_view id) {
+    static const std::unordered_set<std::string_view> names = {
+        "string", "wstring", "basic_string", "vector", "deque", "list", "forward_list", "map", "multimap",
+        "set", "multiset", "unordered_map", "unordered_multimap", "unordered_set", "unordered_multiset",
+        "function", "any", "shared_ptr"};
+    return names.count(id) != 0;
+}
+
+struct TypeDefs {
+    const vector<LintToken> &t;
+    std::unordered_map<std::string_view, std::pair<size_t, size_t>> bodies; // name -> its { and }
+    std::unordered_map<std::string_view, TypeCost> costs;
+
+    TypeCost cost(std::string_view name, int depth = 0);
+};
+
+// Data members are the statements of the body without a '(' or nested '{'.
+TypeCost TypeDefs::cost(std::string_view name, int depth) {
+    auto known = costs.find(name);
+    if (known != costs.end()) return known->second;
+    TypeCost tc;
+    auto body = bodies.find(name);
+    if (body == bodies.end() || depth > 8) return tc;
+    costs[name] = tc; // a recursive member (through a pointer) must not loop
+    size_t k = body->second.first + 1;
+    while (k < body->second.second) {
+        size_t e = k;
+        bool skip = false;
+        while (e < body->second.second && t[e].text != ";") {
+            if (t[e].text == "(") skip = true;
+            if (t[e].text == "{") { skip = true; e = lint_match(t, e); }
+            ++e;
+        }
+        size_t b = k;
+        while (b + 1 < e && t[b + 1].text == ":" && (t[b].text == "public" || t[b].text == "private" || t[b].text == "protected")) b += 2;
+        if (!skip && b < e && t[b].text != "static" && t[b].text != "using" && t[b].text != "typedef" &&
+            t[b].text != "friend" && t[b].text != "enum") {
+            size_t one = 0;
+            bool pointer = false;
+            size_t declarators = 1;
+            size_t array = 1;
+            bool longs = false;
+            for (size_t m = b; m < e && t[m].text != "="; ++m) {
+                std::string_view x = t[m].text;
+                if (x == "*" || x == "&") pointer = true;
+                else if (x == ",") ++declarators;
+                else if (x == "[") {
+                    array = 64; // an array of unknown or large extent
+                } else if (x == "<") {
+                    // template arguments: std::array<T, N> and friends are large by themselves
+                    size_t close = lint_match(t, m);
+                    if (m > b && t[m - 1].text == "array") one = std::max<size_t>(one, 64);
+                    if (close < e) m = close;
+                } else if (owning_type(x)) {
+                    tc.owning = true;
+                } else if (x == "long" && longs) {
+                    one = 8; // long long
+                } else if (size_t f = fundamental_size(x)) {
+                    if (x == "double" && longs) f = 16; // long double
+                    longs = longs || x == "long";
+                    one = std::max(one, f);
+                } else if (x != name && bodies.count(x)) {
+                    TypeCost inner = cost(x, depth + 1);
+                    tc.owning = tc.owning || inner.owning;
+                    one = std::max(one, inner.bytes);
+                }
+            }
+            if (pointer) one = 8;
+            if (one == 0) one = 8; // a type we cannot see into
+            tc.bytes += one * declarators * array;
+        }
+        k = e + 1;
+    }
+    costs[name] = tc;
+    return tc;
+}
+
+static const std::unordered_set<std::string_view> &not_a_function() {
+    static const std::unordered_set<std::string_view> names = {
+        "if", "for", "while", "switch", "return", "sizeof", "alignof", "alignas", "decltype", "typeid",
+        "noexcept", "static_assert", "throw", "new", "delete", "co_await", "co_return", "co_yield", "defined"};
+    return names;
+}
+
+std::vector<LintFinding> lint_program(std::string_view code, const std::set<std::string> &user_types) {
+    std::vector<LintFinding> findings;
+    const LintSource src = lint_tokens(code);
+    const vector<LintToken> &t = src.tokens;
+    const size_t n = t.size();
+    std::set<std::pair<int, string>> reported; // (line, message): the same finding once per line
+    auto report = [&](int line, string rule, string message, string suggestion) {
+        if (!reported.insert({line, message}).second) return;
+        const size_t ln = static_cast<size_t>(line);
+        string tag = ln < src.line_tags.size() ? string(src.line_tags[ln]) : string();
+        findings.push_back({line, std::move(tag), std::move(rule), std::move(message), std::move(suggestion)});
+    };
+
+    // declarations first: type definitions, vectors and where each vector is reserved
+    TypeDefs defs{t, {}, {}};
+    std::unordered_map<std::string_view, size_t> vectors;  // name -> token of its declaration
+    std::unordered_map<std::string_view, size_t> reserved; // name -> token of its first reserve()
+    for (size_t k = 0; k + 1 < n; ++k) {
+        std::string_view x = t[k].text;
+        if ((x == "struct" || x == "class" || x == "union") && ascii::is_ident(t[k + 1].text[0]) &&
+            !(k > 0 && t[k - 1].text == "enum")) {
+            size_t b = k + 2;
+            while (b < n && t[b].text != "{" && t[b].text != ";" && t[b].text != "(" && t[b].text != ")" &&
+                   t[b].text != ",") ++b;
+            if (b < n && t[b].text == "{") defs.bodies.emplace(t[k + 1].text, std::make_pair(b, lint_match(t, b)));
+        } else if (x == "vector" && t[k + 1].text == "<") {
+            size_t close = lint_match(t, k + 1);
+            if (close + 2 < n && ascii::is_ident(t[close + 1].text[0])) {
+                std::string_view next = t[close + 2].text;
+                if (next == ";" || next == "{" || next == "(" || next == "=" || next == "," || next == ")") {
+                    vectors.emplace(t[close + 1].text, close + 1);
+                }
+            }
+        } else if (x == "." && t[k + 1].text == "reserve" && k > 0) {
+            reserved.emplace(t[k - 1].text, k);
+        }
+    }
+    std::unordered_set<std::string_view> large; // the user types checked for by-value parameters
+    auto consider = [&](std::string_view name) {
+        if (defs.bodies.count(name) && defs.cost(name).large()) large.insert(name);
+    };
+    if (user_types.empty()) {
+        for (const auto &b : defs.bodies) consider(b.first);
+    } else {
+        for (const auto &name : user_types) {
+            auto it = defs.bodies.find(name);
+            if (it != defs.bodies.end()) consider(it->first);
+        }
+    }
+
+    // loops: brace scopes that are loop bodies, and single statements under a loop header
+    struct Scope { bool loop; size_t start; bool is_do; };
+    vector<Scope> scopes;
+    struct Pending { size_t start; size_t depth; };
+    vector<Pending> pending;
+    size_t loop_header = n;   // the loop whose '{' comes next
+    bool next_is_do = false;
+    bool closed_do = false;   // the last '}' ended a do body: a 'while' follows
+    std::unordered_set<std::string_view> flagged_vectors;
+    auto loop_start = [&]() {
+        size_t start = n;
+        for (const auto &sc : scopes) if (sc.loop) { start = sc.start; break; }
+        for (const auto &p : pending) start = std::min(start, p.start);
+        return start;
+    };
+
+    for (size_t k = 0; k < n; ++k) {
+        std::string_view x = t[k].text;
+        const bool after_do = closed_do;
+        closed_do = false;
+        if ((x == "for" || x == "while") && k + 1 < n && t[k + 1].text == "(") {
+            size_t close = lint_match(t, k + 1);
+            if (x == "while" && after_do) { k = close; continue; } // do { ... } while (cond);
+            if (close + 1 < n && t[close + 1].text == "{") { loop_header = k; next_is_do = false; }
+            else if (close + 1 < n) pending.push_back({k, scopes.size()});
+            k = close; // the header itself runs once (init) or is not the body
+            continue;
+        }
+        if (x == "do" && k + 1 < n && t[k + 1].text == "{") { loop_header = k; next_is_do = true; continue; }
+        if (x == "{") {
+            scopes.push_back({loop_header != n, loop_header, next_is_do});
+            loop_header = n;
+            next_is_do = false;
+            continue;
+        }
+        if (x == "}") {
+            if (!scopes.empty()) {
+                closed_do = scopes.back().is_do;
+                scopes.pop_back();
+            }
+            if (!pending.empty() && pending.back().depth == scopes.size() && !(k + 1 < n && t[k + 1].text == "else")) {
+                while (!pending.empty() && pending.back().depth == scopes.size()) pending.pop_back();
+            }
+            continue;
+        }
+        if (x == ";") {
+            while (!pending.empty() && pending.back().depth == scopes.size()) pending.pop_back();
+            continue;
+        }
+
+        if (!large.empty() && x == "(" && k > 0 && ascii::is_ident(t[k - 1].text[0]) &&
+            !not_a_function().count(t[k - 1].text)) {
+            // a parameter "[const] T name" or "[const] T" with T a large user type
+            const size_t close = lint_match(t, k);
+            size_t b = k + 1;
+            for (size_t m = k + 1; m <= close && m < n; ++m) {
+                if (m < close && t[m].text == "<") { m = lint_match(t, m); continue; }
+                if (m < close && t[m].text != ",") continue;
+                size_t e = m;
+                for (size_t q = b; q < m; ++q) if (t[q].text == "=") { e = q; break; }
+                size_t p = b;
+                while (p < e && (t[p].text == "const" || t[p].text == "volatile" || t[p].text == "struct" ||
+                                 t[p].text == "class")) ++p;
+                if (p < e && large.count(t[p].text) && (e - p == 1 || (e - p == 2 && ascii::is_ident(t[p + 1].text[0])))) {
+                    const string type(t[p].text);
+                    const TypeCost tc = defs.cost(t[p].text);
+                    report(t[p].line, "large-by-value",
+                         "'" + type + "' is passed by value: every call copies " +
+                             (tc.owning ? string("it, allocating for what it owns")
+                                        : "about " + std::to_string(tc.bytes) + " bytes"),
+                         "take 'const " + type + " &' (or '" + type + " &&' if the function keeps it)");
+                }
+                b = m + 1;
+            }
+        }
+
+        const size_t start = loop_start();
+        if (start == n) continue;
+        const int line = t[k].line;
+        if (x == "endl") {
+            report(line, "endl-in-loop", "'endl' in a loop flushes the stream on every iteration",
+                 "write '\\n' and let the stream flush when its buffer fills (or once after the loop)");
+        } else if (x == "new" && !(k > 0 && t[k - 1].text == "operator")) {
+            report(line, "new-in-loop", "'new' in a loop allocates on every iteration",
+                 "allocate once before the loop, or keep the objects by value in a container reserved up front");
+        } else if (x == "delete" && !(k > 0 && (t[k - 1].text == "operator" || t[k - 1].text == "="))) {
+            report(line, "delete-in-loop", "'delete' in a loop frees on every iteration",
+                 "reuse one allocation across iterations, or let a container or std::unique_ptr own the objects");
+        } else if (x == "dynamic_cast") {
+            report(line, "dynamic-cast-in-loop", "'dynamic_cast' in a loop searches the class hierarchy on every iteration",
+                 "cast once before the loop, or call a virtual function instead");
+        } else if ((x == "push_back" || x == "emplace_back") && k >= 2 && t[k - 1].text == "." &&
+                   !flagged_vectors.count(t[k - 2].text)) {
+            const std::string_view v = t[k - 2].text;
+            auto decl = vectors.find(v);
+            if (decl == vectors.end() || decl->second > start) continue; // not a vector, or a fresh one per iteration
+            auto res = reserved.find(v);
+            if (res != reserved.end() && res->second < start) continue;
+            flagged_vectors.insert(v);
+            const string name(v);
+            report(line, "push-back-without-reserve",
+                 "'" + name + "." + string(x) + "' in a loop grows '" + name +
+                     "' without a reserve(): it reallocates and moves its elements as it grows",
+                 "call " + name + ".reserve(n) before the loop when the number of elements is known");
+        }
+    }
+    std::stable_sort(findings.begin(), findings.end(),
+                     [](const LintFinding &a, const LintFinding &b) { return a.line < b.line; });
+    return findings;
+}
+
+std::vector<LintFinding> lint_user_keyword(const UserKeyword &uk) {
+    return lint_program(substitute_params(uk, {}));
+}
+
+std::string describe_finding(const LintFinding &finding) {
+    string out = "line " + std::to_string(finding.line);
+    if (!finding.tag.empty()) out += " [" + finding.tag + "]";
+    out += ": " + finding.message + "; " + finding.suggestion;
+    return out;
+}
+
+// -------------------- Built-in handlers (tag-aware) --------------------
+// For brevity and to preserve original behavior these are similar to previous implementations.
+// Each accepts a 'tag' string to reference the occurrence.
+
+static Parts handle_type_like(Context &ctx, const string &kw, const string &tag) {
+    Parts p;
+    string def_name = "x";
+    string def_value = (kw == "char") ? "'a'" : (kw == "bool" ? "true" : "0");
+    if (kw == "double") def_value = "3.14";
+    if (kw == "float") def_value = "2.5f";
+    if (kw == "long") def_value = "123456789L";
+    if (kw == "short") def_value = "42";
+    if (kw == "wchar_t") def_value = "L'a'";
+    if (kw == "char16_t") def_value = "u'a'";
+    if (kw == "char32_t") def_value = "U'a'";
+
+    string name = ask("[" + tag + "] Variable name for type '" + kw + "'", def_name);
+    string init = ask("[" + tag + "] Initial value for " + name, def_value);
+    string decl = declare_variable(ctx, kw, name, init);
+    p.body.push_back("// (" + tag + ") Demonstrate type: " + kw);
+    p.body.push_back(decl);
+    p.body.push_back("cout << \"" + ctx.last_var + " = \" << " + ctx.last_var + " << endl;");
+    return p;
+}
+
+static Parts handle_auto(Context &ctx, const string &tag) {
+    Parts p;
+    string init_default = ctx.last_var.empty() ? "42" : ctx.last_var;
+    string init = ask("[" + tag + "] Initializer expression for auto variable", init_default);
+    string name = ask("[" + tag + "] Variable name", "v");
+    string unique = name;
+    int suffix = 1;
+    while (ctx.vars.find(unique) != ctx.vars.end()) unique = name + std::to_string(suffix++);
+    p.body.push_back("// (" + tag + ") Demonstrate auto (type deduction)");
+    p.body.push_back("auto " + unique + " = " + init + ";");
+    ctx.vars[unique] = "auto";
+    ctx.last_var = unique;
+    p.body.push_back("cout << \"" + unique + " (deduced) = \" << " + unique + " << endl;");
+    return p;
+}
+
+static Parts handle_if_else(Context &ctx, const string &tag) {
+    Parts p;
+    string cond_default = ctx.last_var.empty() ? "x > 0" : (ctx.last_var + " > 0");
+    string cond = ask("[" + tag + "] Condition expression for if", cond_default);
+    string then_stmt = ask("[" + tag + "] Then-branch ", "cout << \"then\" << endl;");
+    string else_stmt = ask("[" + tag + "] Else-branch ", "cout << \"else\" << endl;");
+    p.body.push_back("// (" + tag + ") Demonstrate if/else");
+    p.body.push_back("if (" + cond + ") {");
+    p.body.push_back("    " + then_stmt);
+    p.body.push_back("} else {");
+    p.body.push_back("    " + else_stmt);
+    p.body.push_back("}");
+    return p;
+}
+
+static Parts handle_for(Context &ctx, const string &tag) {
+    Parts p;
+    string init = ask("[" + tag + "] Initializer for for-loop", "int i = 0");
+    string cond = ask("[" + tag + "] Condition for for-loop", "i < 5");
+    string incr = ask("[" + tag + "] Increment expression", "++i");
+    string body_stmt = ask("[" + tag + "] Body statement", "cout << i << '\\n';");
+    p.body.push_back("// (" + tag + ") Demonstrate for loop");
+    {
+        std::istringstream iss(init);
+        string t, n;
+        if (iss >> t >> n) {
+            size_t eq = n.find('=');
+            string varname = (eq==string::npos) ? n : n.substr(0, eq);
+            varname = normalize_token(varname);
+            if (!varname.empty()) { ctx.vars[varname] = t; ctx.last_var = varname; }
+        }
+    }
+    p.body.push_back(init + ";");
+    p.body.push_back("for (" + init + "; " + cond + "; " + incr + ") {");
+    p.body.push_back("    " + body_stmt);
+    p.body.push_back("}");
+    return p;
+}
+
+static Parts handle_while(Context &ctx, const string &tag) {
+    Parts p;
+    string init = ask("[" + tag + "] Initializer (e.g., int n = 3)", "int n = 3");
+    string cond = ask("[" + tag + "] Condition", "n-- > 0");
+    string body_stmt = ask("[" + tag + "] Loop body", "cout << n << '\\n';");
+    {
+        std::istringstream iss(init);
+        string t, n;
+        if (iss >> t >> n) {
+            size_t eqpos = n.find('=');
+            string varname = (eqpos==string::npos) ? n : n.substr(0, eqpos);
+            varname = normalize_token(varname);
+            if (!varname.empty()) { ctx.vars[varname] = t; ctx.last_var = varname; }
+        }
+    }
+    p.body.push_back("// (" + tag + ") Demonstrate while");
+    p.body.push_back(init + ";");
+    p.body.push_back("while (" + cond + ") {");
+    p.body.push_back("    " + body_stmt);
+    p.body.push_back("}");
+    return p;
+}
+
+static Parts handle_do(Context &ctx, const string &tag) {
+    Parts p;
+    string init = ask("[" + tag + "] Initializer (e.g., int n = 3)", "int n = 3");
+    string cond = ask("[" + tag + "] Condition (after body)", "n-- > 0");
+    string body_stmt = ask("[" + tag + "] Loop body", "cout << n << '\\n';");
+    {
+        std::istringstream iss(init);
+        string t, n;
+        if (iss >> t >> n) {
+            size_t eqpos = n.find('=');
+            string varname = (eqpos==string::npos) ? n : n.substr(0, eqpos);
+            varname = normalize_token(varname);
+            if (!varname.empty()) { ctx.vars[varname] = t; ctx.last_var = varname; }
+        }
+    }
+    p.body.push_back("// (" + tag + ") Demonstrate do/while");
+    p.body.push_back(init + ";");
+    p.body.push_back("do {");
+    p.body.push_back("    " + body_stmt);
+    p.body.push_back("} while (" + cond + ");");
+    return p;
+}
+
+static Parts handle_switch(Context &ctx, const string &tag) {
+    Parts p;
+    string init = ask("[" + tag + "] Initializer (e.g., int n = 2)", "int n = 2");
+    // try to register variable from initializer (like other handlers do)
+    {
+        std::istringstream iss(init);
+        string t, n;
+        if (iss >> t >> n) {
+            size_t eqpos = n.find('=');
+            string varname = (eqpos==string::npos) ? n : n.substr(0, eqpos);
+            varname = normalize_token(varname);
+            if (!varname.empty()) { ctx.vars[varname] = t; ctx.last_var = varname; }
+        }
+    }
+
+    string expr = ask("[" + tag + "] Expression to switch on", ctx.last_var.empty() ? "n" : ctx.last_var);
+    string cases = ask("[" + tag + "] Comma-separated case values", "1,2,3");
+    vector<string> case_list = split_csv(cases);
+
+    p.body.push_back("// (" + tag + ") Demonstrate switch");
+    p.body.push_back(init + ";");
+    p.body.push_back("switch (" + expr + ") {");
+
+    for (auto &c : case_list) {
+        // prompt for either a single-line or multiline body for this case
+        string single = ask("[" + tag + "] Single-line for case " + c + " (enter 'm' for multiline)", "cout << \"case " + c + "\" << endl; break;");
+        if (single == "m" || single == "M") {
+            // multiline mode
+            p.body.push_back("    case " + c + ":");
+            vector<string> lines = read_multiline_body("Enter lines for case " + c + " (finish with a single '.' on its own line):");
+            bool has_break = false;
+            for (auto &ln : lines) {
+                string tln = trim(ln);
+                p.body.push_back("        " + ln);
+                // simple detection of break; or return; to avoid appending an extra break
+                if (tln == "break;" || tln.rfind("break", 0) == 0 || tln.find("return ") == 0 || tln == "return;") has_break = true;
+            }
+            if (!has_break) p.body.push_back("        break;");
+        } else {
+            // single-line case: place the user's line directly (assume they include terminating ';' or break)
+            p.body.push_back("    case " + c + ": " + single);
+        }
+    }
+
+    p.body.push_back("    default: cout << \"default\" << endl; break;");
+    p.body.push_back("}");
+    return p;
+}
+
+static Parts handle_return(Context &ctx, const string &tag) {
+    Parts p;
+
+    // Disallow at top-level (no open control frames).
+    if (ctx.control_stack.empty()) {
+        p.body.push_back("// (" + tag + ") ERROR: 'return' is disallowed at top-level.");
+        p.body.push_back("// Allowed only inside an if/else, a loop (for/while/do), switch/case, try or catch block.");
+        return p;
+    }
+
+    // Walk innermost -> outer control frames and examine their header lines.
+    bool allowed = true;
+    std::string header;
+    for (int i = static_cast<int>(ctx.control_stack.size()) - 1; i >= 0; --i) {
+        const Parts &fp = ctx.control_stack[i].parts;
+
+        // Reuse repo helper to extract frame header.
+        std::vector<std::string> preceding;
+        std::vector<std::string> inner;
+        bool had_closing = false;
+        extract_block_header_and_inner(fp, preceding, header, inner, had_closing);
+
+        std::string h = trim(header);
+        if (h.empty()) continue;
+
+        // Normalize leading non-letters (handles " } else {" previews).
+        size_t pos = 0;
+        while (pos < h.size() && !ascii::is_alpha(h[pos])) ++pos;
+        std::string h2 = (pos < h.size()) ? h.substr(pos) : h;
+
+        // Allow only these constructs (checking start).
+        if (h2.rfind("if", 0) == 0 ||
+            h2.rfind("else", 0) == 0 ||
+            h2.rfind("for", 0) == 0 ||
+            h2.rfind("while", 0) == 0 ||
+            h2.rfind("do", 0) == 0 ||
+            h2.rfind("switch", 0) == 0 ||
+            h2.rfind("case ", 0) == 0 ||
+            h2.rfind("try", 0) == 0 ||
+            h2.rfind("catch", 0) == 0) {
+            allowed = false;
+            break;
+        }
+    }
+
+    if (!allowed) {
+        p.body.push_back("// (" + tag + ") ERROR: 'return' not inside an allowed construct.");
+        p.body.push_back("// Allowed only inside an if/else, a loop (for/while/do), switch/case, try or catch block.");
+    } else {
+        // Allowed — prompt ONCE for optional return expression.
+        std::string expr = ask("[" + tag + "] Return expression (leave empty for a bare 'return;')", "");
+
+        // Normalize: trim and drop a trailing semicolon if present.
+        if (!expr.empty()) {
+            expr = trim(expr);
+            if (!expr.empty() && expr.back() == ';') expr.pop_back();
+            expr = trim(expr);
+        }
+
+        p.body.push_back("// (" + tag + ") Inserted return");
+        if (expr.empty()) p.body.push_back("return;");
+        else p.body.push_back("return " + expr + ";");
+    }
+
+    return p;
+}
+
+static Parts handle_class_struct_union(Context &ctx, const string &kw, const string &tag) {
+    Parts p;
+    string name = ask("[" + tag + "] Name for " + kw, (kw == "union") ? "MyUnion" : "MyType");
+    string members = ask("[" + tag + "] Comma-separated members (name:type)", "value:int");
+    vector<string> mems = split_csv(members);
+    ctx.types.insert(name);
+    ctx.last_type = name;
+    if (kw == "union") {
+        std::ostringstream def;
+        def << "union " << name << " {";
+        for (auto &m : mems) {
+            auto pos = m.find(':');
+            string n = (pos == string::npos) ? m : m.substr(0,pos);
+            string t = (pos == string::npos) ? "int" : m.substr(pos+1);
+            def << "\n    " << t << " " << n << ";";
+        }
+        def << "\n};";
+        p.top.push_back(def.str());
+        string var = name + "_u";
+        string decl = declare_variable(ctx, name, var, "{}");
+        p.body.push_back("// (" + tag + ") Demonstrate union");
+        p.body.push_back(decl);
+        if (!mems.empty()) {
+            auto pos = mems[0].find(':');
+            string n = (pos == string::npos) ? mems[0] : mems[0].substr(0,pos);
+            p.body.push_back(ctx.last_var + "." + n + " = 123;");
+            p.body.push_back("cout << \"" + ctx.last_var + "." + n + " = \" << " + ctx.last_var + "." + n + " << endl;");
+        }
+        return p;
+    } else {
+        std::ostringstream def;
+        def << kw << " " << name << " {\npublic:\n";
+        for (auto &m : mems) {
+            auto pos = m.find(':');
+            string n = (pos == string::npos) ? m : m.substr(0,pos);
+            string t = (pos == string::npos) ? "int" : m.substr(pos+1);
+            def << "    " << t << " " << n << ";\n";
+        }
+        def << "    " << name << "(";
+        bool first = true;
+        for (auto &m : mems) {
+            auto pos = m.find(':');
+            string n = (pos == string::npos) ? m : m.substr(0,pos);
+            string t = (pos == string::npos) ? "int" : m.substr(pos+1);
+            if (!first) def << ", ";
+            def << t << " " << n << "_";
+            first = false;
+        }
+        def << ") : ";
+        first = true;
+        for (auto &m : mems) {
+            auto pos = m.find(':');
+            string n = (pos == string::npos) ? m : m.substr(0,pos);
+            if (!first) def << ", ";
+            def << n << "(" << n << "_)";
+            first = false;
+        }
+        def << " {}\n};";
+        p.top.push_back(def.str());
+        std::ostringstream usage;
+        usage << name << " obj(";
+        bool first2 = true;
+        for (auto &m : mems) {
+            if (!first2) usage << ", ";
+            auto pos = m.find(':');
+            string t = (pos == string::npos) ? "int" : m.substr(pos+1);
+            if (t == "string") usage << "\"hi\"";
+            else if (t == "double") usage << "3.14";
+            else usage << "0";
+            first2 = false;
+        }
+        usage << ");";
+        p.body.push_back("// (" + tag + ") Demonstrate " + kw);
+        p.body.push_back(usage.str());
+        if (!mems.empty()) {
+            auto pos = mems[0].find(':');
+            string n = (pos == string::npos) ? mems[0] : mems[0].substr(0,pos);
+            p.body.push_back("cout << \"obj." + n + " = \" << obj." + n + " << endl;");
+        }
+        for (auto &m : mems) if (m.find("string") != string::npos) p.includes.push_back("string");
+        return p;
+    }
+}
+
+static Parts handle_enum(Context &ctx, const string &tag) {
+    Parts p;
+    string name = ask("[" + tag + "] Enum name", "Color");
+    string items = ask("[" + tag + "] Comma-separated enumerators", "Red,Green,Blue");
+    vector<string> enumerators = split_csv(items);
+    ctx.types.insert(name);
+    ctx.last_type = name;
+    std::ostringstream def;
+    def << "enum class " << name << " { ";
+    for (size_t i = 0; i < enumerators.size(); ++i) {
+        if (i) def << ", ";
+        def << enumerators[i];
+    }
+    def << " };";
+    p.top.push_back(def.str());
+    p.body.push_back("// (" + tag + ") Demonstrate enum");
+    p.body.push_back(name + " c = " + name + "::" + enumerators.front() + ";");
+    p.body.push_back("cout << static_cast<int>(c) << endl;");
+    return p;
+}
+
+static Parts handle_template(Context &ctx, const string &tag) {
+    Parts p;
+    string kind = ask("[" + tag + "] Template kind ('function' or 'class')", "function");
+    if (kind == "class") {
+        string name = ask("[" + tag + "] Template class name", "Box");
+        string tparam = ask("[" + tag + "] Type parameter name", "T");
+        std::ostringstream def;
+        def << "template <typename " << tparam << ">\n";
+        def << "struct " << name << " { " << tparam << " value; " << name << "(" << tparam << " v) : value(v) {} };";
+        p.top.push_back(def.str());
+        p.body.push_back("// (" + tag + ") Demonstrate class template");
+        p.body.push_back(name + "<int> b(5);");
+        p.body.push_back("cout << b.value << endl;");
+        ctx.types.insert(name);
+        ctx.last_type = name;
+        return p;
+    } else {
+        string name = ask("[" + tag + "] Template function name", "add");
+        string tparam = ask("[" + tag + "] Type parameter name", "T");
+        std::ostringstream def;
+        def << "template <typename " << tparam << ">\n" << tparam << " " << name << "(" << tparam << " a, " << tparam << " b) { return a + b; }";
+        p.top.push_back(def.str());
+        p.body.push_back("// (" + tag + ") Demonstrate function template");
+        p.body.push_back("cout << " + name + "(2, 3) << endl;");
+        return p;
+    }
+}
+
+static Parts handle_cast(Context &, const string &castkw, const string &tag) {
+    Parts p;
+    if (castkw == "static_cast") {
+        string from = ask("[" + tag + "] Source expression (e.g., 3.14)", "3.14");
+        string to = ask("[" + tag + "] Target type (e.g., int)", "int");
+        p.body.push_back("// (" + tag + ") Demonstrate static_cast");
+        p.body.push_back(to + " v = static_cast<" + to + ">(" + from + ");");
+        p.body.push_back("cout << v << endl;");
+        return p;
+    } else if (castkw == "dynamic_cast") {
+        p.top.push_back("struct Base { virtual ~Base() = default; }; ");
+        p.top.push_back("struct Derived : Base { int x = 42; }; ");
+        p.body.push_back("// (" + tag + ") Demonstrate dynamic_cast");
+        p.body.push_back("Base* b = new Derived();");
+        p.body.push_back("if (Derived* d = dynamic_cast<Derived*>(b)) {");
+        p.body.push_back("    cout << \"dynamic_cast succeeded: \" << d->x << endl;");
+        p.body.push_back("} else {");
+        p.body.push_back("    cout << \"dynamic_cast failed\" << endl;");
+        p.body.push_back("}");
+        p.body.push_back("delete b;");
+        return p;
+    } else if (castkw == "const_cast") {
+        p.body.push_back("// (" + tag + ") Demonstrate const_cast (illustrative)");
+        p.body.push_back("const int ci = 10;");
+        p.body.push_back("int &r = const_cast<int&>(ci);");
+        p.body.push_back("r = 20; // undefined behavior but illustrative");
+        p.body.push_back("cout << \"ci (after const_cast attempt) = \" << ci << endl;");
+        return p;
+    } else {
+        p.body.push_back("// (" + tag + ") Demonstrate reinterpret_cast");
+        p.body.push_back("int x = 0x12345678;");
+        p.body.push_back("char* p = reinterpret_cast<char*>(&x);");
+        p.body.push_back("cout << \"First byte (interpretation): \" << static_cast<int>(p[0]) << endl;");
+        return p;
+    }
+}
+
+static Parts handle_new_delete(Context &, const string &tag) {
+    Parts p;
+    string typeName = ask("[" + tag + "] Type to allocate", "int");
+    string init = ask("[" + tag + "] Initial value", "42");
+    p.body.push_back("// (" + tag + ") Demonstrate new/delete");
+    p.body.push_back(typeName + "* p = new " + typeName + "(" + init + ");");
+    p.body.push_back("cout << \"*p = \" << *p << endl;");
+    p.body.push_back("delete p;");
+    return p;
+}
+
+static Parts handle_operator_keyword(Context &, const string &tag) {
+    Parts p;
+    string op = ask("[" + tag + "] Operator to demonstrate/overload (e.g. +, <<)", "+");
+    p.top.push_back("struct Point { int x, y; Point(int x_, int y_):x(x_),y(y_){} };");
+    if (op == "+") {
+        p.top.push_back("Point operator+(const Point& a, const Point& b) { return Point(a.x + b.x, a.y + b.y); }");
+        p.body.push_back("// (" + tag + ") Demonstrate operator+");
+        p.body.push_back("Point a(1,2), b(3,4);");
+        p.body.push_back("Point c = a + b;");
+        p.body.push_back("cout << \"c = (\" << c.x << \",\" << c.y << \")\" << endl;");
+    } else if (op == "<<") {
+        p.top.push_back("std::ostream& operator<<(std::ostream& os, const Point& p) { return os << '(' << p.x << ',' << p.y << ')'; }");
+        p.body.push_back("// (" + tag + ") Demonstrate operator<<");
+        p.body.push_back("Point a(1,2), b(3,4);");
+        p.body.push_back("cout << a << \" \" << b << endl;");
+    } else {
+        p.top.push_back("// (" + tag + ") Operator not specially implemented; showing operator+ instead");
+        p.top.push_back("Point operator+(const Point& a, const Point& b) { return Point(a.x + b.x, a.y + b.y); }");
+        p.body.push_back("Point a(1,2), b(3,4);");
+        p.body.push_back("Point c = a + b;");
+        p.body.push_back("cout << \"c = (\" << c.x << \",\" << c.y << \")\" << endl;");
+    }
+    return p;
+}
+
+static Parts handle_try_catch_throw(Context &, const string &tag) {
+    Parts p;
+    string msg = ask("[" + tag + "] Exception message to throw", "Something went wrong");
+    p.body.push_back("// (" + tag + ") Demonstrate try/catch/throw");
+    p.body.push_back("try {");
+    p.body.push_back("    throw std::runtime_error(\"" + msg + "\");");
+    p.body.push_back("} catch (const std::exception& e) {");
+    p.body.push_back("    cout << \"Caught: \" << e.what() << endl;");
+    p.body.push_back("}");
+    p.includes.push_back("stdexcept");
+    return p;
+}
+
+static Parts handle_constexpr(Context &, const string &tag) {
+    Parts p;
+    string expr = ask("[" + tag + "] Provide either a constexpr function or a constant expression", "int square(int x){return x*x;}");
+    if (expr.find('{') != string::npos) {
+        p.top.push_back("constexpr " + expr);
+        p.body.push_back("// (" + tag + ") Demonstrate constexpr function");
+        p.body.push_back("cout << square(5) << endl;");
+    } else {
+        p.body.push_back("// (" + tag + ") Demonstrate constexpr value");
+        p.body.push_back("constexpr auto v = " + expr + ";");
+        p.body.push_back("cout << v << endl;");
+    }
+    return p;
+}
+
+static Parts handle_static_assert(Context &, const string &tag) {
+    Parts p;
+    string cond = ask("[" + tag + "] Condition to assert at compile time", "sizeof(int) >= 4");
+    string msg = ask("[" + tag + "] Message for static_assert", "int_size_ok");
+    p.top.push_back("static_assert(" + cond + ", \"" + msg + "\");");
+    p.body.push_back("// (" + tag + ") static_assert present above; runtime note:");
+    p.body.push_back("cout << \"static_assert present; program compiled successfully\" << endl;");
+    return p;
+}
+
+static Parts handle_alignas_alignof(Context &ctx, const string &tag) {
+    Parts p;
+
+    // Questions
+    string struct_name = ask("[" + tag + "] Struct name", "Demo");
+    string struct_align_s = ask("[" + tag + "] Struct alignment in bytes (positive integer)", "16");
+    string fields_s = ask("[" + tag + "] Number of fields in struct", "5");
+
+    // parse numeric answers safely
+    int struct_align = 16;
+    int nfields = 5;
+    try { struct_align = std::stoi(struct_align_s); if (struct_align <= 0) struct_align = 16; } catch(...) {}
+    try { nfields = std::stoi(fields_s); if (nfields < 0) nfields = 0; } catch(...) {}
+
+    // typical sizes (x86_64 conventions)
+    auto typical_size = [](const string &t)->int {
+        if (t == "char") return 1;
+        if (t == "short") return 2;
+        if (t == "int") return 4;
+        if (t == "long") return 8;
+        if (t == "long long") return 8;
+        if (t == "float") return 4;
+        if (t == "double") return 8;
+        if (t == "bool") return 1;
+        // fallback: unknown types — use 0 to indicate unknown
+        return 0;
+    };
+
+    // collect fields
+    struct Field { string type; string name; int length; string align; };
+    vector<Field> fields;
+    for (int i = 0; i < nfields; ++i) {
+        string idx = std::to_string(i+1);
+        string typ = ask("[" + tag + "] Field #" + idx + " type", (i==0 ? "int" : (i==1 ? "int" : (i==2 ? "short" : (i==3 ? "char" : "char")))));
+        string name = ask("[" + tag + "] Field #" + idx + " name", "var" + idx);
+        string len_s = ask("[" + tag + "] Field #" + idx + " array length (0 = not an array)", "0");
+        int len = 0;
+        try { len = std::stoi(len_s); if (len < 0) len = 0; } catch(...) {}
+        string falign = ask("[" + tag + "] Field #" + idx + " alignment in bytes (empty = none)", "");
+        // normalize common synonyms
+        if (typ == "signed char") typ = "char";
+        if (typ == "unsigned char") typ = "char";
+        fields.push_back({typ, name, len, falign});
+    }
+
+    // register last variable name in context for consistency with other handlers
+    if (!fields.empty()) { ctx.vars[fields[0].name] = struct_name; ctx.last_var = fields[0].name; }
+
+    // Build struct declaration lines (multi-line, commented)
+    p.top.push_back(std::string("struct alignas(") + std::to_string(struct_align) + ") " + struct_name);
+    p.top.push_back("{");
+
+    for (auto &f : fields) {
+        // declaration
+        std::string decl = "    ";
+        if (!f.align.empty()) decl += "alignas(" + f.align + ") ";
+        decl += f.type + " " + f.name;
+        if (f.length > 0) decl += "[" + std::to_string(f.length) + "]";
+        decl += ";";
+
+        // comment with typical size and alignment note (if provided)
+        int tsize = typical_size(f.type);
+        std::string comment;
+        if (tsize > 0) {
+            comment = " // " + std::to_string(tsize) + " bytes";
+            if (f.length > 0) comment += " x " + std::to_string(f.length) + " elements";
+        } else {
+            comment = " // size: platform-dependent";
+            if (f.length > 0) comment += " x " + std::to_string(f.length) + " elements";
+        }
+        if (!f.align.empty()) comment += "; aligned to " + f.align + " bytes";
+
+        p.top.push_back(decl + comment);
+    }
+
+    p.top.push_back("");
+    p.top.push_back("    // example: an aligned sub-object (member) with explicit alignment");
+    // Optionally (nothing here) — we already allowed per-field alignas above.
+    p.top.push_back("};");
+
+    // Body: demonstration code
+    // instance name
+    string inst_name = ask("[" + tag + "] Instance name to create", "d");
+    ctx.vars[inst_name] = struct_name;
+    ctx.last_var = inst_name;
+
+    p.body.push_back("// (" + tag + ") Demonstrate alignas/alignof for " + struct_name);
+    p.body.push_back(struct_name + " " + inst_name + ";");
+    p.body.push_back(std::string("cout << \"alignof(") + struct_name + ") = \" << alignof(" + struct_name + ") << endl;");
+    p.body.push_back(std::string("cout << \"sizeof(") + struct_name + ") = \" << sizeof(" + struct_name + ") << endl;");
+    p.body.push_back(std::string("cout << \"address of ") + inst_name + " = \" << (void*)&" + inst_name + " << endl;");
+    p.body.push_back(std::string("cout << \"address mod ") + std::to_string(struct_align) + " = \" << (reinterpret_cast<uintptr_t>(&" + inst_name + ") % " + std::to_string(struct_align) + ") << endl;");
+
+    // If there are array members we can also instantiate an array of structs and print element addresses
+    string arr_count_s = ask("[" + tag + "] Create an array of instances? (enter count or 0 for single instance)", "3");
+    int arr_count = 0;
+    try { arr_count = std::stoi(arr_count_s); } catch(...) { arr_count = 0; }
+    if (arr_count > 0) {
+        p.body.push_back(struct_name + " arr_" + inst_name + "[" + std::to_string(arr_count) + "];");
+        p.body.push_back(std::string("cout << \"alignof(") + struct_name + ") = \" << alignof(" + struct_name + ") << endl;");
+        p.body.push_back(std::string("cout << \"sizeof(") + struct_name + ") = \" << sizeof(" + struct_name + ") << \", elements = " + std::to_string(arr_count) + "\" << endl;");
+        for (int i = 0; i < arr_count; ++i) {
+            p.body.push_back(std::string("cout << \"&arr_") + inst_name + "[" + std::to_string(i) + "] = \" << (void*)&arr_" + inst_name + "[" + std::to_string(i) + "]"
+                                  " << \", addr mod " + std::to_string(struct_align) + " = \" << (reinterpret_cast<uintptr_t>(&arr_" + inst_name + "[" + std::to_string(i) + "]) % " + std::to_string(struct_align) + ") << endl;");
+        }
+        if (arr_count > 1) {
+            p.body.push_back(std::string("cout << \"distance between element 0 and 1 = \" << (reinterpret_cast<uintptr_t>(&arr_") + inst_name + "[1]) - reinterpret_cast<uintptr_t>(&arr_" + inst_name + "[0])) << endl;");
+        }
+    }
+
+    // final note comment in generated code (informational)
+    p.body.push_back("// Note: sizes shown in comments are typical for x86_64 and may vary by platform/ABI.");
+
+    return p;
+}
+
+static Parts handle_thread_local(Context &, const string &tag) {
+    Parts p;
+    string name = ask("[" + tag + "] Thread-local variable name", "counter");
+    string init = ask("[" + tag + "] Initial value", "0");
+    p.top.push_back("thread_local int " + name + " = " + init + ";");
+    p.body.push_back("// (" + tag + ") Demonstrate thread_local");
+    p.body.push_back("cout << \"" + name + " = \" << " + name + " << endl;");
+    return p;
+}
+
+static Parts handle_mutable(Context &, const string &tag) {
+    Parts p;
+    string member = ask("[" + tag + "] Mutable member name", "cached");
+    p.top.push_back("struct S { mutable int " + member + " = 0; int value = 0; int get() const { return " + member + " = value; } }; ");
+    p.body.push_back("// (" + tag + ") Demonstrate mutable");
+    p.body.push_back("S s{0, 7};");
+    p.body.push_back("cout << \"get() = \" << s.get() << endl;");
+    return p;
+}
+
+static Parts handle_sizeof_typeid(Context &, const string &tag) {
+    Parts p;
+    string expr = ask("[" + tag + "] Expression or type to inspect", "int");
+    p.body.push_back("// (" + tag + ") Demonstrate sizeof and typeid");
+    p.body.push_back("cout << \"sizeof(" + expr + ") = \" << sizeof(" + expr + ") << endl;");
+    p.body.push_back("cout << \"typeid(" + expr + ").name() = \" << typeid(" + expr + ").name() << endl;");
+    p.includes.push_back("typeinfo");
+    return p;
+}
+
+static Parts handle_alternative_tokens(Context &ctx, const string &kw, const string &tag) {
+    Parts p;
+
+    // helper: check if type is integral
+    auto is_integral = [&](const string &t)->bool {
+        static const vector<string> ints = {
+            "char","signed char","unsigned char",
+            "short","unsigned short",
+            "int","unsigned int",
+            "long","unsigned long",
+            "long long","unsigned long long"
+        };
+        for (auto &s : ints) if (t == s) return true;
+        return false;
+    };
+
+    // helper: ask for name + type but enforce "integral only"
+    auto ask_integral = [&](const string &prefix, const string &def_name, const string &def_type){
+        string name = ask("[" + tag + "] " + prefix + " name", def_name);
+        string type;
+
+        while (true) {
+            type = ask("[" + tag + "] " + prefix + " type (integral only)", def_type);
+            if (is_integral(type)) break;
+            session_out() << "Type '" << type << "' is not integral. Allowed: int, long, short, char, unsigned..., etc.\n";
+        }
+        return std::pair<string,string>(type,name);
+    };
+
+    // utility: make a safe result variable name from components
+    auto make_res_name = [&](const string &a, const string &b, const string &suffix) {
+        return a + "_" + b + "_" + suffix;
+    };
+    auto make_res_name_unary = [&](const string &a, const string &suffix) {
+        return a + "_" + suffix;
+    };
+
+    // boolean alternative tokens: and / or / not
+    if (kw == "and" || kw == "or" || kw == "not") {
+        // For logical demonstrations we use bool variables for operands.
+        if (kw == "not") {
+            string name = ask("[" + tag + "] Variable name", "x");
+            string val  = ask("[" + tag + "] Initial boolean value (true/false)", "true");
+
+            // define operand
+            p.body.push_back("// (" + tag + ") Demonstrate 'not' (logical negation) with a variable");
+            p.body.push_back("bool " + name + " = " + val + ";");
+            // compute result into a variable
+            string res = make_res_name_unary(name, "not_res");
+            p.body.push_back("bool " + res + " = (not " + name + ");");
+            p.body.push_back("cout << \"" + res + " = \" << (" + res + " ? \"true\" : \"false\") << endl;");
+            // update context
+            ctx.vars[name] = "bool";
+            ctx.vars[res] = "bool";
+            ctx.last_var = res;
+            return p;
+        } else {
+            // and / or: two boolean operands
+            string a_name = ask("[" + tag + "] Left operand name", "x");
+            string a_val  = ask("[" + tag + "] Left operand initial boolean (true/false)", "true");
+            string b_name = ask("[" + tag + "] Right operand name", "y");
+            string b_val  = ask("[" + tag + "] Right operand initial boolean (true/false)", "false");
+
+            p.body.push_back("// (" + tag + ") Demonstrate '" + kw + "' (logical) using two bool variables");
+            p.body.push_back("bool " + a_name + " = " + a_val + ";");
+            p.body.push_back("bool " + b_name + " = " + b_val + ";");
+
+            // compute into a result variable
+            string res = make_res_name(a_name, b_name, "logic_res");
+            string op = (kw == "and") ? "and" : "or";
+            p.body.push_back("bool " + res + " = (" + a_name + " " + op + " " + b_name + ");");
+            p.body.push_back("cout << \"" + res + " = \" << (" + res + " ? \"true\" : \"false\") << endl;");
+            // update context
+            ctx.vars[a_name] = "bool";
+            ctx.vars[b_name] = "bool";
+            ctx.vars[res] = "bool";
+            ctx.last_var = res;
+            return p;
+        }
+    }
+
+    // bitwise binaries: xor, bitand, bitor
+    if (kw == "xor" || kw == "bitand" || kw == "bitor") {
+
+        auto L = ask_integral("Left operand", "a", "int");
+        auto R = ask_integral("Right operand", "b", "int");
+
+        string a_type = L.first, a_name = L.second;
+        string b_type = R.first, b_name = R.second;
+
+        string a_val = ask("[" + tag + "] Left operand initial value", "5");
+        string b_val = ask("[" + tag + "] Right operand initial value", "3");
+
+        // ensure variables exist
+        p.body.push_back("// (" + tag + ") Demonstrate alternative token '" + kw + "'");
+        p.body.push_back(a_type + " " + a_name + " = " + a_val + ";");
+        p.body.push_back(b_type + " " + b_name + " = " + b_val + ";");
+
+        // compute result into a named variable and print both the alternative-token expression and the symbolic expression
+        string res = make_res_name(a_name, b_name, "res");
+        // result type is same as operands
+        p.body.push_back(a_type + " " + res + " = (" + a_name + " " + (kw == "xor" ? "^" : (kw=="bitand" ? "&" : "|")) + " " + b_name + ");");
+
+        // print: first the alternative token form, then symbolic form (both refer to the computed result)
+        p.body.push_back("cout << \"" + a_name + " " + kw + " " + b_name + " = \" << " + res + " << endl;");
+        p.body.push_back("cout << \"" + a_name + " " + (kw=="xor" ? "^" : (kw=="bitand" ? "&" : "|")) + " " + b_name +
+                         " (symbol) = \" << " + res + " << endl;");
+
+        ctx.vars[a_name] = a_type;
+        ctx.vars[b_name] = b_type;
+        ctx.vars[res] = a_type;
+        ctx.last_var = res;
+        return p;
+    }
+
+    // unary: compl
+    if (kw == "compl") {
+        auto V = ask_integral("Variable", "x", "int");
+        string t = V.first, v = V.second;
+        string val = ask("[" + tag + "] Initial value", "42");
+
+        p.body.push_back("// (" + tag + ") Demonstrate 'compl' and '~' with a variable");
+        p.body.push_back(t + " " + v + " = " + val + ";");
+
+        // compute complemented result into named variable
+        string inv = make_res_name_unary(v, "compl_res");
+        p.body.push_back(t + " " + inv + " = (compl " + v + ");");
+        p.body.push_back("cout << \"" + inv + " (compl " + v + ") = \" << " + inv + " << endl;");
+        // show symbolic ~ form too but using same computed value
+        p.body.push_back("cout << \"~" + v + " = \" << " + inv + " << endl;");
+
+        ctx.vars[v] = t;
+        ctx.vars[inv] = t;
+        ctx.last_var = inv;
+        return p;
+    }
+
+    // not_eq: inequality (alternative token for '!=')
+    if (kw == "not_eq") {
+        auto L = ask_integral("Left operand", "x", "int");
+        string t = L.first, left = L.second;
+
+        string right_val = ask("[" + tag + "] Right operand/value", "0");
+        // ensure left variable exists
+        p.body.push_back("// (" + tag + ") Demonstrate 'not_eq' (inequality) with a computed bool result");
+        p.body.push_back(t + " " + left + " = 1; // example");
+        // compute comparison result into a bool variable
+        string cmp = make_res_name_unary(left, "not_eq_res");
+        p.body.push_back("bool " + cmp + " = (" + left + " not_eq " + right_val + ");");
+        p.body.push_back("cout << \"" + cmp + " ( " + left + " not_eq " + right_val + ") = \" << (" + cmp + " ? \"true\" : \"false\") << endl;");
+
+        ctx.vars[left] = t;
+        ctx.vars[cmp] = "bool";
+        ctx.last_var = cmp;
+        return p;
+    }
+
+    // compound: and_eq, or_eq, xor_eq
+    if (kw == "and_eq" || kw == "or_eq" || kw == "xor_eq") {
+        auto V = ask_integral("Variable to modify", "v", "int");
+        string t = V.first, v = V.second;
+
+        string val = ask("[" + tag + "] Initial value", "15");
+        string rhs = ask("[" + tag + "] RHS value", "6");
+
+        p.body.push_back("// (" + tag + ") Demonstrate '" + kw + "' with before/after variables");
+        // create explicit before variable so every value has a variable
+        string before = make_res_name_unary(v, "before");
+        p.body.push_back(t + " " + before + " = " + val + ";");
+        p.body.push_back(t + " " + v + " = " + before + ";");
+        // compute RHS into its own variable
+        string rhs_name = make_res_name_unary(v, "rhs");
+        p.body.push_back(t + " " + rhs_name + " = " + rhs + ";");
+
+        // print before
+        p.body.push_back("cout << \"before: " + before + " = \" << " + before + " << endl;");
+
+        // perform the compound operation on v (which was initialized from before)
+        string sym = (kw=="and_eq") ? "&=" : (kw=="or_eq" ? "|=" : "^=");
+        p.body.push_back(v + " " + kw + " " + rhs_name + ";");
+
+        // assign after to an explicit after variable
+        string after = make_res_name_unary(v, "after");
+        p.body.push_back(t + " " + after + " = " + v + ";");
+
+        // print after using the after variable
+        p.body.push_back(std::string("cout << \"after (" + v + " " + sym + " " + rhs_name + "): \" << ") + after + " << endl;");
+
+        // update context
+        ctx.vars[before] = t;
+        ctx.vars[v] = t;
+        ctx.vars[rhs_name] = t;
+        ctx.vars[after] = t;
+        ctx.last_var = after;
+        return p;
+    }
+
+    // fallback
+    p.body.push_back("// (" + tag + ") Unknown alternative token");
+    p.body.push_back(std::string("cout << \"Alternative token: ") + kw + "\" << endl;");
+    return p;
+}
+
+static Parts handle_generic_with_body(Context &, const string &kw, const string &tag) {
+    Parts p;
+    session_out() << "[" << tag << "] No tailored snippet for '" << kw << "'. Please paste a small code fragment." << endl;
+    vector<string> lines = read_multiline_body("Finish the fragment with a single '.' on its own line:");
+    bool has_main = false;
+    for (auto &l : lines) if (l.find("int main(") != string::npos) { has_main = true; break; }
+    if (has_main) {
+        std::ostringstream ss;
+        for (auto &l : lines) ss << l << "\n";
+        p.top.push_back(ss.str());
+        p.body.push_back("// (" + tag + ") User provided a full program above; no extra main content added.");
+    } else {
+        for (auto &l : lines) p.body.push_back(l);
+    }
+    return p;
+}
+
+// -------------------- Additional handlers for previously unmapped keywords --------------------
+
+static Parts handle_extern(Context &, const string &tag) {
+    Parts p;
+    string decl = ask("[" + tag + "] Declaration to treat as 'extern' (e.g. int x)", "int external_value");
+    p.top.push_back("extern " + decl + ";");
+    p.body.push_back("// (" + tag + ") Demonstrate extern declaration above; at runtime we just note it.");
+    p.body.push_back("cout << \"extern declaration inserted: \" << \"" + decl + "\" << endl;");
+    return p;
+}
+
+static Parts handle_inline(Context &, const string &tag) {
+    Parts p;
+    string sig = ask("[" + tag + "] Inline function signature (without body)", "int foo()");
+    string body = ask("[" + tag + "] Inline function body single statement", "return 42;");
+    p.top.push_back("inline " + sig + " { " + body + " }");
+    p.body.push_back("// (" + tag + ") Demonstrate inline function above and call it:");
+    // attempt to derive a function name
+    string fname = sig;
+    size_t pos = fname.find('(');
+    if (pos != string::npos) fname = fname.substr(0, pos);
+    size_t sp = fname.find_last_of(' ');
+    if (sp != string::npos) fname = fname.substr(sp+1);
+    p.body.push_back("cout << " + fname + "() << endl;");
+    return p;
+}
+
+static Parts handle_register(Context &ctx, const string &tag) {
+    Parts p;
+    string decl = ask("[" + tag + "] Variable declaration using 'register' (e.g. int i = 0)", "int i = 0");
+    p.body.push_back("// (" + tag + ") Demonstrate register (historical, may be ignored by modern compilers)");
+    p.body.push_back("register " + decl + ";");
+    // record variable if possible
+    std::istringstream iss(decl);
+    string t, n;
+    if (iss >> t >> n) {
+        size_t eq = n.find('=');
+        string varname = (eq==string::npos) ? n : n.substr(0, eq);
+        varname = normalize_token(varname);
+        if (!varname.empty()) { ctx.vars[varname] = t; ctx.last_var = varname; }
+    }
+    p.body.push_back("cout << \"register var processed.\" << endl;");
+    return p;
+}
+
+static Parts handle_asm(Context &, const string &tag) {
+    Parts p;
+    string code = ask("[" + tag + "] Inline assembly snippet (single string)", "\"nop\"");
+    p.body.push_back("// (" + tag + ") Demonstrate asm (platform dependent; illustrative)");
+    p.body.push_back("asm(" + code + ");");
+    p.body.push_back("cout << \"Inserted asm snippet.\" << endl;");
+    return p;
+}
+
+static Parts handle_goto(Context &, const string &tag) {
+    Parts p;
+    string label = ask("[" + tag + "] Label name to create/jump to", "L1");
+    p.body.push_back("// (" + tag + ") Demonstrate goto (use sparingly)");
+    p.body.push_back(label + ": ;");
+    p.body.push_back("goto " + label + ";");
+    p.body.push_back("cout << \"Performed goto to label " + label + "\" << endl;");
+    return p;
+}
+
+static Parts handle_break_continue(Context &, const string &kw, const string &tag) {
+    Parts p;
+
+    // Basic loop parameters
+    string loop_type = ask("[" + tag + "] Loop type to demonstrate (for / while / do-while)", "for");
+    string start = ask("[" + tag + "] Start index (integer)", "0");
+    string step  = ask("[" + tag + "] Step (increment, integer)", "1");
+    string iterations = ask("[" + tag + "] Number of iterations to demonstrate", "5");
+    string trigger = ask("[" + tag + "] Iteration index that triggers '" + kw + "' (integer)", "2");
+    string print_before = ask("[" + tag + "] Execute user body before the trigger check? (y/n)", "y");
+    string custom_msg = ask("[" + tag + "] Message to print when '" + kw + "' occurs (empty = default)", "");
+    if (custom_msg.empty()) custom_msg = (kw == "break") ? ("Breaking at i=" + trigger) : ("Continuing at i=" + trigger);
+
+    // Read user-supplied loop content (multiline). Signature: vector<string> read_multiline_body(const string &)
+    vector<string> user_lines = read_multiline_body("[" + tag + "] Enter loop body lines (use {i} for index); finish with a single '.' line");
+
+    // If user provided no lines, supply a sensible default
+    if (user_lines.empty()) user_lines.push_back("cout << i << endl;");
+
+    // Detect if user body already contains 'break' or 'continue' to avoid duplicate automatic insertion
+    bool user_has_control = false;
+    for (const auto &ln : user_lines) {
+        if (ln.find("break") != string::npos || ln.find("continue") != string::npos) {
+            user_has_control = true;
+            break;
+        }
+    }
+
+    // Helpers
+    auto replace_all = [](string s, const string &from, const string &to) {
+        size_t pos = 0;
+        while ((pos = s.find(from, pos)) != string::npos) {
+            s.replace(pos, from.length(), to);
+            pos += to.length();
+        }
+        return s;
+    };
+
+    auto emit_user_body = [&](Parts &out) {
+        for (const auto &ln : user_lines) {
+            string replaced = replace_all(ln, "{i}", "i");
+            out.body.push_back("    " + replaced);
+        }
+    };
+
+    // Header
+    p.body.push_back("// (" + tag + ") Demonstrate '" + kw + "' inside a " + loop_type + " loop");
+
+    string end_expr = "(" + start + " + " + iterations + ")";
+    bool check_before = (!print_before.empty() && (print_before[0] == 'y' || print_before[0] == 'Y'));
+
+    // Emit loops; if user already included control, do not auto-insert trigger check
+    auto emit_trigger_stmt = [&](Parts &out) {
+        if (user_has_control) return; // user supplied their own break/continue
+        if (check_before) {
+            if (kw == "break") out.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; break; }");
+            else               out.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; continue; }");
+        } else {
+            // when printing after, trigger is emitted after user body — handled by callers
+        }
+    };
+
+    if (loop_type == "for" || loop_type == "For" || loop_type == "FOR") {
+        p.body.push_back("for (int i = " + start + "; i < " + end_expr + "; i += " + step + ") {");
+        if (check_before) {
+            emit_trigger_stmt(p);
+            emit_user_body(p);
+        } else {
+            emit_user_body(p);
+            if (!user_has_control) {
+                if (kw == "break") p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; break; }");
+                else               p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; continue; }");
+            }
+        }
+        p.body.push_back("}");
+    }
+    else if (loop_type == "while" || loop_type == "While" || loop_type == "WHILE") {
+        p.body.push_back("int i = " + start + ";");
+        p.body.push_back("while (i < " + end_expr + ") {");
+        if (check_before) {
+            emit_trigger_stmt(p);
+            emit_user_body(p);
+        } else {
+            emit_user_body(p);
+            if (!user_has_control) {
+                if (kw == "break") p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; break; }");
+                else               p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; i += " + step + "; continue; }");
+            }
+        }
+        p.body.push_back("    i += " + step + ";");
+        p.body.push_back("}");
+    }
+    else if (loop_type == "do-while" || loop_type == "Do-while" || loop_type == "DO-WHILE") {
+        p.body.push_back("int i = " + start + ";");
+        p.body.push_back("do {");
+        if (check_before) {
+            emit_trigger_stmt(p);
+            emit_user_body(p);
+        } else {
+            emit_user_body(p);
+            if (!user_has_control) {
+                if (kw == "break") p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; break; }");
+                else               p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; i += " + step + "; continue; }");
+            }
+        }
+        p.body.push_back("    i += " + step + ";");
+        p.body.push_back("} while (i < " + end_expr + ");");
+    }
+    else {
+        // fallback to simple for-loop
+        p.body.push_back("// Unrecognized loop type; falling back to for-loop demonstration");
+        p.body.push_back("for (int i = " + start + "; i < " + end_expr + "; ++i) {");
+        if (check_before) {
+            emit_trigger_stmt(p);
+            emit_user_body(p);
+        } else {
+            emit_user_body(p);
+            if (!user_has_control) {
+                if (kw == "break") p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; break; }");
+                else               p.body.push_back("    if (i == " + trigger + ") { cout << \"" + custom_msg + "\" << endl; continue; }");
+            }
+        }
+        p.body.push_back("}");
+    }
+
+    return p;
+}
+
+static Parts handle_export(Context &, const string &tag) {
+    Parts p;
+    p.body.push_back("// (" + tag + ") 'export' keyword is largely historical in header/module contexts; illustrative only");
+    p.body.push_back("cout << \"export (illustrative)\" << endl;");
+    return p;
+}
+
+// -------------------- New handlers for requested standard keywords --------------------
+
+static Parts handle_const(Context &, const string &tag) {
+    Parts p;
+    string type = ask("[" + tag + "] Type for const variable", "int");
+    string name = ask("[" + tag + "] Name for const variable", "kValue");
+    string val = ask("[" + tag + "] Initial value for " + name, "100");
+    p.body.push_back("// (" + tag + ") Declare and use a meaningful const variable");
+    p.body.push_back("const " + type + " " + name + " = " + val + ";");
+    p.body.push_back("cout << \"" + name + " = \" << " + name + " << endl;");
+    return p;
+}
+
+static Parts handle_decltype(Context &, const string &tag) {
+    Parts p;
+    string expr = ask("[" + tag + "] An expression to inspect with decltype", "42");
+    string name = ask("[" + tag + "] Variable name to declare with decltype", "y");
+    p.body.push_back("// (" + tag + ") Use decltype to deduce the type of an expression and declare a variable");
+    p.body.push_back("decltype(" + expr + ") " + name + " = " + expr + ";");
+    p.body.push_back("cout << \"declared var '" + name + "' = \" << " + name + " << endl;");
+    return p;
+}
+
+static Parts handle_explicit(Context &, const string &tag) {
+    Parts p;
+    string cls = ask("[" + tag + "] Class name to create with explicit constructor", "Number");
+    p.top.push_back("struct " + cls + " { int v; explicit " + cls + "(int x):v(x){} int get() const { return v; } }; ");
+    p.body.push_back("// (" + tag + ") Use explicit constructor to avoid implicit conversions; construct explicitly");
+    p.body.push_back(cls + " n(" + ask("[" + tag + "] Constructor argument for " + cls, "7") + ");");
+    p.body.push_back("cout << \"" + cls + "::get() = \" << n.get() << endl;");
+    return p;
+}
+
+static Parts handle_bool_literal(Context &, const string &kw, const string &tag) {
+    Parts p;
+    string name = ask("[" + tag + "] Name for bool variable", "flag");
+    string val = (kw == "true") ? "true" : "false";
+    p.body.push_back("// (" + tag + ") Demonstrate boolean literal '" + val + "' stored and checked meaningfully");
+    p.body.push_back("bool " + name + " = " + val + ";");
+    p.body.push_back("if (" + name + ") cout << \"" + name + " is true\" << endl; else cout << \"" + name + " is false\" << endl;");
+    return p;
+}
+
+static Parts handle_friend(Context &, const string &tag) {
+    Parts p;
+    string cls = ask("[" + tag + "] Class name to create with a friend accessor", "Box");
+    p.top.push_back("struct " + cls + " { private: int secret = 99; public: friend int reveal(const " + cls + "& b); };");
+    p.top.push_back("int reveal(const " + cls + "& b) { return b.secret; }");
+    p.body.push_back("// (" + tag + ") Use friend function to access private member meaningfully");
+    p.body.push_back(cls + " b;" );
+    p.body.push_back("cout << \"friend reveal = \" << reveal(b) << endl;");
+    return p;
+}
+
+static Parts handle_namespace(Context &, const string &tag) {
+    Parts p;
+    string ns = ask("[" + tag + "] Namespace name to create", "myns");
+    string fname = ask("[" + tag + "] Function name inside namespace", "answer");
+    string ret = ask("[" + tag + "] Integer result the function should return", "123");
+    std::ostringstream ss;
+    ss << "namespace " << ns << " { int " << fname << "() { return " << ret << "; } }";
+    p.top.push_back(ss.str());
+    p.body.push_back("// (" + tag + ") Call a namespaced function and use its result meaningfully");
+    p.body.push_back("cout << \"namespace::function() = \" << " + ns + "::" + fname + "() << endl;");
+    return p;
+}
+
+static Parts handle_noexcept(Context &, const string &tag) {
+    Parts p;
+    string fname = ask("[" + tag + "] Name for noexcept function", "safe_func");
+    string ret = ask("[" + tag + "] Integer value to return from function", "7");
+    p.top.push_back("int " + fname + "() noexcept { return " + ret + "; }");
+    p.body.push_back("// (" + tag + ") Call noexcept function and use result");
+    p.body.push_back("cout << \"noexcept result = \" << " + fname + "() << endl;");
+    return p;
+}
+
+static Parts handle_nullptr(Context &, const string &tag) {
+    Parts p;
+    string type = ask("[" + tag + "] Pointer type to demonstrate (e.g. int)", "int");
+    p.body.push_back("// (" + tag + ") Demonstrate nullptr usage and safe check before dereference");
+    p.body.push_back(type + "* p = nullptr;");
+    p.body.push_back("if (p == nullptr) { cout << \"pointer is nullptr, allocating and assigning\" << endl; p = new " + type + "(42); cout << *p << endl; delete p; } else cout << *p << endl;");
+    return p;
+}
+
+static Parts handle_access_specifiers(Context &, const string &, const string &tag) {
+    Parts p;
+    string cls = ask("[" + tag + "] Class name to create", "C");
+    std::ostringstream def;
+    def << "struct " << cls << " {\n"
+        << "private:\n"
+        << "    int priv = 1;\n"
+        << "protected:\n"
+        << "    int prot = 2;\n"
+        << "public:\n"
+        << "    int pub = 3;\n"
+        << "    int get_priv() const { return priv; }\n"
+        << "    int get_prot() const { return prot; }\n"
+        << "};";
+    p.top.push_back(def.str());
+    p.body.push_back("// (" + tag + ") Use accessors to read private/protected/public members meaningfully");
+    p.body.push_back(cls + " o;");
+    // Single valid C++ statement string
+    p.body.push_back("cout << \"pub=\" << o.pub << \", priv=\" << o.get_priv() << \", prot=\" << o.get_prot() << endl;");
+    return p;
+}
+
+static Parts handle_static(Context &, const string &tag) {
+    Parts p;
+    string fname = ask("[" + tag + "] Function name to hold a static counter", "counter_func");
+    p.top.push_back("int " + fname + "() { static int cnt = 0; return ++cnt; }");
+    p.body.push_back("// (" + tag + ") Demonstrate static local lifetime across calls");
+    p.body.push_back("cout << \"call1=\" << " + fname + "() << \", call2=\" << " + fname + "() << endl;");
+    return p;
+}
+
+static Parts handle_this(Context &, const string &tag) {
+    Parts p;
+    string cls = ask("[" + tag + "] Class name to create that uses this", "Thing");
+    p.top.push_back("struct " + cls + " { int v = 0; void set(int x) { this->v = x; } int get() const { return v; } }; ");
+    p.body.push_back("// (" + tag + ") Use this-> to refer to members inside methods and show effect");
+    p.body.push_back(cls + " t; t.set(" + ask("[" + tag + "] Value to set via this->", "9") + ");");
+    p.body.push_back("cout << \"this-> set value = \" << t.get() << endl;");
+    return p;
+}
+
+static Parts handle_typedef_typename(Context &, const string &kw, const string &tag) {
+    Parts p;
+    if (kw == "typedef") {
+        string orig = ask("[" + tag + "] Original type to alias", "long");
+        string alias = ask("[" + tag + "] Alias name", "LInt");
+        p.top.push_back("typedef " + orig + " " + alias + ";");
+        p.body.push_back("// (" + tag + ") Use typedef alias to declare a variable meaningfully");
+        p.body.push_back(alias + " v = 123456789L; cout << v << endl;");
+    } else {
+        string tparam = ask("[" + tag + "] Template parameter type to use with typename (e.g. T)", "T");
+        std::ostringstream def;
+        def << "template <typename " << tparam << ">\nstruct Holder { " << tparam << " value; Holder(" << tparam << " v):value(v){} };";
+        p.top.push_back(def.str());
+        p.body.push_back("// (" + tag + ") Use typename in a template context: instantiate Holder<int>");
+        p.body.push_back("Holder<int> h(5); cout << h.value << endl;");
+    }
+    return p;
+}
+
+static Parts handle_using(Context &, const string &tag) {
+    Parts p;
+    string kind = ask("[" + tag + "] 'alias' or 'directive'?", "alias");
+    if (kind == "directive") {
+        string ns = ask("[" + tag + "] Namespace to bring in (e.g. std)", "std");
+        p.body.push_back("// (" + tag + ") Demonstrate using-directive (note: program already uses namespace std globally)");
+        p.body.push_back("cout << \"using directive for namespace " + ns + " noted.\" << endl;");
+    } else {
+        string orig = ask("[" + tag + "] Original type to alias (e.g. std::string)", "std::string");
+        string alias = ask("[" + tag + "] Alias name", "Str");
+        p.top.push_back("using " + alias + " = " + orig + ";");
+        p.body.push_back("// (" + tag + ") Use alias in main meaningfully");
+        p.body.push_back(alias + " s = \"hi\"; cout << s << endl;");
+    }
+    return p;
+}
+
+static Parts handle_virtual(Context &, const string &tag) {
+    Parts p;
+    p.top.push_back("struct BaseV { virtual ~BaseV() = default; virtual int id() const { return 1; } }; ");
+    p.top.push_back("struct DerivedV : BaseV { int id() const override { return 2; } }; ");
+    p.body.push_back("// (" + tag + ") Demonstrate virtual dispatch via base pointer to derived instance");
+    p.body.push_back("BaseV* b = new DerivedV(); cout << \"virtual id=\" << b->id() << endl; delete b;");
+    return p;
+}
+
+static Parts handle_void(Context &, const string &tag) {
+    Parts p;
+    string fname = ask("[" + tag + "] Function name that returns void", "doit");
+    string stmt = ask("[" + tag + "] Statement inside the void function (single)", "cout << \"did it\" << endl;");
+    p.top.push_back("void " + fname + "() { " + stmt + " }");
+    p.body.push_back("// (" + tag + ") Call void function for its side-effect");
+    p.body.push_back(fname + "();");
+    return p;
+}
+
+static Parts handle_volatile(Context &, const string &tag) {
+    Parts p;
+    string type = ask("[" + tag + "] Type to declare volatile variable (e.g. int)", "int");
+    p.body.push_back("// (" + tag + ") Demonstrate volatile qualification for a variable that may change externally");
+    p.body.push_back("volatile " + type + " v = 0; cout << \"volatile v initial=\" << v << endl; v = 1; cout << \"volatile v after change=\" << v << endl;");
+    return p;
+}
+
+// --- Helper: parse param list entered as "name=default, other=val" into vector<pair>
+static std::vector<std::pair<std::string,std::string>> parse_param_list(const std::string &in) {
+    std::vector<std::pair<std::string,std::string>> out;
+    std::string cur;
+    size_t i = 0, n = in.size();
+    while (i < n) {
+        // collect until comma
+        cur.clear();
+        while (i < n && in[i] != ',') {
+            cur.push_back(in[i]);
+            i++;
+        }
+        // skip comma
+        if (i < n && in[i] == ',') i++;
+        std::string_view item = trim_view(cur);
+        if (item.empty()) continue;
+        size_t eq = item.find('=');
+        if (eq == std::string_view::npos) out.emplace_back(std::string(item), std::string{});
+        else out.emplace_back(trim(item.substr(0, eq)), trim(item.substr(eq + 1)));
+    }
+    return out;
+}
+
+// -------------------- Dispatcher per occurrence, updated to support user keywords with params ------
+
+// NOTE: this variant:
+//  - preserves exact token order across lines,
+//  - ignores tokens inside quotes/comments,
+//  - substitutes nested bodies inline at the token position,
+//  - prompts to define previously-undefined unquoted tokens (one prompt per unique token per top-level expansion),
+//  - detects recursion and avoids cycles.
+// Looks keywords up with find_user_keyword (the db's UserKeywordMap, then ctx.shared).
+static Parts generate_parts_for_keyword_occurrence(const std::string &kw,
+                                                   Context &ctx,
+                                                   int occurrence_index,
+                                                   int token_pos_in_input,
+                                                   UserKeywordDb &db,
+                                                   std::unordered_set<std::string> *active = nullptr) {
+    std::ostringstream t;
+    t << "occurrence " << occurrence_index << " (token " << token_pos_in_input << ")";
+    std::string tag = t.str();
+
+    // Prepare active recursion tracking set
+    std::unordered_set<std::string> local_active;
+    std::unordered_set<std::string> *active_ptr = active ? active : &local_active;
+
+    // Cycle detection
+    if (active_ptr->count(kw)) {
+        session_out() << "[" << tag << "] Detected recursive keyword reference for '" << kw
+                  << "'. Skipping nested expansion to avoid infinite recursion.\n";
+        return handle_generic_with_body(ctx, kw, tag);
+    }
+    active_ptr->insert(kw);
+
+    // 1) If user-defined: ask for its parameters and generate its raw parts (placeholders substituted)
+    const UserKeyword *found = find_user_keyword(db, ctx, kw);
+    Parts p;
+    LexedSnippet scratch;
+    const LexedSnippet *lx = nullptr;
+    if (found) {
+        const UserKeyword &uk = *found;
+        std::map<std::string,std::string> values;
+        for (const auto &pp : uk.params) {
+            const std::string &pname = pp.first;
+            const std::string &pdef  = pp.second;
+            std::string val = ask("[" + tag + "] Value for parameter '" + pname + "'", pdef);
+            values[pname] = val;
+        }
+        lx = &lexed_snippet_for(uk, values, scratch);
+        if (lx->has_main) {
+            active_ptr->erase(kw);
+            return user_snippet_with_main(tag);
+        }
+        // #include lines go before main(), not into the body
+        for (const auto &line : lx->lines) {
+            if (line.is_include && !line.include.empty()) p.includes.push_back(line.include);
+        }
+    }
+
+    // If not user-defined, handle builtins
+    if (!found) {
+        // handle built-in keywords (same as previous function) — keep exhaustive list
+        const std::string k = kw;
+        if (k == "int" || k == "double" || k == "float" || k == "char" ||
+            k == "long" || k == "short" || k == "signed" || k == "unsigned" ||
+            k == "bool" || k == "wchar_t" || k == "char16_t" || k == "char32_t")
+            { active_ptr->erase(kw); return handle_type_like(ctx, k, tag); }
+        if (k == "auto") { active_ptr->erase(kw); return handle_auto(ctx, tag); }
+        if (k == "if" || k == "else") { active_ptr->erase(kw); return handle_if_else(ctx, tag); }
+        if (k == "for") { active_ptr->erase(kw); return handle_for(ctx, tag); }
+        if (k == "while") { active_ptr->erase(kw); return handle_while(ctx, tag); }
+        if (k == "do") { active_ptr->erase(kw); return handle_do(ctx, tag); }
+        if (k == "switch" || k == "case") { active_ptr->erase(kw); return handle_switch(ctx, tag); }
+        if (k == "return") { active_ptr->erase(kw); return handle_return(ctx, tag); }
+        if (k == "class" || k == "struct" || k == "union") { active_ptr->erase(kw); return handle_class_struct_union(ctx, k, tag); }
+        if (k == "enum") { active_ptr->erase(kw); return handle_enum(ctx, tag); }
+        if (k == "template") { active_ptr->erase(kw); return handle_template(ctx, tag); }
+        if (k == "static_cast" || k == "dynamic_cast" || k == "const_cast" || k == "reinterpret_cast") { active_ptr->erase(kw); return handle_cast(ctx, k, tag); }
+        if (k == "new" || k == "delete") { active_ptr->erase(kw); return handle_new_delete(ctx, tag); }
+        if (k == "operator") { active_ptr->erase(kw); return handle_operator_keyword(ctx, tag); }
+        if (k == "try" || k == "catch" || k == "throw") { active_ptr->erase(kw); return handle_try_catch_throw(ctx, tag); }
+        if (k == "constexpr") { active_ptr->erase(kw); return handle_constexpr(ctx, tag); }
+        if (k == "static_assert") { active_ptr->erase(kw); return handle_static_assert(ctx, tag); }
+        if (k == "alignas" || k == "alignof") { active_ptr->erase(kw); return handle_alignas_alignof(ctx, tag); }
+        if (k == "thread_local") { active_ptr->erase(kw); return handle_thread_local(ctx, tag); }
+        if (k == "mutable") { active_ptr->erase(kw); return handle_mutable(ctx, tag); }
+        if (k == "sizeof" || k == "typeid") { active_ptr->erase(kw); return handle_sizeof_typeid(ctx, tag); }
+        if (k == "and" || k == "or" || k == "not" || k == "xor" ||
+            k == "bitand" || k == "bitor" || k == "compl" || k == "not_eq" || k == "and_eq" || k == "or_eq" || k == "xor_eq")
+            { active_ptr->erase(kw); return handle_alternative_tokens(ctx, k, tag); }
+        if (k == "extern") { active_ptr->erase(kw); return handle_extern(ctx, tag); }
+        if (k == "inline") { active_ptr->erase(kw); return handle_inline(ctx, tag); }
+        if (k == "register") { active_ptr->erase(kw); return handle_register(ctx, tag); }
+        if (k == "asm") { active_ptr->erase(kw); return handle_asm(ctx, tag); }
+        if (k == "goto") { active_ptr->erase(kw); return handle_goto(ctx, tag); }
+        if (k == "export") { active_ptr->erase(kw); return handle_export(ctx, tag); }
+        if (k == "const") { active_ptr->erase(kw); return handle_const(ctx, tag); }
+        if (k == "decltype") { active_ptr->erase(kw); return handle_decltype(ctx, tag); }
+        if (k == "explicit") { active_ptr->erase(kw); return handle_explicit(ctx, tag); }
+        if (k == "true" || kw == "false") { active_ptr->erase(kw); return handle_bool_literal(ctx, kw, tag); }
+        if (k == "friend") { active_ptr->erase(kw); return handle_friend(ctx, tag); }
+        if (k == "break" || k == "continue") { active_ptr->erase(kw); return handle_break_continue(ctx, k, tag); }
+        if (k == "namespace") { active_ptr->erase(kw); return handle_namespace(ctx, tag); }
+        if (k == "noexcept") { active_ptr->erase(kw); return handle_noexcept(ctx, tag); }
+        if (k == "nullptr") { active_ptr->erase(kw); return handle_nullptr(ctx, tag); }
+        if (k == "private" || k == "protected" || k == "public") { active_ptr->erase(kw); return handle_access_specifiers(ctx, k, tag); }
+        if (k == "static") { active_ptr->erase(kw); return handle_static(ctx, tag); }
+        if (k == "this") { active_ptr->erase(kw); return handle_this(ctx, tag); }
+        if (k == "typedef" || k == "typename") { active_ptr->erase(kw); return handle_typedef_typename(ctx, k, tag); }
+        if (k == "using") { active_ptr->erase(kw); return handle_using(ctx, tag); }
+        if (k == "virtual") { active_ptr->erase(kw); return handle_virtual(ctx, tag); }
+        if (k == "void") { active_ptr->erase(kw); return handle_void(ctx, tag); }
+        if (k == "volatile") { active_ptr->erase(kw); return handle_volatile(ctx, tag); }
+
+        // fallback for unknown builtins
+        active_ptr->erase(kw);
+        return handle_generic_with_body(ctx, kw, tag);
+    }
+
+    // At this point: lx holds the lexed user-defined snippet (placeholders substituted).
+    // We'll perform inline expansion: walk its lines' tokens left-to-right and replace identifiers in-place
+    // with their expansions. We will also prompt to define unknown unquoted tokens.
+
+    // Keep a set of tokens we already processed (so we only prompt/expand a unique token once per top-level expansion).
+    std::unordered_set<std::string> processed_tokens;
+    // For merging includes while preserving order of discovery:
+    auto append_include_if_new = [&](const std::string &inc) {
+        if (std::find(p.includes.begin(), p.includes.end(), inc) == p.includes.end())
+            p.includes.push_back(inc);
+    };
+
+    // Gather C++ keywords set
+    const auto &kwset = cpp17_keywords();
+
+    // We'll build the new body lines as we go, starting with a note on the substitution.
+    std::vector<std::string> new_body_lines;
+    new_body_lines.push_back("// (" + tag + ") User-defined snippet (with parameter substitution):");
+
+    for (const LexedLine &line : lx->lines) {
+        if (line.is_include) continue;
+        // Start current_lines with one empty working line
+        std::vector<std::string> current_lines(1, std::string{});
+
+        std::string seg; // segment builder for non-token text
+        for (size_t ti = line.first; ti < line.last; ++ti) {
+            const SnippetToken &tok = lx->tokens[ti];
+            const std::string_view token = std::string_view(lx->text).substr(tok.begin, tok.size);
+            if (tok.kind == SnippetToken::TEXT) {
+                seg += token;
+                continue;
+            }
+            // flush current text segment to current_lines
+            if (!seg.empty()) {
+                for (auto &ln : current_lines) ln += seg;
+                seg.clear();
+            }
+            std::string norm = normalize_token(token);
+            if (norm.empty()) {
+                // only underscores: nothing to look up
+                for (auto &ln : current_lines) ln += token;
+                continue;
+            }
+
+            // If we've already processed this token earlier in this top-level call, reuse its expansion (no new prompt)
+            if (processed_tokens.count(norm)) {
+                // If it's known user keyword or known built-in, we need to get its expanded parts:
+                Parts nested;
+                if (find_user_keyword(db, ctx, norm)) {
+                    nested = generate_parts_for_keyword_occurrence(norm, ctx, 0, 0, db, active_ptr);
+                } else if (kwset.find(norm) != kwset.end()) {
+                    // built-in; call handler once
+                    nested = generate_parts_for_keyword_occurrence(norm, ctx, 0, 0, db, active_ptr);
+                } else {
+                    // unknown but previously declined or otherwise skipped -> append raw token
+                    for (auto &ln : current_lines) ln += token;
+                    continue;
+                }
+                // Merge includes (in discovery order)
+                for (const auto &inc : nested.includes) append_include_if_new(inc);
+                // Inline-append nested.body into current_lines
+                if (!nested.body.empty()) {
+                    // append first nested line to every current working line, push remainder as extra lines
+                    for (auto &ln : current_lines) ln += nested.body[0];
+                    for (size_t bi = 1; bi < nested.body.size(); ++bi) new_body_lines.push_back(nested.body[bi]);
+                    // if there were multiple current_lines, coalesce them before continuing
+                    if (!new_body_lines.empty()) {
+                        // prepend existing current_lines content into new_body_lines front if needed
+                        // flush current_lines aggregated into new_body_lines
+                        for (auto &cl : current_lines) {
+                            new_body_lines.insert(new_body_lines.begin(), cl);
+                        }
+                        // reset current_lines to a single empty line to continue
+                        current_lines.clear();
+                        current_lines.emplace_back("");
+                    }
+                } else {
+                    // nothing to insert, keep token text
+                    for (auto &ln : current_lines) ln += token;
+                }
+                continue;
+            }
+
+            // If token is a known user keyword or a C++ keyword -> expand (this may prompt)
+            if (find_user_keyword(db, ctx, norm) || kwset.find(norm) != kwset.end()) {
+                session_out() << "[" << tag << "] Nested token detected in snippet: '" << norm << "'.\n";
+                Parts nested = generate_parts_for_keyword_occurrence(norm, ctx, 0, 0, db, active_ptr);
+                // Merge includes
+                for (const auto &inc : nested.includes) append_include_if_new(inc);
+                // Inline-append nested.body into current_lines
+                if (!nested.body.empty()) {
+                    for (auto &ln : current_lines) ln += nested.body[0];
+                    for (size_t bi = 1; bi < nested.body.size(); ++bi) {
+                        new_body_lines.push_back(nested.body[bi]);
+                    }
+                    if (!new_body_lines.empty()) {
+                        for (auto &cl : current_lines) {
+                            new_body_lines.insert(new_body_lines.begin(), cl);
+                        }
+                        current_lines.clear();
+                        current_lines.emplace_back("");
+                    }
+                }
+                processed_tokens.insert(norm);
+                continue;
+            }
+
+            // Unknown unquoted token: prompt user whether to create a definition now
+            {
+                std::string q = "[" + tag + "] Token '" + std::string(token) + "' is used in snippet but not defined. Define it now? (y/N)";
+                std::string resp = ctx.offer_definitions ? ask(q, "n") : "n";
+                if (!resp.empty() && (resp == "y" || resp == "Y" || resp == "yes" || resp == "Yes")) {
+                    // Ask for param list (comma-separated "name=default" pairs)
+                    std::string params_raw = ask("Enter parameters (format: name=default,other=val) or leave blank for none", "");
+                    auto parsed = parse_param_list(params_raw);
+
+                    // Ask for a multi-line snippet: user finishes by typing 'QED' on its own line.
+                    std::vector<std::string> lines;
+                    try {
+                        lines = read_multiline_body("Enter the snippet for '" + std::string(token) + "'. Finish with a single 'QED' on its own line:");
+                    } catch (const EOFExit &) {
+                        session_out() << "[" << tag << "] EOF while reading snippet — aborting new-definition flow for '" << token << "'.\n";
+                        // leave token verbatim and mark processed to avoid repeated asking
+                        for (auto &ln : current_lines) ln += token;
+                        processed_tokens.insert(norm);
+                        continue;
+                    }
+
+                    // Join lines into multi-line snippet representation expected by your UserKeyword structure.
+                    // If your UserKeyword stores snippet as a single string with embedded newlines:
+                    std::string snippet_joined;
+                    for (size_t li = 0; li < lines.size(); ++li) {
+                        snippet_joined += lines[li];
+                        if (li + 1 < lines.size()) snippet_joined += "\n";
+                    }
+
+                    // Build UserKeyword entry and insert into user_keywords
+                    UserKeyword newuk;
+                    newuk.snippet = snippet_joined;
+                    newuk.params = parsed;
+                    put_user_keyword(db, norm, std::move(newuk));
+
+                    // Persist immediately so future top-level expansions (or program runs) will not prompt again
+                    if (!save_user_keywords(db, ctx.db_path)) {
+                        session_out() << "[" << tag << "] Warning: failed to save new user keyword '" << token << "' to disk.\n";
+                    }
+
+                    // Now expand it (this will prompt for its params)
+                    Parts nested = generate_parts_for_keyword_occurrence(norm, ctx, 0, 0, db, active_ptr);
+
+                    // Merge includes
+                    for (const auto &inc : nested.includes) append_include_if_new(inc);
+                    // Inline-append nested.body into current_lines
+                    if (!nested.body.empty()) {
+                        for (auto &ln : current_lines) ln += nested.body[0];
+                        for (size_t bi = 1; bi < nested.body.size(); ++bi) {
+                            new_body_lines.push_back(nested.body[bi]);
+                        }
+                        if (!new_body_lines.empty()) {
+                            for (auto &cl : current_lines) {
+                                new_body_lines.insert(new_body_lines.begin(), cl);
+                            }
+                            current_lines.clear();
+                            current_lines.emplace_back("");
+                        }
+                    }
+                    processed_tokens.insert(norm);
+                    continue;
+                } else {
+                    // user declined: leave token verbatim
+                    for (auto &ln : current_lines) ln += token;
+                    processed_tokens.insert(norm); // avoid asking again
+                    continue;
+                }
+            }
+        } // end for tokens in line
+
+        // flush any remaining seg text into current_lines
+        if (!seg.empty()) {
+            for (auto &ln : current_lines) ln += seg;
+            seg.clear();
+        }
+
+        // finished processing this original line; commit current_lines and any new_body_lines into new_body_lines
+        // If there is content in current_lines, append them to new_body_lines in order
+        for (auto &ln : current_lines) new_body_lines.push_back(ln);
+        // Note: new_body_lines already accumulated any extra nested lines inserted mid-line.
+
+    } // end for each snippet line
+
+    // Final merged includes already inserted into p.includes; replace p.body with new_body_lines
+    p.body = std::move(new_body_lines);
+
+    // Unmark current keyword as active
+    active_ptr->erase(kw);
+
+    return p;
+}
+
+// -------------------- Tokenization --------------------
+
+// Whitespace-separated words, as `iss >> word` would split them.
+static vector<string> tokenize(std::string_view line) {
+    vector<string> out;
+    out.reserve(16);
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && ascii::is_space(line[i])) ++i;
+        size_t b = i;
+        while (i < line.size() && !ascii::is_space(line[i])) ++i;
+        if (i > b) out.emplace_back(line.substr(b, i - b));
+    }
+    return out;
+}
+
+// -------------------- Interactive define flow --------------------
+
+UserKeyword prompt_user_keyword_definition() {
+    // parameters
+    string params_line = ask("Provide parameters (format: name=default,other=val) or leave blank", "");
+    vector<std::pair<string,string>> params;
+    if (!params_line.empty()) {
+        auto parts = split_csv(params_line);
+        for (auto &p : parts) {
+            size_t eq = p.find('=');
+            string pname = trim((eq==string::npos)?p:p.substr(0,eq));
+            string pdef = trim((eq==string::npos)?"":p.substr(eq+1));
+            if (!pname.empty()) params.emplace_back(pname, pdef);
+        }
+    }
+    session_out() << "Paste the snippet that demonstrates this custom keyword. You may use placeholders {name}.\n";
+    vector<string> snippet_lines = read_multiline_body("End with a single 'QED' on new line:");
+    std::ostringstream ss;
+    for (auto &l : snippet_lines) ss << l << "\n";
+    UserKeyword uk;
+    uk.snippet = ss.str();
+    uk.params = std::move(params);
+    return uk;
+}
+
+// -------------------- Generator --------------------
+
+Generator::Generator(string db_path) : db_path_(std::move(db_path)) {}
+
+void Generator::load(bool refresh_image) {
+    load_user_keywords(db_, db_path_, refresh_image);
+}
+
+bool Generator::save() const {
+    return save_user_keywords(db_, db_path_);
+}
+
+void Generator::set_shared(std::shared_ptr<const UserKeywordDb> shared) {
+    shared_ = std::move(shared);
+}
+
+GenerateResult Generator::generate(const string &line, const AnswerProvider &answers, const GenerateOptions &opts) {
+    GenerateResult res;
+    std::ostream discard(nullptr);
+    SessionIO io{&answers, opts.log ? opts.log : &discard};
+    // route prompts/notes of this call (and any nested one) to the caller
+    struct Guard {
+        SessionIO *prev;
+        explicit Guard(SessionIO *cur) : prev(t_session) { t_session = cur; }
+        ~Guard() { t_session = prev; }
+    } guard(&io);
+    std::ostream &log = *io.out;
+    using clock = std::chrono::steady_clock;
+    clock::time_point stage_start = clock::now();
+
+    UserKeywordMap &user_keywords = db_.entries;
+    const auto &kwset = cpp17_keywords();
+    auto is_user_keyword = [&](const string &name) {
+        return user_keywords.count(name) || (shared_ && shared_->entries.count(name));
+    };
+    // tokenize input and offer to define any unknown tokens that look like custom keywords
+    vector<string> tokens = tokenize(line);
+    if (opts.offer_definitions) {
+        try {
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                string norm = normalize_token(tokens[i]);
+                if (norm.empty()) continue;
+                // if it's not a standard keyword and not already a stored user keyword,
+                // and it looks like an identifier (starts with alpha or '_'), offer to define or skip
+                if (kwset.find(norm) == kwset.end() && !is_user_keyword(norm)) {
+                    // check identifier-like
+                    if (ascii::is_alpha(norm[0]) || norm[0] == '_') {
+                        string choice = ask("Token '" + norm + "' is not a C++17 or stored custom keyword. Define it now? (y to define / s to skip)", "s");
+                        if (choice == "y" || choice == "Y") {
+                            // run a tiny define flow that mirrors :add for this single keyword
+                            put_user_keyword(db_, norm, prompt_user_keyword_definition());
+                            if (save()) {
+                                log << "Custom keyword '" << norm << "' saved to disk with " << user_keywords[norm].params.size() << " parameter(s).\n";
+                            } else {
+                                log << "Failed to save custom keywords to disk.\n";
+                            }
+                        } else {
+                            // skip this token silently
+                            log << "Skipping token '" << norm << "'.\n";
+                        }
+                    }
+                }
+            }
+        } catch (const EOFExit&) {
+            res.aborted = true;
+            res.error = "EOF received during custom-keyword definition prompt";
+            return res;
+        }
+    }
+
+    // now build occurrences (includes newly-defined user keywords)
+    res.occurrences.reserve(tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        string norm = normalize_token(tokens[i]);
+        if (norm.empty()) continue;
+        if (kwset.find(norm) != kwset.end() || is_user_keyword(norm)) {
+            res.occurrences.emplace_back(norm, static_cast<int>(i + 1));
+        }
+    }
+
+    res.timings.tokenize = clock::now() - stage_start;
+    if (res.occurrences.empty()) {
+        res.error = "No recognized C++17 or user-defined keyword found in the input";
+        return res;
+    }
+
+    log << "\nDetected occurrences in order:";
+    for (size_t i = 0; i < res.occurrences.size(); ++i) {
+        log << " [" << (i+1) << "] '" << res.occurrences[i].first << "'(token " << res.occurrences[i].second << ")";
+    }
+    log << "\n\n";
+
+    // collect parts for each occurrence
+    stage_start = clock::now();
+    Context ctx;
+    ctx.db_path = db_path_;
+    ctx.offer_definitions = opts.offer_definitions;
+    ctx.shared = shared_ ? &shared_->entries : nullptr;
+    Parts aggregated;
+    TopIndex top_index;
+    try {
+        for (size_t i = 0; i < res.occurrences.size(); ++i) {
+            const string &kw = res.occurrences[i].first;
+            int token_pos = res.occurrences[i].second;
+            int occ_index = static_cast<int>(i + 1);
+            log << "--- Asking about keyword occurrence " << occ_index << ": '" << kw << "' (token " << token_pos << ") ---\n";
+            Parts p = generate_parts_for_keyword_occurrence(kw, ctx, occ_index, token_pos, db_);
+            merge_top(top_index, aggregated, p, ctx,
+                      "occurrence " + std::to_string(occ_index) + " (token " + std::to_string(token_pos) + ")", log);
+            append_parts_with_nesting(aggregated, p, ctx, kw);
+            log << "\n";
+        }
+    } catch (const EOFExit&) {
+        res.aborted = true;
+        res.error = "EOF received during follow-up prompts";
+        return res;
+    }
+
+    // flush any remaining open control blocks so they appear in the final output
+    if (!ctx.control_stack.empty()) {
+        log << "Flushing " << ctx.control_stack.size() << " open control block(s) to output.\n";
+        flush_control_stack(aggregated, ctx);
+    }
+
+    res.timings.expand = clock::now() - stage_start;
+
+    // assemble final program
+    stage_start = clock::now();
+    vector<int> top_lines;
+    res.program = make_program_from_body_lines(aggregated.body, aggregated.includes, aggregated.top, &top_lines);
+    res.timings.assemble = clock::now() - stage_start;
+    res.ok = true;
+
+    // declarations before main() have no tag comments: tag them by the occurrence that emitted them
+    auto tag_top = [&](int line, string &tag) {
+        if (!tag.empty() || line == 0) return;
+        auto it = std::upper_bound(top_lines.begin(), top_lines.end(), line);
+        if (it == top_lines.begin()) return;
+        size_t k = static_cast<size_t>(it - top_lines.begin()) - 1;
+        if (k < top_index.tags.size()) tag = top_index.tags[k];
+    };
+    if (opts.validate) {
+        stage_start = clock::now();
+        res.issues = validate_program(res.program);
+        for (auto &is : res.issues) tag_top(is.line, is.tag);
+        res.timings.validate = clock::now() - stage_start;
+    }
+    if (opts.lint) {
+        stage_start = clock::now();
+        res.lint = lint_program(res.program, ctx.types);
+        for (auto &f : res.lint) tag_top(f.line, f.tag);
+        res.timings.lint = clock::now() - stage_start;
+    }
+    return res;
+}
+
+bool Generator::generate(const string &line, const AnswerProvider &answers, string &program_out) {
+    GenerateResult res = generate(line, answers);
+    if (!res.ok) return false;
+    program_out = std::move(res.program);
+    return true;
+}
+
+} // namespace snippetgen
@@ -0,0 +1,352 @@
+/*
+snippetgen — in-process library behind the keyword-driven C++17 snippet generator.
+
+The interactive tool (snippet_gen.cpp) is a thin CLI over this library. Embedders
+load the keyword database once into a Generator and call generate() per request;
+every follow-up question is routed to an AnswerProvider instead of stdin, so a
+request costs one in-process call rather than a process spawn and a DB parse.
+*/
+
+#ifndef SNIPPETGEN_H
+#define SNIPPETGEN_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <iosfwd>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace snippetgen {
+
+// EOF signal during prompts.
+struct EOFExit : public std::runtime_error {
+    EOFExit() : std::runtime_error("EOF received during prompt") {}
+};
+
+// -------------------- Prompting --------------------
+
+// One follow-up question asked while generating.
+struct Prompt {
+    std::string question;      // text shown to an interactive user (without the "[default]: " suffix)
+    std::string default_value; // what an empty reply selects
+    bool body_line = false;    // collecting a multi-line body; the reply "QED" ends it
+};
+
+// Supplies replies to prompts. Return the reply line (empty = take the default)
+// or nullopt for end of input, which aborts the current request with EOFExit.
+using AnswerProvider = std::function<std::optional<std::string>(const Prompt &)>;
+
+// Prompts on std::cout and reads replies from std::cin (the interactive CLI).
+AnswerProvider stdio_answers();
+// Accepts every default and ends multi-line bodies immediately.
+AnswerProvider default_answers();
+
+// Ask with a default; routes through the answer provider of the current
+// generate() call, or stdio when called outside one.
+std::string ask(const std::string &prompt, const std::string &def);
+// Read lines until a single 'QED' line; throws EOFExit on end of input.
+std::vector<std::string> read_multiline_body(const std::string &instruction =
+    "Enter lines, finish with a single 'QED' on its own line:");
+
+// -------------------- String helpers shared with the CLI --------------------
+
+// ASCII character classes from one 256-entry table, so the hot scanners do not
+// go through the C locale as std::isspace/std::ispunct/std::tolower do. Bytes
+// >= 0x80 belong to no class. The classes match the "C" locale; '_' is
+// punctuation there, which normalize_token relies on.
+namespace ascii {
+
+enum : unsigned char { SPACE = 1, DIGIT = 2, LOWER = 4, UPPER = 8, UNDERSCORE = 16, PUNCT = 32 };
+
+constexpr std::array<unsigned char, 256> make_class_table() {
+    std::array<unsigned char, 256> t{};
+    for (int c = 0; c < 256; ++c) {
+        unsigned char k = 0;
+        if (c == ' ' || (c >= '\t' && c <= '\r')) k |= SPACE;
+        else if (c >= '0' && c <= '9') k |= DIGIT;
+        else if (c >= 'a' && c <= 'z') k |= LOWER;
+        else if (c >= 'A' && c <= 'Z') k |= UPPER;
+        else if (c > ' ' && c < 0x7f) k |= PUNCT;
+        if (c == '_') k |= UNDERSCORE;
+        t[static_cast<size_t>(c)] = k;
+    }
+    return t;
+}
+inline constexpr std::array<unsigned char, 256> class_table = make_class_table();
+
+constexpr bool has(char c, unsigned char classes) { return (class_table[static_cast<unsigned char>(c)] & classes) != 0; }
+constexpr bool is_space(char c) { return has(c, SPACE); }
+constexpr bool is_digit(char c) { return has(c, DIGIT); }
+constexpr bool is_alpha(char c) { return has(c, LOWER | UPPER); }
+constexpr bool is_alnum(char c) { return has(c, LOWER | UPPER | DIGIT); }
+constexpr bool is_ident(char c) { return has(c, LOWER | UPPER | DIGIT | UNDERSCORE); }
+constexpr bool is_punct(char c) { return has(c, PUNCT); }
+constexpr char to_lower(char c) { return has(c, UPPER) ? static_cast<char>(c - 'A' + 'a') : c; }
+
+} // namespace ascii
+
+// The views point into the argument; they allocate nothing.
+std::string_view trim_view(std::string_view s);
+std::string_view trim_leading_view(std::string_view s);
+std::string_view trim_trailing_view(std::string_view s);
+std::string_view strip_punct_view(std::string_view s); // drop leading/trailing punctuation
+void lowercase_inplace(std::string &s);
+
+std::string trim(std::string_view s);
+// Punctuation stripped, lowercased: the name a token is looked up under.
+std::string normalize_token(std::string_view token);
+std::vector<std::string> split_csv(const std::string &s);
+const std::unordered_set<std::string>& cpp17_keywords();
+// 64-bit FNV-1a; pass a previous result as `h` to hash several pieces as one.
+uint64_t fnv1a64(std::string_view data, uint64_t h = 1469598103934665603ull);
+
+// -------------------- Keyword database --------------------
+
+extern const char *USER_KW_FILE;
+extern const char *USER_KW_DELTA_FILE;
+
+struct LexedSnippet; // defined in snippetgen.cpp
+
+// Represents a user-defined keyword with its snippet and parameters (name, default)
+struct UserKeyword {
+    std::string snippet;                                // raw multiline snippet
+    std::vector<std::pair<std::string,std::string>> params; // ordered list of (name, default)
+    uint64_t rev = 0;                                   // database version of the last change
+    // The snippet with its parameter defaults substituted, lexed once when the
+    // entry is loaded or stored (put_user_keyword) and shared by copies. Nested
+    // expansion with default values walks these tokens instead of re-scanning.
+    std::shared_ptr<const LexedSnippet> lexed;
+};
+
+// Approximate heap bytes of a lexed snippet: the shared block, the text and
+// source copies, the token and line vectors. 0 for nullptr.
+size_t lexed_snippet_bytes(const LexedSnippet *lx);
+
+// Use a hash-map for user keywords for O(1) average lookup
+using UserKeywordMap = std::unordered_map<std::string, UserKeyword>;
+
+// The persisted keyword set plus the version bookkeeping used for deltas.
+// Every change bumps `version` and stamps it into the entry (or its tombstone).
+struct UserKeywordDb {
+    UserKeywordMap entries;
+    uint64_t version = 0;
+    // `version` at the last delta export or import. Entries and tombstones
+    // newer than this are local changes the other side has not seen.
+    uint64_t synced = 0;
+    std::map<std::string, uint64_t> deleted; // name -> version at which it was deleted
+    // The names in `entries`, sorted. Every function below that changes
+    // `entries` keeps it in step; code changing `entries` directly must too.
+    std::set<std::string, std::less<>> index;
+};
+
+void read_user_keywords(std::istream &in, UserKeywordDb &out);
+void write_user_keywords(std::ostream &os, const UserKeywordDb &db, uint64_t since = 0);
+// refresh_image: rewrite a missing or stale fast-start image ("<path>.img").
+// Read-only loaders (servers, tenants, replicas) pass false.
+void load_user_keywords(UserKeywordDb &db, const std::string &path = USER_KW_FILE, bool refresh_image = true);
+bool save_user_keywords(const UserKeywordDb &db, const std::string &path = USER_KW_FILE);
+void put_user_keyword(UserKeywordDb &db, const std::string &name, UserKeyword uk);
+bool erase_user_keyword(UserKeywordDb &db, const std::string &name);
+// Names in db.index starting with `prefix` (all names for an empty prefix), in
+// name order: at most `limit` of them after skipping the first `offset`.
+// `total` receives the number of names starting with `prefix`.
+std::vector<std::string> list_user_keywords(const UserKeywordDb &db, std::string_view prefix,
+                                            size_t offset, size_t limit, size_t &total);
+// Both record db.version as the last sync (db.synced); save afterwards to keep it.
+long export_user_keywords_delta(UserKeywordDb &db, uint64_t since, const std::string &path = USER_KW_DELTA_FILE);
+// Delta entries that would overwrite or delete a local change newer than the
+// last sync are not applied; their names go to `conflicts` when given.
+long import_user_keywords_delta(UserKeywordDb &db, const std::string &path = USER_KW_DELTA_FILE,
+                                std::vector<std::string> *conflicts = nullptr);
+
+// Process-wide counts of load_user_keywords calls served from the fast-start
+// image versus parsed from text (missing files are not counted).
+struct DbLoadStats {
+    uint64_t image_hits = 0;
+    uint64_t image_misses = 0;
+};
+DbLoadStats db_load_stats();
+
+// Journal for read replicas: while "<db>.journal" exists, every
+// save_user_keywords appends the changes since its previous record, so
+// replicas can follow the writer without reloading the whole database.
+std::string keyword_journal_path(const std::string &db_path);
+// Start (or restart) the journal with a record holding the whole database.
+bool init_keyword_journal(const UserKeywordDb &db, const std::string &db_path);
+
+struct JournalRecord {
+    UserKeywordDb changes;      // entries and tombstones, with the writer's revisions
+    uint64_t version = 0;       // writer's database version after this record
+    int64_t committed_ms = 0;   // writer's wall clock at commit, ms since the epoch
+    bool restart = false;       // first record of a re-initialized journal: the whole database
+};
+
+// Reads a journal incrementally, remembering how far it got.
+class JournalTailer {
+public:
+    explicit JournalTailer(std::string path);
+    // Append the records committed since the last call to `out`. A record
+    // still being written is left for a later call. When the journal was
+    // re-initialized (a new epoch, or it shrank) since the last call, reading
+    // starts over and the first record is marked `restart`. Returns false if
+    // the journal cannot be opened.
+    bool read_new(std::vector<JournalRecord> &out);
+    // Newest committed version seen so far.
+    uint64_t head_version() const { return head_; }
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+    uint64_t offset_ = 0; // just past the last complete record
+    uint64_t head_ = 0;
+    std::string epoch_;   // the journal's ===JOURNAL:...=== line when last read
+};
+
+// Apply one record to a replica's database, keeping the writer's revisions.
+// Records (and entries) at or below db.version are already there and skipped.
+// A restart record replaces the database, even at a lower version (the writer
+// restored an older database and re-initialized the journal).
+// Returns true if the record changed the database.
+bool apply_journal_record(UserKeywordDb &db, const JournalRecord &rec);
+
+enum class ImportConflict { Skip, Overwrite, Rename };
+
+struct ImportReport {
+    size_t files = 0;
+    size_t added = 0;
+    size_t replaced = 0;
+    size_t renamed = 0;
+    size_t skipped = 0;
+    std::vector<std::string> problems; // rejected entries / unreadable files
+};
+
+ImportReport import_user_keyword_packs(UserKeywordDb &db, const std::string &root, ImportConflict policy);
+
+// Interactive define flow shared by :add and the unknown-token prompt: asks for
+// the parameter list and the snippet body.
+UserKeyword prompt_user_keyword_definition();
+
+// -------------------- Generator --------------------
+
+struct GenerateOptions {
+    // Ask whether to define unknown identifier-like tokens (in the line and in
+    // nested snippets). When false the call never writes the database, so
+    // concurrent generate() calls on one Generator are safe.
+    bool offer_definitions = true;
+    bool validate = true;          // run validate_program() on the result
+    bool lint = true;              // run lint_program() on the result
+    std::ostream *log = nullptr;   // progress notes printed while asking; nullptr discards them
+};
+
+// Wall time spent in each stage of one generate() call (prompts included).
+struct GenerateTimings {
+    std::chrono::nanoseconds tokenize{0}; // tokenizing, offering definitions, finding occurrences
+    std::chrono::nanoseconds expand{0};   // per-occurrence handlers and nesting
+    std::chrono::nanoseconds assemble{0}; // building the final program text
+    std::chrono::nanoseconds validate{0}; // validate_program()
+    std::chrono::nanoseconds lint{0};     // lint_program()
+};
+
+// A structural problem in an assembled program.
+struct ProgramIssue {
+    int line = 0;        // 1-based; 0 for the program as a whole
+    int column = 0;      // 1-based; 0 with line 0
+    std::string tag;     // occurrence whose code it is in ("occurrence 2 (token 3)"), "" if unknown
+    std::string message;
+};
+
+// Linear-time structural check of a program as make_program_from_body_lines
+// assembles it, without a compiler: balanced (), [] and {}, terminated
+// string/character literals, block comments and raw strings, no top-level name
+// defined twice and exactly one main(). Issues inside main() carry the tag of
+// the nearest preceding "// (occurrence N (token M))" comment.
+std::vector<ProgramIssue> validate_program(std::string_view program);
+
+// The tag in a comment written by the handlers: "occurrence 2 (token 3)" for
+// "// (occurrence 2 (token 3)) ...", or "" if the comment has none.
+std::string_view occurrence_tag_in(std::string_view comment);
+
+// "line 12:5 [occurrence 2 (token 3)]: '{' is never closed"
+std::string describe_issue(const ProgramIssue &issue);
+
+// A performance anti-pattern in a program or snippet, with what to write instead.
+struct LintFinding {
+    int line = 0;           // 1-based
+    std::string tag;        // occurrence whose code it is in, "" if unknown
+    std::string rule;       // "endl-in-loop", "new-in-loop", "delete-in-loop", "dynamic-cast-in-loop",
+                            // "push-back-without-reserve" or "large-by-value"
+    std::string message;
+    std::string suggestion;
+};
+
+// Linear-time lint of C++ text (a whole program or a snippet) for habits that
+// cost time at run time: endl, new, delete and dynamic_cast inside loops,
+// push_back/emplace_back in a loop on a vector never reserve()d before it, and
+// parameters of large user types taken by value. A type is large if its
+// definition in the text owns heap storage (string, containers) or is estimated
+// at more than 16 bytes. Only the names in `user_types` (Context::types when
+// generating) are checked; if it is empty, every class, struct and union the
+// text defines is. Tags are found as validate_program() finds them.
+std::vector<LintFinding> lint_program(std::string_view code, const std::set<std::string> &user_types = {});
+
+// lint_program() on a stored keyword's snippet with its parameter defaults filled in.
+std::vector<LintFinding> lint_user_keyword(const UserKeyword &uk);
+
+// "line 7 [occurrence 1 (token 1)]: 'endl' in a loop flushes ...; write '\n' ..."
+std::string describe_finding(const LintFinding &finding);
+
+struct GenerateResult {
+    bool ok = false;                                      // a program was produced
+    bool aborted = false;                                 // the answer provider hit end of input
+    std::string program;                                  // the assembled C++17 program
+    std::vector<std::pair<std::string,int>> occurrences;  // (keyword, 1-based token position)
+    std::string error;                                    // why ok == false
+    std::vector<ProgramIssue> issues;                     // from validate_program(), if enabled
+    std::vector<LintFinding> lint;                        // from lint_program(), if enabled
+    GenerateTimings timings;
+};
+
+class Generator {
+public:
+    explicit Generator(std::string db_path = USER_KW_FILE);
+
+    // (Re)load the database from db_path(); a missing file yields an empty database.
+    // See load_user_keywords() for refresh_image.
+    void load(bool refresh_image = true);
+    bool save() const;
+
+    UserKeywordDb &db() { return db_; }
+    const UserKeywordDb &db() const { return db_; }
+    const std::string &db_path() const { return db_path_; }
+
+    // Read-only keywords (e.g. system packs loaded once and shared by many
+    // Generators) consulted when db() has no entry of that name.
+    void set_shared(std::shared_ptr<const UserKeywordDb> shared);
+    const std::shared_ptr<const UserKeywordDb> &shared() const { return shared_; }
+
+    // Generate the program for one input line, asking follow-ups through `answers`.
+    GenerateResult generate(const std::string &line, const AnswerProvider &answers,
+                            const GenerateOptions &opts = GenerateOptions());
+    // Convenience: write the program into `program_out`; returns false on failure.
+    bool generate(const std::string &line, const AnswerProvider &answers, std::string &program_out);
+
+private:
+    std::string db_path_;
+    UserKeywordDb db_;
+    std::shared_ptr<const UserKeywordDb> shared_;
+};
+
+} // namespace snippetgen
+
+#endif // SNIPPETGEN_H
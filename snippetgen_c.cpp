@@ -0,0 +1,98 @@
+/*
+snippetgen C ABI implementation: wraps snippetgen::Generator behind an opaque
+handle. See snippetgen_c.h.
+*/
+
+#define SNIPPETGEN_BUILD
+#include "snippetgen_c.h"
+#include "snippetgen.h"
+
+#include <cstring>
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+
+struct sg_db {
+    snippetgen::Generator gen;
+    std::string last_program; // kept so a truncated result can be fetched without re-asking
+    std::string last_error;
+
+    explicit sg_db(const char *path) : gen(path ? path : snippetgen::USER_KW_FILE) {}
+};
+
+// Copy `s` into the caller's buffer; reports the full length either way.
+static int copy_out(const std::string &s, char *out, size_t out_cap, size_t *out_len) {
+    if (out_len) *out_len = s.size();
+    if (!out || out_cap <= s.size()) {
+        if (out && out_cap > 0) out[0] = '\0';
+        return SG_ERR_TRUNCATED;
+    }
+    std::memcpy(out, s.data(), s.size());
+    out[s.size()] = '\0';
+    return SG_OK;
+}
+
+extern "C" {
+
+int sg_abi_version(void) {
+    return SG_ABI_VERSION;
+}
+
+sg_db *sg_open_db(const char *path) {
+    try {
+        sg_db *db = new sg_db(path);
+        db->gen.load();
+        return db;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+int sg_generate(sg_db *db, const char *line, sg_answer_fn answer, void *user,
+                unsigned flags, char *out, size_t out_cap, size_t *out_len) {
+    if (!db || !line) return SG_ERR_INVALID;
+    db->last_error.clear();
+    try {
+        snippetgen::AnswerProvider provider = snippetgen::default_answers();
+        if (answer) {
+            provider = [answer, user](const snippetgen::Prompt &q) -> std::optional<std::string> {
+                std::vector<char> reply(4096, '\0');
+                int rc = answer(user, q.question.c_str(), q.default_value.c_str(), q.body_line ? 1 : 0,
+                                reply.data(), reply.size());
+                if (rc == SG_ANSWER_ABORT) return std::nullopt;
+                if (rc != SG_ANSWER_REPLY) return std::string(q.body_line ? "QED" : "");
+                reply.back() = '\0';
+                return std::string(reply.data());
+            };
+        }
+        snippetgen::GenerateOptions opts;
+        opts.offer_definitions = (flags & SG_FLAG_OFFER_DEFINITIONS) != 0;
+        snippetgen::GenerateResult res = db->gen.generate(line, provider, opts);
+        if (res.aborted) { db->last_error = res.error; return SG_ERR_ABORTED; }
+        if (!res.ok) { db->last_error = res.error; return SG_ERR_NO_KEYWORDS; }
+        db->last_program = std::move(res.program);
+        return copy_out(db->last_program, out, out_cap, out_len);
+    } catch (const std::exception &ex) {
+        db->last_error = ex.what();
+        return SG_ERR_INTERNAL;
+    } catch (...) {
+        db->last_error = "unknown error";
+        return SG_ERR_INTERNAL;
+    }
+}
+
+int sg_copy_last(const sg_db *db, char *out, size_t out_cap, size_t *out_len) {
+    if (!db) return SG_ERR_INVALID;
+    return copy_out(db->last_program, out, out_cap, out_len);
+}
+
+const char *sg_last_error(const sg_db *db) {
+    return db ? db->last_error.c_str() : "invalid handle";
+}
+
+void sg_free(sg_db *db) {
+    delete db;
+}
+
+} // extern "C"
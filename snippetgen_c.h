@@ -0,0 +1,84 @@
+/*
+snippetgen C ABI — a stable C interface to the in-process generator for editor
+plugins and other non-C++ hosts. Only opaque handles, plain C types and
+caller-provided buffers cross the boundary; no C++ exception escapes it.
+
+Build as a shared library:
+  g++ -std=c++17 -O2 -fPIC -shared -fvisibility=hidden -pthread -o libsnippetgen.so snippetgen.cpp snippetgen_c.cpp
+
+A handle is not thread-safe; open one handle per thread (or serialize calls).
+*/
+
+#ifndef SNIPPETGEN_C_H
+#define SNIPPETGEN_C_H
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(SNIPPETGEN_BUILD)
+#    define SG_API __declspec(dllexport)
+#  else
+#    define SG_API __declspec(dllimport)
+#  endif
+#else
+#  define SG_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_ABI_VERSION 1
+
+/* Status codes returned by sg_generate / sg_copy_last. */
+#define SG_OK               0
+#define SG_ERR_INVALID     -1  /* NULL handle/line or bad arguments */
+#define SG_ERR_NO_KEYWORDS -2  /* the line contains no known keyword */
+#define SG_ERR_ABORTED     -3  /* the answer callback returned SG_ANSWER_ABORT */
+#define SG_ERR_TRUNCATED   -4  /* output buffer too small; *out_len holds the required size */
+#define SG_ERR_INTERNAL    -5  /* unexpected failure; see sg_last_error */
+
+/* Return values of the answer callback. */
+#define SG_ANSWER_DEFAULT   0  /* accept the default (reply buffer ignored) */
+#define SG_ANSWER_REPLY     1  /* reply written to `reply` as a NUL-terminated string */
+#define SG_ANSWER_ABORT    -1  /* stop generating (like EOF at an interactive prompt) */
+
+/* sg_generate flags. */
+#define SG_FLAG_OFFER_DEFINITIONS 0x1u /* ask whether to define unknown tokens (and save them) */
+
+/* Called for every follow-up question. `body_line` is non-zero while a multi-line
+   body is read; reply "QED" (or SG_ANSWER_DEFAULT) to finish it. */
+typedef int (*sg_answer_fn)(void *user, const char *question, const char *default_value,
+                            int body_line, char *reply, size_t reply_cap);
+
+typedef struct sg_db sg_db;
+
+/* ABI version of the loaded library (compare with SG_ABI_VERSION). */
+SG_API int sg_abi_version(void);
+
+/* Load the keyword database at `path` (NULL = "user_keywords.db"). A missing file
+   yields an empty database. Returns NULL only on allocation failure. */
+SG_API sg_db *sg_open_db(const char *path);
+
+/* Generate the program for one keyword line. `answer` may be NULL to accept every
+   default. The program is written NUL-terminated into `out` (capacity `out_cap`);
+   `*out_len` (if non-NULL) receives its length without the NUL. On
+   SG_ERR_TRUNCATED the program is kept and can be fetched with sg_copy_last. */
+SG_API int sg_generate(sg_db *db, const char *line, sg_answer_fn answer, void *user,
+                       unsigned flags, char *out, size_t out_cap, size_t *out_len);
+
+/* Copy the program produced by the last successful or truncated sg_generate. */
+SG_API int sg_copy_last(const sg_db *db, char *out, size_t out_cap, size_t *out_len);
+
+/* Message for the last failed call on this handle ("" if none). Valid until the
+   next call on the handle. */
+SG_API const char *sg_last_error(const sg_db *db);
+
+/* Release the handle. NULL is ignored. */
+SG_API void sg_free(sg_db *db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNIPPETGEN_C_H */
@@ -0,0 +1,53 @@
+# Golden-output test for `snippet_gen --jsonl`.
+#
+#   cmake -DPROGRAM=<snippet_gen> -DDB=<db> -DINPUT=<requests.jsonl>
+#         -DACTUAL=<output file> [-DEXPECTED=<expected file>] [-DUPDATE=ON]
+#         [-DREPEAT=N] -P golden.cmake
+#
+# Timings differ on every run, so the "timings" object is removed from each
+# response before comparing. Without EXPECTED the requests are only run (used
+# for PGO training); UPDATE=ON rewrites EXPECTED instead of comparing.
+
+foreach(var PROGRAM DB INPUT ACTUAL)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "golden.cmake: ${var} is not set")
+    endif()
+endforeach()
+
+set(input "${INPUT}")
+if(DEFINED REPEAT AND REPEAT GREATER 1)
+    file(READ "${INPUT}" requests)
+    string(REPEAT "${requests}" ${REPEAT} requests)
+    set(input "${ACTUAL}.in")
+    file(WRITE "${input}" "${requests}")
+endif()
+
+get_filename_component(actual_dir "${ACTUAL}" DIRECTORY)
+file(MAKE_DIRECTORY "${actual_dir}")
+execute_process(COMMAND "${PROGRAM}" --db "${DB}" --jsonl
+                INPUT_FILE "${input}"
+                OUTPUT_FILE "${ACTUAL}"
+                RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${PROGRAM} --jsonl exited with ${rc}")
+endif()
+if(NOT DEFINED EXPECTED)
+    return()
+endif()
+
+file(READ "${ACTUAL}" actual)
+string(REGEX REPLACE ",\"timings\":{[^}]*}" "" actual "${actual}")
+file(WRITE "${ACTUAL}" "${actual}")
+
+if(UPDATE)
+    file(WRITE "${EXPECTED}" "${actual}")
+    message(STATUS "Wrote ${EXPECTED}")
+    return()
+endif()
+
+file(READ "${EXPECTED}" expected)
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "Output differs from ${EXPECTED}\n"
+                        "  actual output: ${ACTUAL}\n"
+                        "  after an intended change: cmake --build <dir> --target update-golden")
+endif()
@@ -0,0 +1,713 @@
+/*
+snippet_test — checks of the server-side modules that the golden --jsonl test
+cannot reach: servers started as child processes, concurrency and failure
+paths. Each check is a subcommand, registered as its own ctest test:
+
+  snippet_test coordinator <snippet_gen>   --coordinate against a local --serve socket
+  snippet_test replica <snippet_gen>       a --replica server following a journal
+  snippet_test admission <snippet_gen>     busy, idle and cancelled sessions
+  snippet_test shm <snippet_gen>           replies through the shared-memory ring (Linux)
+  snippet_test run_command                 child processes of the build helpers
+  snippet_test c_abi                       the C interface (snippetgen_c.h)
+  snippet_test tenants                     tenant pool eviction and pinning
+  snippet_test delta                       :export-delta / :import-delta and conflicts
+
+A check prints what failed and exits 1; it exits 0 when everything held.
+*/
+
+#include "snippetgen.h"
+#include "snippet_build.h"
+#include "snippet_coordinator.h"
+#include "snippet_jsonl.h"
+#include "snippet_server.h"
+#include "snippet_shm.h"
+#include "snippet_tenants.h"
+#include "snippetgen_c.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::string;
+using std::vector;
+
+using namespace snippetgen;
+
+#ifdef _WIN32
+
+int main() {
+    cerr << "snippet_test needs a POSIX system.\n";
+    return 1;
+}
+
+#else
+
+// -------------------- Helpers --------------------
+
+static int g_failures = 0;
+static vector<pid_t> g_children; // stopped before giving up on a hung check
+
+static void check(bool ok, const string &what) {
+    if (ok) return;
+    cerr << "FAILED: " << what << "\n";
+    ++g_failures;
+}
+
+// Run `body` on its own thread; a check that is still running after
+// `timeout` has hung, which no later check can recover from.
+static void within(std::chrono::seconds timeout, const string &what, std::function<void()> body) {
+    auto done = std::async(std::launch::async, std::move(body));
+    if (done.wait_for(timeout) == std::future_status::timeout) {
+        cerr << "FAILED: " << what << " did not finish within " << timeout.count() << " s\n";
+        for (pid_t pid : g_children) ::kill(pid, SIGKILL);
+        std::_Exit(1);
+    }
+    done.get();
+}
+
+// A fresh directory under $TMPDIR, removed with everything in it.
+class TempDir {
+    string path_;
+public:
+    TempDir() {
+        const char *base = std::getenv("TMPDIR");
+        string pattern = string(base && *base ? base : "/tmp") + "/snippet_test.XXXXXX";
+        vector<char> buf(pattern.begin(), pattern.end());
+        buf.push_back('\0');
+        if (::mkdtemp(buf.data())) path_ = buf.data();
+    }
+    ~TempDir() {
+        std::error_code ec;
+        if (!path_.empty()) std::filesystem::remove_all(path_, ec);
+    }
+    bool ok() const { return !path_.empty(); }
+    const string &path() const { return path_; }
+    string file(const string &name) const { return path_ + "/" + name; }
+};
+
+// `snippet_gen <args>` as a child process, stopped (SIGTERM) on destruction.
+class ChildProcess {
+    pid_t pid_ = -1;
+public:
+    explicit ChildProcess(const vector<string> &args) {
+        vector<char*> argv;
+        for (const auto &a : args) argv.push_back(const_cast<char*>(a.c_str()));
+        argv.push_back(nullptr);
+        pid_ = ::fork();
+        if (pid_ == 0) {
+            ::execv(argv[0], argv.data());
+            ::_exit(127);
+        }
+        if (pid_ > 0) g_children.push_back(pid_);
+    }
+    ~ChildProcess() { stop(); }
+    bool started() const { return pid_ > 0; }
+    int stop() {
+        if (pid_ <= 0) return -1;
+        ::kill(pid_, SIGTERM);
+        int status = 0;
+        ::waitpid(pid_, &status, 0);
+        g_children.erase(std::find(g_children.begin(), g_children.end(), pid_));
+        pid_ = -1;
+        return status;
+    }
+};
+
+// Wait until a server accepts connections at `address`.
+static bool wait_for_server(const string &address) {
+    for (int i = 0; i < 200; ++i) {
+        string error;
+        int fd = connect_to_server(address, error);
+        if (fd >= 0) { ::close(fd); return true; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+static vector<string> split_lines(const string &s) {
+    vector<string> lines;
+    std::istringstream is(s);
+    string line;
+    while (std::getline(is, line)) lines.push_back(line);
+    return lines;
+}
+
+// One request on a fresh connection: the program of an OK reply, "" otherwise.
+static string request_program(const string &address, const string &line) {
+    string error;
+    int fd = connect_to_server(address, error);
+    if (fd < 0) return string();
+    const string msg = line + "\n";
+    string reply;
+    if (::write(fd, msg.data(), msg.size()) == static_cast<ssize_t>(msg.size())) {
+        char buf[4096];
+        size_t want = string::npos;
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+            reply.append(buf, static_cast<size_t>(n));
+            const size_t nl = reply.find('\n');
+            if (want == string::npos && nl != string::npos) {
+                if (reply.rfind("OK ", 0) != 0) break;
+                want = nl + 1 + std::stoul(reply.substr(3, nl - 3));
+            }
+            if (reply.size() >= want) break;
+        }
+        if (want == string::npos || reply.size() < want) reply.clear();
+        else reply = reply.substr(reply.find('\n') + 1, want - reply.find('\n') - 1);
+    }
+    ::close(fd);
+    return reply;
+}
+
+// Poll `cond` for up to 10 s.
+static bool eventually(const std::function<bool()> &cond) {
+    for (int i = 0; i < 200; ++i) {
+        if (cond()) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+static UserKeyword keyword(const string &snippet) {
+    UserKeyword uk;
+    uk.snippet = snippet;
+    return uk;
+}
+
+// An output whose every write fails, like a full disk.
+class FullBuf : public std::streambuf {
+protected:
+    int_type overflow(int_type) override { return traits_type::eof(); }
+};
+
+// -------------------- coordinator --------------------
+
+static void test_coordinator(const string &snippet_gen) {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    const string sock = dir.file("worker.sock");
+    ChildProcess server({snippet_gen, "--db", dir.file("keywords.db"), "--serve", sock, "--workers", "2"});
+    check(server.started() && wait_for_server(sock), "server listening on " + sock);
+
+    static const char *lines[] = {"int", "for if", "struct class template", "while"};
+    std::ostringstream requests;
+    const int n = 400;
+    for (int i = 0; i < n; ++i)
+        requests << "{\"id\": \"r" << i << "\", \"line\": \"" << lines[i % 4] << "\"}\n";
+
+    CoordinatorOptions opts;
+    opts.workers = {sock};
+    opts.connections = 2;
+    opts.shard_size = 7;
+
+    within(std::chrono::seconds(60), "coordinated run", [&] {
+        std::istringstream in(requests.str());
+        std::ostringstream out;
+        check(run_coordinator(opts, in, out) == 0, "coordinated run exits 0");
+        const vector<string> responses = split_lines(out.str());
+        check(responses.size() == static_cast<size_t>(n), "one response per request");
+        for (size_t i = 0; i < responses.size(); ++i) {
+            const string id = "{\"id\":\"r" + std::to_string(i) + "\",\"ok\":true,";
+            if (responses[i].rfind(id, 0) != 0) {
+                check(false, "response " + std::to_string(i) + " in input order and ok: " + responses[i].substr(0, 80));
+                break;
+            }
+        }
+    });
+
+    // every write fails: the run must end (exit 1) rather than wait on the writer
+    opts.connections = 1;
+    opts.shard_size = 1;
+    opts.inflight_shards = 200;
+    within(std::chrono::seconds(60), "coordinated run to a failing output", [&] {
+        std::istringstream in(requests.str());
+        FullBuf full;
+        std::ostream out(&full);
+        check(run_coordinator(opts, in, out) == 1, "failing output exits 1");
+    });
+
+    // nobody listening: every request is answered with an error
+    opts.workers = {dir.file("nobody.sock")};
+    opts.max_attempts = 1;
+    within(std::chrono::seconds(60), "coordinated run without a worker", [&] {
+        std::istringstream in("{\"id\": \"x\", \"line\": \"int\"}\n");
+        std::ostringstream out;
+        check(run_coordinator(opts, in, out) == 1, "unreachable worker exits 1");
+        check(out.str().find("\"ok\":false") != string::npos, "unreachable worker answers with an error");
+    });
+}
+
+// -------------------- replica --------------------
+
+static void test_replica(const string &snippet_gen) {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    const string db_path = dir.file("keywords.db");
+    const string sock = dir.file("replica.sock");
+    UserKeywordDb db;
+    put_user_keyword(db, "alpha", keyword("int alpha_marker = 1;\n"));
+    check(save_user_keywords(db, db_path) && init_keyword_journal(db, db_path), "writer database and journal");
+
+    ChildProcess replica({snippet_gen, "--db", db_path, "--serve", sock, "--workers", "2", "--replica"});
+    check(replica.started() && wait_for_server(sock), "replica listening on " + sock);
+    check(request_program(sock, "alpha").find("alpha_marker") != string::npos, "replica serves the loaded database");
+
+    // the writer saves twice; every worker catches up without reloading
+    put_user_keyword(db, "beta", keyword("int beta_marker = 2;\n"));
+    check(save_user_keywords(db, db_path), "writer save");
+    erase_user_keyword(db, "alpha");
+    check(save_user_keywords(db, db_path), "writer save");
+    for (int i = 0; i < 4; ++i) {
+        check(eventually([&] { return request_program(sock, "beta").find("beta_marker") != string::npos; }),
+              "replica applies an added keyword");
+        check(eventually([&] { return request_program(sock, "alpha").find("alpha_marker") == string::npos; }),
+              "replica applies a deletion");
+    }
+
+    // the writer goes back to an older, smaller database and starts the
+    // journal over: the replica must follow it down, not skip it as old
+    UserKeywordDb older;
+    put_user_keyword(older, "gamma", keyword("int gamma_marker = 3;\n"));
+    check(older.version < db.version, "older database has a lower version");
+    check(save_user_keywords(older, db_path) && init_keyword_journal(older, db_path), "journal re-initialized");
+    for (int i = 0; i < 4; ++i) {
+        check(eventually([&] { return request_program(sock, "gamma").find("gamma_marker") != string::npos; }),
+              "replica follows a re-initialized journal");
+        check(eventually([&] { return request_program(sock, "beta").find("beta_marker") == string::npos; }),
+              "replica drops what the re-initialized journal does not have");
+    }
+}
+
+// -------------------- admission --------------------
+
+// Everything the server sends on `fd` until it closes the connection; "" if
+// it is still open after 10 s.
+static string read_until_closed(int fd) {
+    string got;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+        pollfd p{fd, POLLIN, 0};
+        if (::poll(&p, 1, 100) <= 0) continue;
+        char buf[4096];
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) return got;
+        got.append(buf, static_cast<size_t>(n));
+    }
+    return string();
+}
+
+static void test_admission(const string &snippet_gen) {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    const string sock = dir.file("admission.sock");
+    ChildProcess server({snippet_gen, "--db", dir.file("keywords.db"), "--serve", sock, "--max-sessions", "1",
+                         "--max-queue", "0", "--idle-timeout", "1"});
+    check(server.started() && wait_for_server(sock), "server listening on " + sock);
+
+    // take the only session (the readiness probe may still hold it briefly)
+    int held = -1;
+    check(eventually([&] {
+              string error;
+              held = connect_to_server(sock, error);
+              if (held < 0) return false;
+              // read the whole framed reply, so only what follows is left
+              const string msg = "int\n";
+              string reply;
+              size_t want = string::npos;
+              char buf[256];
+              ssize_t n = 0;
+              if (::write(held, msg.data(), msg.size()) == static_cast<ssize_t>(msg.size())) {
+                  while (reply.size() < want && (n = ::read(held, buf, sizeof(buf))) > 0) {
+                      reply.append(buf, static_cast<size_t>(n));
+                      const size_t nl = reply.find('\n');
+                      if (want == string::npos && nl != string::npos) {
+                          if (reply.rfind("OK ", 0) != 0) break;
+                          want = nl + 1 + std::stoul(reply.substr(3, nl - 3));
+                      }
+                  }
+              }
+              if (want != string::npos && reply.size() == want) return true;
+              ::close(held);
+              held = -1;
+              return false;
+          }),
+          "a session is admitted");
+    if (held < 0) return;
+
+    // no free session and no room in the queue
+    string error;
+    int rejected = connect_to_server(sock, error);
+    check(rejected >= 0 && read_until_closed(rejected) == "ERR server busy\n", "a full queue answers ERR server busy");
+    if (rejected >= 0) ::close(rejected);
+
+    // the held session says nothing for --idle-timeout and is closed
+    const auto idle_since = std::chrono::steady_clock::now();
+    check(read_until_closed(held) == "ERR idle timeout\n", "an idle session gets ERR idle timeout and is closed");
+    check(std::chrono::steady_clock::now() - idle_since >= std::chrono::milliseconds(500),
+          "the session was closed for idling, not at once");
+    ::close(held);
+    check(eventually([&] { return request_program(sock, "int").find("int x = 0;") != string::npos; }),
+          "the closed session's slot is free again");
+
+    // a request cancelled at its first follow-up question
+    Generator gen(dir.file("keywords.db"));
+    int asked = 0;
+    const string reply = handle_jsonl_request(gen, R"({"id":7,"line":"int"})", [&] { return ++asked > 0; });
+    check(asked == 1 && reply.rfind(R"({"id":7,"ok":false,)", 0) == 0 &&
+          reply.find(R"("error":"cancelled")") != string::npos,
+          "a cancelled request answers \"error\":\"cancelled\"");
+}
+
+// -------------------- shm --------------------
+
+// A session upgraded by hand ("@shm"), mapping the ring writable as ShmClient
+// does, then scribbling over every header field after the magic. The server
+// must end that session, and only that session.
+static void scribble_ring_header(const string &sock) {
+    string error;
+    int fd = connect_to_server(sock, error);
+    check(fd >= 0, "raw shm session connects: " + error);
+    if (fd < 0) return;
+    const string hello = "@shm " + std::to_string(SHM_MIN_RING) + "\n";
+    check(::write(fd, hello.data(), hello.size()) == static_cast<ssize_t>(hello.size()), "raw shm hello");
+    char buf[64];
+    int fds[3] = {-1, -1, -1};
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    const ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (cm && cm->cmsg_type == SCM_RIGHTS && cm->cmsg_len == CMSG_LEN(sizeof(fds))) std::memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    check(n > 0 && string(buf, static_cast<size_t>(n)).rfind("OK", 0) == 0 && fds[0] >= 0, "raw shm upgrade");
+    void *mem = fds[0] < 0 ? MAP_FAILED : ::mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    check(mem != MAP_FAILED, "raw shm mapping");
+    if (mem != MAP_FAILED) {
+        std::memset(static_cast<char*>(mem) + 8, 0xff, 4096 - 8);
+        ::munmap(mem, 4096);
+    }
+    const string req = "int\n";
+    check(::write(fd, req.data(), req.size()) == static_cast<ssize_t>(req.size()), "raw shm request");
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    check(::poll(&pfd, 1, 10000) == 1 && ::read(fd, buf, sizeof(buf)) == 0, "server ends a session with a corrupted ring");
+    for (int f : fds) if (f >= 0) ::close(f);
+    ::close(fd);
+}
+
+static void test_shm(const string &snippet_gen) {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    const string sock = dir.file("server.sock");
+    ChildProcess server({snippet_gen, "--db", dir.file("keywords.db"), "--serve", sock});
+    check(server.started() && wait_for_server(sock), "server listening on " + sock);
+
+    within(std::chrono::seconds(60), "shm requests", [&] {
+        ShmClient client;
+        string error;
+        check(client.connect(sock, SHM_MIN_RING, error), "shm upgrade: " + error);
+        if (!error.empty()) return;
+        // replies of a few KiB in the smallest ring wrap around it many times
+        static const char *lines[] = {"int", "for if", "struct class template", "while switch", "int int int int"};
+        for (int i = 0; i < 500; ++i) {
+            const string line = lines[i % 5];
+            bool ok = false;
+            std::string_view reply;
+            if (!client.request(line, ok, reply, error)) { check(false, "shm request " + std::to_string(i) + ": " + error); return; }
+            if (!ok || reply != request_program(sock, line)) { check(false, "shm reply " + std::to_string(i) + " equals the socket reply"); return; }
+        }
+        // over half the ring: answered with an error, and the session goes on
+        string big;
+        for (int i = 0; i < 600; ++i) big += "int ";
+        bool ok = true;
+        std::string_view reply;
+        check(client.request(big, ok, reply, error) && !ok && reply.find("shared memory ring") != string::npos,
+              "a reply over half the ring is an ERR record");
+        check(client.request("int", ok, reply, error) && ok && reply == request_program(sock, "int"),
+              "the session continues after an oversized reply");
+    });
+
+    within(std::chrono::seconds(60), "corrupted ring header", [&] { scribble_ring_header(sock); });
+    check(!request_program(sock, "int").empty(), "server still serves after a corrupted ring");
+}
+
+// -------------------- run_command --------------------
+
+static void test_run_command() {
+    within(std::chrono::seconds(30), "run_command", [&] {
+        CommandResult r = run_command({"sh", "-c", "echo hi; exit 3"}, "", 5000);
+        check(r.started && r.exit_code == 3 && r.output == "hi\n" && !r.timed_out, "run_command captures output and exit code");
+
+        // the deadline holds after the program closed its output
+        const auto start = std::chrono::steady_clock::now();
+        r = run_command({"sh", "-c", "exec >/dev/null 2>&1; sleep 20"}, "", 300);
+        check(r.timed_out && r.signal == SIGKILL, "run_command kills a program that closed its output");
+        check(std::chrono::steady_clock::now() - start < std::chrono::seconds(10), "run_command returns at the deadline");
+
+        r = run_command({"sleep", "20"}, "", 300, {}, true);
+        check(r.timed_out && r.signal == SIGKILL, "run_command kills a counted program at its timeout");
+        r = run_command({"snippet-test-no-such-program"}, "", 5000, {}, true);
+        check(!r.started, "run_command reports a program that does not exist");
+    });
+
+    // counted runs from many threads at once, as --matrix starts them
+    within(std::chrono::seconds(60), "concurrent counted run_command", [&] {
+        for (int round = 0; round < 4; ++round) {
+            vector<std::thread> threads;
+            vector<CommandResult> results(16);
+            for (size_t k = 0; k < results.size(); ++k) {
+                threads.emplace_back([&results, k] { results[k] = run_command({"true"}, "", 5000, {}, true); });
+            }
+            for (auto &th : threads) th.join();
+            for (const auto &r : results) {
+                if (!r.started || r.timed_out || r.exit_code != 0) { check(false, "every concurrent counted run exits 0"); return; }
+            }
+        }
+    });
+}
+
+// -------------------- C ABI --------------------
+
+struct AbiAnswers {
+    vector<string> questions;
+    bool abort = false;
+};
+
+static int abi_answer(void *user, const char *question, const char *, int, char *reply, size_t reply_cap) {
+    AbiAnswers &a = *static_cast<AbiAnswers*>(user);
+    a.questions.push_back(question);
+    if (a.abort) return SG_ANSWER_ABORT;
+    if (string(question).find("Variable name") == string::npos) return SG_ANSWER_DEFAULT;
+    std::snprintf(reply, reply_cap, "%s", "abi_count");
+    return SG_ANSWER_REPLY;
+}
+
+static void test_c_abi() {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    check(sg_abi_version() == SG_ABI_VERSION, "sg_abi_version matches the header");
+    sg_db *db = sg_open_db(dir.file("missing.db").c_str());
+    check(db != nullptr, "sg_open_db opens a missing database as an empty one");
+    if (!db) return;
+
+    char out[16384];
+    size_t len = 0;
+    int rc = sg_generate(db, "int", nullptr, nullptr, 0, out, sizeof(out), &len);
+    const string defaults = rc == SG_OK ? string(out) : string();
+    check(rc == SG_OK && len == defaults.size() && defaults.find("int x = 0;") != string::npos,
+          "sg_generate with every default");
+
+    AbiAnswers answers;
+    rc = sg_generate(db, "int", abi_answer, &answers, 0, out, sizeof(out), &len);
+    check(rc == SG_OK && string(out).find("int abi_count = 0;") != string::npos, "the answer callback's reply is used");
+    check(answers.questions.size() == 2, "the callback sees every question");
+
+    answers = AbiAnswers();
+    answers.abort = true;
+    rc = sg_generate(db, "int", abi_answer, &answers, 0, out, sizeof(out), &len);
+    check(rc == SG_ERR_ABORTED && answers.questions.size() == 1, "SG_ANSWER_ABORT stops generating");
+
+    char small[8];
+    len = 0;
+    rc = sg_generate(db, "int", nullptr, nullptr, 0, small, sizeof(small), &len);
+    check(rc == SG_ERR_TRUNCATED && len == defaults.size() && small[0] == '\0',
+          "a small buffer is truncated and reports the size needed");
+    vector<char> big(len + 1);
+    size_t copied = 0;
+    rc = sg_copy_last(db, big.data(), big.size(), &copied);
+    check(rc == SG_OK && copied == len && string(big.data()) == defaults, "sg_copy_last returns the truncated program");
+
+    rc = sg_generate(db, "no keyword here", nullptr, nullptr, 0, out, sizeof(out), &len);
+    check(rc == SG_ERR_NO_KEYWORDS && *sg_last_error(db) != '\0', "a line without keywords fails with a message");
+    check(sg_generate(nullptr, "int", nullptr, nullptr, 0, out, sizeof(out), &len) == SG_ERR_INVALID &&
+          sg_generate(db, nullptr, nullptr, nullptr, 0, out, sizeof(out), &len) == SG_ERR_INVALID,
+          "NULL handle or line is SG_ERR_INVALID");
+    sg_free(db);
+    sg_free(nullptr);
+}
+
+// -------------------- tenants --------------------
+
+static void test_tenants() {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    // identical databases, so every tenant costs the same bytes
+    for (const char *name : {"a", "b", "c"}) {
+        UserKeywordDb db;
+        UserKeyword uk;
+        uk.snippet = "int ${name} = ${value};";
+        uk.params = {{"name", "n"}, {"value", "1"}};
+        put_user_keyword(db, "tenant_kw", uk);
+        check(save_user_keywords(db, dir.file(string(name) + ".db")), "tenant database saved");
+    }
+    auto system = std::make_shared<const UserKeywordDb>();
+    string error;
+
+    size_t one = 0;
+    {
+        TenantPool probe(dir.path(), SIZE_MAX, system);
+        check(probe.acquire("a", error) != nullptr, "tenant loads");
+        one = probe.stats().bytes;
+    }
+    check(one > 0, "a loaded tenant has a size");
+    check(TenantPool(dir.path(), SIZE_MAX, system).acquire("nobody", error) == nullptr && !error.empty(),
+          "an unknown tenant is an error");
+
+    // room for two tenants: the least recently used one goes
+    {
+        TenantPool pool(dir.path(), one * 5 / 2, system);
+        for (const char *name : {"a", "b", "c"}) pool.acquire(name, error);
+        TenantPool::Stats s = pool.stats();
+        check(s.loaded == 2 && s.evictions == 1 && s.bytes == 2 * one, "LRU eviction keeps the pool within budget");
+        pool.acquire("b", error); // b is now more recent than c
+        pool.acquire("a", error); // reloads a, evicting c
+        s = pool.stats();
+        check(s.loads == 4 && s.hits == 1 && s.evictions == 2, "the least recently used tenant is evicted");
+        pool.acquire("b", error);
+        check(pool.stats().hits == 2, "the recently used tenant stayed loaded");
+    }
+
+    // a pinned tenant survives eviction even when it is the oldest
+    {
+        TenantPool pool(dir.path(), one * 5 / 2, system);
+        std::shared_ptr<Generator> a = pool.acquire("a", error);
+        pool.acquire("b", error);
+        pool.acquire("c", error);
+        TenantPool::Stats s = pool.stats();
+        check(a && s.loaded == 2 && s.evictions == 1, "an unpinned tenant is evicted instead of the pinned one");
+        pool.acquire("a", error);
+        check(pool.stats().hits == 1, "the pinned tenant stayed loaded");
+    }
+
+    // over budget while everything is pinned; each release evicts again
+    {
+        TenantPool pool(dir.path(), one * 3 / 2, system);
+        std::shared_ptr<Generator> a = pool.acquire("a", error);
+        std::shared_ptr<Generator> b = pool.acquire("b", error);
+        std::shared_ptr<Generator> c = pool.acquire("c", error);
+        check(pool.stats().loaded == 3 && pool.stats().evictions == 0, "pinned tenants are not evicted");
+        a.reset();
+        check(pool.stats().loaded == 2 && pool.stats().evictions == 1, "releasing a pin re-runs eviction");
+        b.reset();
+        check(pool.stats().loaded == 1 && pool.stats().evictions == 2, "each release evicts while over budget");
+        c.reset();
+        check(pool.stats().loaded == 1 && pool.stats().bytes == one, "eviction stops within budget");
+    }
+}
+
+// -------------------- delta --------------------
+
+static void test_delta() {
+    TempDir dir;
+    check(dir.ok(), "temporary directory");
+    const string file = dir.file("sync.delta");
+    UserKeywordDb a, b;
+    vector<string> conflicts;
+    put_user_keyword(a, "alpha", keyword("int alpha = 1;\n"));
+    put_user_keyword(a, "beta", keyword("int beta = 1;\n"));
+    put_user_keyword(a, "gamma", keyword("int gamma = 1;\n"));
+
+    // first sync: everything
+    check(export_user_keywords_delta(a, 0, file) == 3 && a.synced == a.version, "export everything");
+    check(import_user_keywords_delta(b, file, &conflicts) == 3 && conflicts.empty() && b.synced == b.version &&
+          b.index.size() == 3, "import everything into an empty database");
+    check(import_user_keywords_delta(b, file, &conflicts) == 0 && conflicts.empty(), "re-importing changes nothing");
+
+    // changes on one side only are applied, deletions included
+    const uint64_t since = a.version;
+    put_user_keyword(a, "alpha", keyword("int alpha = 2;\n"));
+    erase_user_keyword(a, "beta");
+    check(export_user_keywords_delta(a, since, file) == 2, "export the changes since the last export");
+    check(import_user_keywords_delta(b, file, &conflicts) == 2 && conflicts.empty() &&
+          b.entries.at("alpha").snippet == "int alpha = 2;\n" && !b.entries.count("beta"),
+          "an update and a deletion are applied");
+
+    // both sides changed gamma since the sync: the local edit is kept
+    const uint64_t since2 = a.version;
+    put_user_keyword(a, "gamma", keyword("int gamma = 2;\n"));
+    put_user_keyword(b, "gamma", keyword("int gamma = 3;\n"));
+    put_user_keyword(b, "delta", keyword("int delta = 3;\n"));
+    put_user_keyword(a, "delta", keyword("int delta = 2;\n"));
+    erase_user_keyword(a, "delta");
+    check(export_user_keywords_delta(a, since2, file) == 2, "export a conflicting update and deletion");
+    check(import_user_keywords_delta(b, file, &conflicts) == 0 && conflicts == vector<string>{"gamma", "delta"},
+          "local changes newer than the last sync are reported as conflicts");
+    check(b.entries.at("gamma").snippet == "int gamma = 3;\n" && b.entries.count("delta"),
+          "conflicting local changes are not overwritten");
+
+    // the sync point survives a save and a load, from the text and the image
+    const string db_path = dir.file("b.db");
+    check(save_user_keywords(b, db_path), "save the synced database");
+    for (int i = 0; i < 2; ++i) {
+        UserKeywordDb loaded;
+        load_user_keywords(loaded, db_path);
+        check(loaded.synced == b.synced && loaded.version == b.version, "the last sync is saved with the database");
+    }
+
+    // importing again after the conflicts takes the delta's side
+    conflicts.clear();
+    check(import_user_keywords_delta(b, file, &conflicts) == 2 && conflicts.empty() &&
+          b.entries.at("gamma").snippet == "int gamma = 2;\n" && !b.entries.count("delta"),
+          "a second import replaces the kept changes");
+    check(import_user_keywords_delta(b, dir.file("missing.delta")) == -1, "a missing delta file is an error");
+}
+
+// -------------------- main --------------------
+
+static int usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " coordinator|replica|admission|shm <snippet_gen> | run_command|c_abi|tenants|delta\n";
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) return usage(argv[0]);
+    const string what = argv[1];
+    ::signal(SIGPIPE, SIG_IGN);
+    if (what == "coordinator" && argc == 3) test_coordinator(argv[2]);
+    else if (what == "replica" && argc == 3) test_replica(argv[2]);
+    else if (what == "admission" && argc == 3) test_admission(argv[2]);
+    else if (what == "shm" && argc == 3) test_shm(argv[2]);
+    else if (what == "run_command" && argc == 2) test_run_command();
+    else if (what == "c_abi" && argc == 2) test_c_abi();
+    else if (what == "tenants" && argc == 2) test_tenants();
+    else if (what == "delta" && argc == 2) test_delta();
+    else return usage(argv[0]);
+    if (g_failures) {
+        cerr << what << ": " << g_failures << " check(s) failed.\n";
+        return 1;
+    }
+    return 0;
+}
+
+#endif // _WIN32